@@ -0,0 +1,145 @@
+/* allocator.hpp -- v1.0
+   Buffer allocation policies for the block encoder and decoder (Talloc) */
+
+#pragma once
+
+#include "stats.hpp"
+#include <cstddef>
+#include <new>
+
+namespace steg {
+    /*! @class: allocates/deallocates using new/delete
+     */
+    class BasicAllocator {
+    public:
+        static void deallocate(const char* const v)
+        {
+            delete[] v;
+        }
+
+        // Uninitialized, callers zero what they need
+        static char* allocate(const std::size_t size)
+        {
+            return new char[size];
+        }
+    };
+
+    /*! @class: keeps freed blocks per thread and hands them out again, so a
+     *  worker running many jobs stops allocating once it has seen the largest
+     */
+    class ScratchAllocator {
+    public:
+        static void deallocate(const char* const v)
+        {
+            if (v == nullptr) {
+                return;
+            }
+
+            char* block = const_cast<char*>(v) - kHeader;
+            Cache& cache = local();
+
+            // Full cache: evict the smallest block if this one is larger
+            std::size_t slot = 0;
+            for (std::size_t i = 0; i != kSlots; ++i) {
+                if (cache.blocks[i] == nullptr) {
+                    slot = i;
+                    break;
+                }
+
+                if (capacity(cache.blocks[i]) < capacity(cache.blocks[slot])) {
+                    slot = i;
+                }
+            }
+
+            if (cache.blocks[slot] != nullptr
+                && capacity(cache.blocks[slot]) >= capacity(block)) {
+                delete[] block;
+                return;
+            }
+
+            delete[] cache.blocks[slot];
+            cache.blocks[slot] = block;
+        }
+
+        // Uninitialized, callers zero what they need
+        static char* allocate(const std::size_t size)
+        {
+            Cache& cache = local();
+
+            // Smallest cached block that fits
+            char** best = nullptr;
+            for (char*& block: cache.blocks) {
+                if (block != nullptr && capacity(block) >= size
+                    && (best == nullptr || capacity(block) < capacity(*best))) {
+                    best = &block;
+                }
+            }
+
+            char* block = nullptr;
+            if (best != nullptr) {
+                block = *best;
+                *best = nullptr;
+            } else {
+                block = new char[size + kHeader];
+                *reinterpret_cast<std::size_t*>(block) = size;
+            }
+
+            return block + kHeader;
+        }
+    private:
+        // Block capacity is stored in front of the memory handed out
+        static constexpr std::size_t kHeader = alignof(std::max_align_t);
+
+        // Blocks kept per thread; the encoder holds two at a time
+        static constexpr std::size_t kSlots = 4;
+
+        // @bag
+        struct Cache {
+            char* blocks[kSlots] = {};
+
+            ~Cache()
+            {
+                for (char* block: blocks) {
+                    delete[] block;
+                }
+            }
+        };
+
+        static std::size_t capacity(const char* block)
+        {
+            return *reinterpret_cast<const std::size_t*>(block);
+        }
+
+        static Cache& local()
+        {
+            thread_local Cache cache;
+            return cache;
+        }
+    };
+
+    /*! @class: allocates through another policy and counts the blocks in the
+     *  running stage's --stats totals
+     */
+    template <typename Talloc>
+    class CountingAllocator {
+    public:
+        static void deallocate(const char* const v)
+        {
+            if (v == nullptr) {
+                return;
+            }
+
+            const char* block = v - sizeof(AllocHeader);
+            Stats::release(*reinterpret_cast<const AllocHeader*>(block));
+            Talloc::deallocate(block);
+        }
+
+        // Uninitialized, callers zero what they need
+        static char* allocate(const std::size_t size)
+        {
+            char* block = Talloc::allocate(size + sizeof(AllocHeader));
+            Stats::track(*reinterpret_cast<AllocHeader*>(block), size);
+            return block + sizeof(AllocHeader);
+        }
+    };
+} // namespace steg
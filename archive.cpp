@@ -0,0 +1,405 @@
+/* archive.cpp -- v1.0 */
+
+#include "archive.hpp"
+#include "allocator.hpp"
+#include "block_decoder.hpp"
+#include "block_encoder.hpp"
+#include "log.hpp"
+#include "seekable.hpp"
+#include "stream.hpp"
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <gcrypt.h>
+#include <memory>
+#include <type_traits>
+#include <unordered_set>
+
+namespace {
+    constexpr char kMagic[4] = {'S', 'T', 'G', 'A'};
+    constexpr std::uint8_t kVersion = 1;
+
+    // Size of an entry record, less its name
+    constexpr std::size_t kRecordSize = 24;
+
+    // Helper: appends a big-endian integer
+    template <typename T>
+    void put(std::string& out, T value)
+    {
+        char bytes[sizeof(T)];
+        for (std::size_t i = sizeof(T); i != 0; --i) {
+            bytes[i - 1] = static_cast<char>(value & 0xff);
+            value = static_cast<T>(value >> 8);
+        }
+
+        out.append(bytes, sizeof(T));
+    }
+
+    // Helper: loads a big-endian integer
+    template <typename T>
+    T get(const char* ptr)
+    {
+        T value = 0;
+        for (std::size_t i = 0; i != sizeof(T); ++i) {
+            const auto byte = static_cast<unsigned char>(ptr[i]);
+            value = static_cast<T>((value << 8) | byte);
+        }
+
+        return value;
+    }
+
+    // Helper: CRC-32 (ISO 3309, as in zlib and png) of a buffer
+    std::uint32_t crc32(const char* data, const std::size_t size)
+    {
+        unsigned char digest[4];
+        ::gcry_md_hash_buffer(GCRY_MD_CRC32, digest, data, size);
+        return get<std::uint32_t>(reinterpret_cast<const char*>(digest));
+    }
+
+    // Helper: logs a damaged archive
+    bool corrupt(const char* what)
+    {
+        steg::Log::error("Archive is damaged,", what);
+        return false;
+    }
+} // namespace
+
+/*! Packs files into an archive payload.
+ */
+bool steg::archive_pack(const std::vector<std::string>& paths,
+                        std::string& out)
+{
+    std::vector<ArchiveEntry> entries(paths.size());
+    std::unordered_set<std::string> names;
+    std::string data;
+
+    for (std::size_t i = 0; i != paths.size(); ++i) {
+        const std::size_t offset = data.size();
+        if (!read_all(paths[i].c_str(), data)) {
+            Log::error("Unable to read", paths[i].c_str());
+            return false;
+        }
+
+        ArchiveEntry& entry = entries[i];
+        if (const std::size_t start = paths[i].find_first_not_of('/');
+            start != std::string::npos) {
+            entry.name = paths[i].substr(start);
+        }
+
+        entry.offset = offset;
+        entry.length = data.size() - offset;
+        entry.crc = crc32(data.data() + offset, entry.length);
+
+        if (entry.name.empty() || entry.name.size() > UINT16_MAX) {
+            Log::error("Bad entry name", paths[i].c_str());
+            return false;
+        }
+
+        // A second entry of the same name could never be extracted
+        if (!names.insert(entry.name).second) {
+            Log::error("Duplicate entry name", paths[i].c_str());
+            return false;
+        }
+    }
+
+    std::string index;
+    for (const ArchiveEntry& entry: entries) {
+        put(index, entry.offset);
+        put(index, entry.length);
+        put(index, entry.crc);
+        put(index, static_cast<std::uint16_t>(entry.name.size()));
+        put(index, std::uint16_t{0});
+        index += entry.name;
+    }
+
+    if (entries.size() > UINT32_MAX || index.size() > UINT32_MAX) {
+        Log::error("Too many entries to archive");
+        return false;
+    }
+
+    out.reserve(kArchiveHeaderSize + index.size() + data.size());
+    out.assign(kMagic, sizeof(kMagic));
+    out += static_cast<char>(kVersion);
+    out.append(3, '\0');
+    put(out, static_cast<std::uint32_t>(entries.size()));
+    put(out, static_cast<std::uint32_t>(index.size()));
+
+    out += index;
+    out += data;
+    return true;
+}
+
+/*! Reads the index of an archive payload.
+ */
+bool steg::archive_list(const ArchiveFetch& fetch,
+                        std::vector<ArchiveEntry>& entries,
+                        std::uint64_t& dataOffset)
+{
+    std::string header;
+    if (!fetch(0, kArchiveHeaderSize, header)
+        || std::memcmp(header.data(), kMagic, sizeof(kMagic)) != 0
+        || static_cast<std::uint8_t>(header[4]) != kVersion) {
+        constexpr const char* kMessage = "Payload is not an archive";
+        return (Log::error(kMessage), false);
+    }
+
+    const auto count = get<std::uint32_t>(header.data() + 8);
+    const auto indexSize = get<std::uint32_t>(header.data() + 12);
+
+    std::string index;
+    if (!fetch(kArchiveHeaderSize, indexSize, index)) {
+        return corrupt("index is cut short");
+    }
+
+    entries.clear();
+    dataOffset = kArchiveHeaderSize + std::uint64_t{indexSize};
+
+    std::size_t pos = 0;
+    for (std::uint32_t i = 0; i != count; ++i) {
+        if (index.size() - pos < kRecordSize) {
+            return corrupt("index is cut short");
+        }
+
+        const char* record = index.data() + pos;
+        const auto nameSize = get<std::uint16_t>(record + 20);
+        pos += kRecordSize;
+
+        if (index.size() - pos < nameSize) {
+            return corrupt("index is cut short");
+        }
+
+        ArchiveEntry& entry = entries.emplace_back();
+        entry.offset = get<std::uint64_t>(record);
+        entry.length = get<std::uint64_t>(record + 8);
+        entry.crc = get<std::uint32_t>(record + 16);
+        entry.name.assign(index.data() + pos, nameSize);
+        pos += nameSize;
+
+        if (entry.length > UINT64_MAX - entry.offset) {
+            return corrupt("entry is out of bounds");
+        }
+    }
+
+    return true;
+}
+
+/*! Reads and checks the data of one entry.
+ */
+bool steg::archive_extract(const ArchiveFetch& fetch,
+                           const std::uint64_t dataOffset,
+                           const ArchiveEntry& entry,
+                           std::string& out)
+{
+    // archive_list() has checked that offset + length does not overflow
+    if (entry.offset + entry.length > UINT64_MAX - dataOffset
+        || !fetch(dataOffset + entry.offset, entry.length, out)) {
+        return corrupt("entry is cut short");
+    }
+
+    if (crc32(out.data(), out.size()) != entry.crc) {
+        return corrupt("checksum mismatch");
+    }
+
+    return true;
+}
+
+namespace {
+    // Helper: packs files and encrypts them into the image with an encoder
+    template <typename T>
+    bool embed(T* encoder,
+               const std::vector<std::string>& paths,
+               const bool b64,
+               steg::Image& image)
+    {
+        // The cipher comes first, it sets up gcrypt for the checksums
+        std::unique_ptr<T> owner(encoder);
+        if (owner == nullptr) {
+            return false;
+        }
+
+        std::string payload;
+        if (!steg::archive_pack(paths, payload)) {
+            return false;
+        }
+
+        if constexpr (std::is_same_v<T, steg::Seekable>) {
+            const char* status = owner->embed(
+                image, payload.data(), payload.size(), b64);
+            return std::strcmp(status, "ok") == 0;
+        } else {
+            steg::BufferInputStream input(payload.data(), payload.size());
+            return owner->run(input, image);
+        }
+    }
+
+    // Helper: encrypts an archive into the image and saves it
+    bool encode_archive(const std::vector<std::string>& paths,
+                        const steg::ArchiveOptions& opts)
+    {
+        steg::Image image;
+        if (image.map(opts.image) == 0) {
+            return false;
+        }
+
+        using steg::BlockEncoder;
+        using Talloc = steg::CountingAllocator<steg::BasicAllocator>;
+
+        bool ok = false;
+        if (opts.seekable) {
+            ok = embed(steg::Seekable::create(opts.key, opts.vec),
+                       paths,
+                       opts.b64,
+                       image);
+        } else if (opts.b64) {
+            ok = embed(BlockEncoder<true, Talloc>::create(opts.key, opts.vec),
+                       paths,
+                       opts.b64,
+                       image);
+        } else {
+            ok = embed(BlockEncoder<false, Talloc>::create(opts.key, opts.vec),
+                       paths,
+                       opts.b64,
+                       image);
+        }
+
+        return ok && image.save(opts.output, opts.type);
+    }
+
+    // Helper: lists or extracts the entries of an archive in the image
+    bool decode_archive(const std::vector<std::string>& paths,
+                        const steg::ArchiveOptions& opts)
+    {
+        steg::Image image;
+        if (image.map(opts.image) == 0) {
+            return false;
+        }
+
+        // Counter mode reads what is asked for; otherwise the whole payload
+        // is decrypted up front
+        std::unique_ptr<steg::Seekable> seekable;
+        steg::IoBuffer payload;
+
+        if (opts.seekable) {
+            seekable.reset(steg::Seekable::create(opts.key, opts.vec));
+            if (seekable == nullptr) {
+                return false;
+            }
+        } else {
+            auto run = [&](auto* decoder) {
+                std::unique_ptr<std::remove_pointer_t<decltype(decoder)>> owner(
+                    decoder);
+                steg::BufferOutputStream output;
+                if (owner == nullptr || !owner->run(image, output)) {
+                    return false;
+                }
+
+                payload = output.release();
+                return true;
+            };
+
+            using Talloc = steg::CountingAllocator<steg::BasicAllocator>;
+            using steg::BlockDecoder;
+
+            const bool ok
+                = opts.b64
+                      ? run(BlockDecoder<true, Talloc>::create(opts.key,
+                                                               opts.vec))
+                      : run(BlockDecoder<false, Talloc>::create(opts.key,
+                                                                opts.vec));
+            if (!ok) {
+                return false;
+            }
+        }
+
+        auto fetch = [&](std::uint64_t offset,
+                         std::uint64_t size,
+                         std::string& out) {
+            if (seekable != nullptr) {
+                steg::IoBuffer part;
+                if (std::strcmp(
+                        seekable->extract(image, offset, size, opts.b64, part),
+                        "ok")
+                        != 0
+                    || part.size != size) {
+                    return false;
+                }
+
+                out.assign(reinterpret_cast<const char*>(part.data.get()),
+                           part.size);
+                return true;
+            }
+
+            if (offset > payload.size || size > payload.size - offset) {
+                return false;
+            }
+
+            const auto* data
+                = reinterpret_cast<const char*>(payload.data.get());
+            out.assign(data + offset, size);
+            return true;
+        };
+
+        std::vector<steg::ArchiveEntry> entries;
+        std::uint64_t dataOffset = 0;
+        if (!steg::archive_list(fetch, entries, dataOffset)) {
+            return false;
+        }
+
+        steg::OutputStream out;
+        if (opts.output != nullptr && !out.open(opts.output)) {
+            steg::Log::error("Unable to create", opts.output);
+            return false;
+        }
+
+        bool ok = true;
+        if (paths.empty()) {
+            // name, length, crc32
+            for (const steg::ArchiveEntry& entry: entries) {
+                char line[64];
+                const int n = std::snprintf(line,
+                                            sizeof(line),
+                                            "\t%" PRIu64 "\t%08" PRIx32 "\n",
+                                            entry.length,
+                                            entry.crc);
+
+                ok = ok && out.write(entry.name.data(), entry.name.size())
+                     && out.write(line, static_cast<std::size_t>(n));
+            }
+        } else {
+            const steg::ArchiveEntry* found = nullptr;
+            for (const steg::ArchiveEntry& entry: entries) {
+                if (entry.name == paths.front()) {
+                    found = &entry;
+                    break;
+                }
+            }
+
+            if (found == nullptr) {
+                const char* name = paths.front().c_str();
+                steg::Log::error("No such entry", name);
+                return false;
+            }
+
+            std::string data;
+            ok = steg::archive_extract(fetch, dataOffset, *found, data)
+                 && out.write(data.data(), data.size());
+        }
+
+        return out.close() && ok;
+    }
+} // namespace
+
+/*! Packs files into an image, or lists or extracts an image's entries.
+ */
+int steg::archive_run(const std::vector<std::string>& paths,
+                      const ArchiveOptions& opts)
+{
+    if (!opts.encode && paths.size() > 1) {
+        constexpr const char* kMessage = "Extract one entry at a time, exiting";
+        return (Log::error(kMessage), 1);
+    }
+
+    const bool ok = opts.encode ? encode_archive(paths, opts)
+                                : decode_archive(paths, opts);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,111 @@
+/* archive.hpp -- v1.0
+   Packs several files into one payload, with an index that lets them be
+   listed and extracted one at a time
+
+   Layout (big-endian), encrypted and embedded like any other payload:
+     u8  magic[4]      "STGA"
+     u8  version       1
+     u8  reserved[3]
+     u32 count         number of entries
+     u32 indexSize     size of the entry records that follow
+   then one record per entry:
+     u64 offset        from the end of the index
+     u64 length
+     u32 crc32         of the entry data
+     u16 nameSize
+     u16 reserved
+     u8  name[nameSize]
+   then the entry data, back to back.
+
+   In counter mode (see seekable.hpp) listing decrypts the header and index
+   only, and extracting an entry decrypts just its own bytes on top. */
+
+#pragma once
+
+#include "image.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace steg {
+    //! Size of the archive header, in front of the index
+    constexpr std::size_t kArchiveHeaderSize = 16;
+
+    //! @bag ArchiveEntry
+    struct ArchiveEntry {
+        std::string name;
+
+        // Position of the data, from the end of the index, and its size
+        std::uint64_t offset = 0;
+        std::uint64_t length = 0;
+
+        // CRC-32 of the data
+        std::uint32_t crc = 0;
+    };
+
+    //! Reads bytes [offset, offset + size) of an archive payload
+    //! @return false unless all of them could be read
+    using ArchiveFetch = std::function<
+        bool(std::uint64_t offset, std::uint64_t size, std::string& out)>;
+
+    //! Packs files into an archive payload
+    //! @param paths files to pack; each is stored under its path, less any
+    //! leading slashes, which must be unique
+    //! @param out[out] archive payload
+    //! @return true on success
+    bool archive_pack(const std::vector<std::string>& paths, std::string& out);
+
+    //! Reads the index of an archive payload
+    //! @param fetch reads from the payload
+    //! @param entries[out] entries, in the order they were packed
+    //! @param dataOffset[out] start of the entry data, past the header and
+    //! the indexSize bytes of the index
+    //! @return true on success
+    bool archive_list(const ArchiveFetch& fetch,
+                      std::vector<ArchiveEntry>& entries,
+                      std::uint64_t& dataOffset);
+
+    //! Reads the data of one entry and checks it against its CRC-32
+    //! @param fetch reads from the payload
+    //! @param dataOffset start of the entry data, from archive_list()
+    //! @param entry entry to read, one returned by archive_list()
+    //! @param out[out] entry data
+    //! @return true on success
+    bool archive_extract(const ArchiveFetch& fetch,
+                         std::uint64_t dataOffset,
+                         const ArchiveEntry& entry,
+                         std::string& out);
+
+    //! @bag ArchiveOptions
+    struct ArchiveOptions {
+        // Encode if true, decode otherwise
+        bool encode = true;
+        // Encrypted payload is base64 encoded
+        bool b64 = false;
+        // Counter mode, so that decoding reads only what it needs
+        bool seekable = false;
+
+        // Cryptographic vars
+        const char* key = nullptr;
+        const char* vec = nullptr;
+
+        // Carrier (encode) or encoded image (decode)
+        const char* image = nullptr;
+        // Encode: output image. Decode: listing or entry data, nullptr for
+        // stdout
+        const char* output = nullptr;
+        // Output image file type
+        Image::ImageType type = Image::ImageType::kPng;
+    };
+
+    //! Packs files into an image, or lists or extracts an image's entries
+    //! Listing prints one "name length crc32" line per entry
+    //! @param paths encode: files to pack; decode: nothing to list the
+    //! entries, or the name of the entry to extract
+    //! @param opts settings
+    //! @return 0 on success, 1 otherwise
+    int archive_run(const std::vector<std::string>& paths,
+                    const ArchiveOptions& opts);
+} // namespace steg
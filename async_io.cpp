@@ -0,0 +1,661 @@
+/* async_io.cpp -- v1.0 */
+
+#include "async_io.hpp"
+#include "log.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <fcntl.h>
+#include <mutex>
+#include <string>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#ifdef STEG_HAVE_IO_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+namespace {
+    // Largest single read or write handed to the kernel
+    constexpr std::size_t kMaxTransfer = std::size_t{1} << 30;
+
+    // @bag
+    struct Request {
+        std::string path;
+        steg::IoBuffer buff;
+
+        // Open file and bytes transferred so far
+        int fd = -1;
+        std::size_t done = 0;
+
+        // errno of the failed transfer, 0 on success
+        int error = 0;
+
+        bool write = false;
+        bool complete = false;
+    };
+
+    // Helper: opens the file and allocates a buffer for its content
+    bool open_read(const char* path, Request& req)
+    {
+        req.path = path;
+        req.fd = ::open(path, O_RDONLY | O_CLOEXEC);
+        if (req.fd < 0) {
+            steg::Log::error("Unable to open", path, std::strerror(errno));
+            return false;
+        }
+
+        struct stat st = {};
+        if (::fstat(req.fd, &st) != 0) {
+            ::close(req.fd);
+            return false;
+        }
+
+        req.buff.size = static_cast<std::size_t>(st.st_size);
+        req.buff.data.reset(new unsigned char[req.buff.size]);
+        return true;
+    }
+
+    // Helper: creates the file written by the request
+    bool open_write(const char* path, steg::IoBuffer&& buff, Request& req)
+    {
+        req.path = path;
+        req.write = true;
+        req.buff = std::move(buff);
+        req.fd = ::open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (req.fd < 0) {
+            steg::Log::error("Unable to open", path, std::strerror(errno));
+            return false;
+        }
+
+        return true;
+    }
+
+    // Helper: accounts for a completed transfer of res bytes (or -errno)
+    // @return true if the request is done, false if more is left to transfer
+    bool advance(Request& req, const long res)
+    {
+        if (res == -EINTR || res == -EAGAIN) {
+            return false; // Retry
+        }
+
+        if (res < 0) {
+            req.error = static_cast<int>(-res);
+            return true;
+        }
+
+        req.done += static_cast<std::size_t>(res);
+        if (res == 0 && !req.write) {
+            req.buff.size = req.done; // File shrank under us
+        }
+
+        if (res == 0 && req.write) {
+            req.error = EIO;
+        }
+
+        return res == 0 || req.done == req.buff.size;
+    }
+
+    // Helper: releases the file and reports the outcome
+    bool finish(Request& req)
+    {
+        if (req.fd >= 0) {
+            ::close(req.fd);
+            req.fd = -1;
+        }
+
+        if (req.error != 0) {
+            steg::Log::error(req.write ? "Unable to write" : "Unable to read",
+                             req.path.c_str(),
+                             std::strerror(req.error));
+            return false;
+        }
+
+        return true;
+    }
+
+    /*! @class: blocking I/O performed on a pool of threads
+     */
+    class ThreadIo final : public steg::AsyncIo {
+        std::mutex mutex_;
+        std::condition_variable queued_;
+        std::condition_variable completed_;
+
+        // Requests by ticket, and tickets waiting for a thread
+        std::unordered_map<Ticket, Request> requests_;
+        std::deque<Ticket> queue_;
+
+        std::vector<std::thread> threads_;
+        Ticket next_ = 1;
+        bool stop_ = false;
+    public:
+        explicit ThreadIo(const unsigned nthreads)
+        {
+            for (unsigned i = 0; i != nthreads; ++i) {
+                threads_.emplace_back([this] {
+                    loop();
+                });
+            }
+        }
+
+        ~ThreadIo() override
+        {
+            drain();
+            {
+                std::lock_guard lock(mutex_);
+                stop_ = true;
+            }
+
+            queued_.notify_all();
+            for (std::thread& thread: threads_) {
+                thread.join();
+            }
+        }
+
+        ThreadIo(const ThreadIo&) = delete;
+        ThreadIo& operator=(const ThreadIo&) = delete;
+
+        Ticket read(const char* path) override
+        {
+            Request req;
+            return open_read(path, req) ? enqueue(std::move(req)) : 0;
+        }
+
+        Ticket write(const char* path, steg::IoBuffer&& buff) override
+        {
+            Request req;
+            return open_write(path, std::move(buff), req)
+                       ? enqueue(std::move(req))
+                       : 0;
+        }
+
+        bool wait(const Ticket ticket, steg::IoBuffer& buff) override
+        {
+            std::unique_lock lock(mutex_);
+
+            auto it = requests_.find(ticket);
+            if (it == requests_.end()) {
+                return false;
+            }
+
+            completed_.wait(lock, [&it] {
+                return it->second.complete;
+            });
+
+            Request req = std::move(it->second);
+            requests_.erase(it);
+            lock.unlock();
+
+            buff = std::move(req.buff);
+            return finish(req);
+        }
+
+        bool drain() override
+        {
+            std::unique_lock lock(mutex_);
+            completed_.wait(lock, [this] {
+                return std::all_of(
+                    requests_.begin(), requests_.end(), [](const auto& kv) {
+                        return kv.second.complete;
+                    });
+            });
+
+            bool ret = true;
+            for (auto& kv: requests_) {
+                ret = finish(kv.second) && ret;
+            }
+
+            requests_.clear();
+            return ret;
+        }
+
+        const char* name() const override
+        {
+            return "threads";
+        }
+    private:
+        // Helper: hands a request to the pool
+        Ticket enqueue(Request&& req)
+        {
+            Ticket ticket = 0;
+            {
+                std::lock_guard lock(mutex_);
+                ticket = next_++;
+                requests_.emplace(ticket, std::move(req));
+                queue_.push_back(ticket);
+            }
+
+            queued_.notify_one();
+            return ticket;
+        }
+
+        // Helper: thread body
+        void loop()
+        {
+            std::unique_lock lock(mutex_);
+            for (;;) {
+                queued_.wait(lock, [this] {
+                    return stop_ || !queue_.empty();
+                });
+
+                if (queue_.empty()) {
+                    return; // Stopped
+                }
+
+                // Element references survive rehashing, and nobody else
+                // touches an incomplete request
+                Request& req = requests_.at(queue_.front());
+                queue_.pop_front();
+
+                lock.unlock();
+                transfer(req);
+                lock.lock();
+
+                req.complete = true;
+                completed_.notify_all();
+            }
+        }
+
+        // Helper: blocking transfer of the whole request
+        static void transfer(Request& req)
+        {
+            while (req.done != req.buff.size) {
+                unsigned char* ptr = req.buff.data.get() + req.done;
+                const std::size_t size
+                    = std::min(req.buff.size - req.done, kMaxTransfer);
+
+                const ssize_t n = req.write ? ::write(req.fd, ptr, size)
+                                            : ::read(req.fd, ptr, size);
+                if (advance(req, n < 0 ? -errno : n)) {
+                    break;
+                }
+            }
+        }
+    };
+
+#ifdef STEG_HAVE_IO_URING
+    /*! @class: requests submitted to the kernel through an io_uring instance
+     */
+    class UringIo final : public steg::AsyncIo {
+        int ring_ = -1;
+
+        // Submission queue ring and entries
+        void* sqMap_ = MAP_FAILED;
+        std::size_t sqMapSize_ = 0;
+        unsigned* sqTail_ = nullptr;
+        unsigned* sqMask_ = nullptr;
+        unsigned* sqArray_ = nullptr;
+        io_uring_sqe* sqes_ = static_cast<io_uring_sqe*>(MAP_FAILED);
+        std::size_t sqesSize_ = 0;
+
+        // Completion queue ring
+        void* cqMap_ = MAP_FAILED;
+        std::size_t cqMapSize_ = 0;
+        unsigned* cqHead_ = nullptr;
+        unsigned* cqTail_ = nullptr;
+        unsigned* cqMask_ = nullptr;
+        io_uring_cqe* cqes_ = nullptr;
+
+        // Transfers in flight, bounded by the ring size
+        unsigned inflight_ = 0;
+        unsigned depth_ = 0;
+
+        // Set once the kernel fails to take a submission or to deliver
+        // completions; the ring is not used again, and buffers still in
+        // flight are never freed, since the kernel may yet write into them
+        bool broken_ = false;
+
+        std::unordered_map<Ticket, Request> requests_;
+        Ticket next_ = 1;
+    public:
+        ~UringIo() override
+        {
+            if (ring_ >= 0) {
+                drain();
+            }
+
+            if (sqes_ != MAP_FAILED) {
+                ::munmap(sqes_, sqesSize_);
+            }
+
+            if (cqMap_ != MAP_FAILED && cqMap_ != sqMap_) {
+                ::munmap(cqMap_, cqMapSize_);
+            }
+
+            if (sqMap_ != MAP_FAILED) {
+                ::munmap(sqMap_, sqMapSize_);
+            }
+
+            if (ring_ >= 0) {
+                ::close(ring_);
+            }
+        }
+
+        UringIo() = default;
+        UringIo(const UringIo&) = delete;
+        UringIo& operator=(const UringIo&) = delete;
+
+        //! Sets up the rings
+        //! @return false if io_uring is unavailable or not permitted
+        bool init(const unsigned depth)
+        {
+            io_uring_params params = {};
+            const long fd = ::syscall(__NR_io_uring_setup, depth, &params);
+            if (fd < 0) {
+                return false;
+            }
+
+            ring_ = static_cast<int>(fd);
+            depth_ = std::min(params.sq_entries, params.cq_entries);
+
+            if (!probe()) {
+                return false;
+            }
+
+            sqMapSize_ = params.sq_off.array
+                         + params.sq_entries * sizeof(unsigned);
+            cqMapSize_ = params.cq_off.cqes
+                         + params.cq_entries * sizeof(io_uring_cqe);
+
+            // Both rings share one mapping on any reasonably recent kernel
+            const bool single
+                = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+            if (single) {
+                sqMapSize_ = cqMapSize_ = std::max(sqMapSize_, cqMapSize_);
+            }
+
+            sqMap_ = ::mmap(nullptr,
+                            sqMapSize_,
+                            PROT_READ | PROT_WRITE,
+                            MAP_SHARED | MAP_POPULATE,
+                            ring_,
+                            IORING_OFF_SQ_RING);
+            if (sqMap_ == MAP_FAILED) {
+                return false;
+            }
+
+            cqMap_ = single ? sqMap_
+                            : ::mmap(nullptr,
+                                     cqMapSize_,
+                                     PROT_READ | PROT_WRITE,
+                                     MAP_SHARED | MAP_POPULATE,
+                                     ring_,
+                                     IORING_OFF_CQ_RING);
+            if (cqMap_ == MAP_FAILED) {
+                return false;
+            }
+
+            sqesSize_ = params.sq_entries * sizeof(io_uring_sqe);
+            sqes_ = static_cast<io_uring_sqe*>(::mmap(nullptr,
+                                                      sqesSize_,
+                                                      PROT_READ | PROT_WRITE,
+                                                      MAP_SHARED | MAP_POPULATE,
+                                                      ring_,
+                                                      IORING_OFF_SQES));
+            if (sqes_ == MAP_FAILED) {
+                return false;
+            }
+
+            auto* sq = static_cast<unsigned char*>(sqMap_);
+            sqTail_ = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+            sqMask_ = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+            sqArray_ = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+
+            auto* cq = static_cast<unsigned char*>(cqMap_);
+            cqHead_ = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+            cqTail_ = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+            cqMask_ = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+            cqes_ = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+            return true;
+        }
+
+        Ticket read(const char* path) override
+        {
+            Request req;
+            return open_read(path, req) ? start(std::move(req)) : 0;
+        }
+
+        Ticket write(const char* path, steg::IoBuffer&& buff) override
+        {
+            Request req;
+            return open_write(path, std::move(buff), req)
+                       ? start(std::move(req))
+                       : 0;
+        }
+
+        bool wait(const Ticket ticket, steg::IoBuffer& buff) override
+        {
+            auto it = requests_.find(ticket);
+            if (it == requests_.end()) {
+                return false;
+            }
+
+            while (!it->second.complete) {
+                if (!reap(1)) {
+                    return false; // Left in flight, see drain()
+                }
+            }
+
+            Request req = std::move(it->second);
+            requests_.erase(it);
+
+            buff = std::move(req.buff);
+            return finish(req);
+        }
+
+        bool drain() override
+        {
+            bool ret = true;
+            while (inflight_ != 0) {
+                if (!reap(1)) {
+                    ret = false;
+                    break;
+                }
+            }
+
+            for (auto& kv: requests_) {
+                Request& req = kv.second;
+                if (!req.complete) {
+                    // Still owned by the kernel: leaked, not freed under it
+                    static_cast<void>(req.buff.data.release());
+                    req.error = EIO;
+                }
+
+                ret = finish(req) && ret;
+            }
+
+            requests_.clear();
+            return ret;
+        }
+
+        const char* name() const override
+        {
+            return "io_uring";
+        }
+    private:
+        // Helper: checks that the kernel (Linux 5.6 on) supports the read
+        // and write operations submit() queues
+        bool probe() const
+        {
+            constexpr unsigned kOps = IORING_OP_WRITE + 1;
+            std::vector<unsigned char> space(
+                sizeof(io_uring_probe) + kOps * sizeof(io_uring_probe_op));
+            auto* probe = reinterpret_cast<io_uring_probe*>(space.data());
+
+            if (::syscall(__NR_io_uring_register,
+                          ring_,
+                          IORING_REGISTER_PROBE,
+                          probe,
+                          kOps)
+                != 0) {
+                return false;
+            }
+
+            auto supported = [probe](const unsigned op) {
+                return op <= probe->last_op
+                       && (probe->ops[op].flags & IO_URING_OP_SUPPORTED) != 0;
+            };
+
+            return supported(IORING_OP_READ) && supported(IORING_OP_WRITE);
+        }
+
+        // Helper: registers a request and queues its first transfer
+        Ticket start(Request&& req)
+        {
+            const Ticket ticket = next_++;
+            Request& ref
+                = requests_.emplace(ticket, std::move(req)).first->second;
+
+            if (ref.buff.size == 0) {
+                ref.complete = true; // Nothing to transfer
+            } else {
+                submit(ticket, ref);
+            }
+
+            return ticket;
+        }
+
+        // Helper: queues the next chunk of a request and submits it
+        void submit(const Ticket ticket, Request& req)
+        {
+            // Make room on the rings
+            while (inflight_ == depth_) {
+                if (!reap(1)) {
+                    break;
+                }
+            }
+
+            if (broken_) {
+                req.error = EIO;
+                req.complete = true;
+                return;
+            }
+
+            const unsigned tail = *sqTail_;
+            const unsigned index = tail & *sqMask_;
+
+            io_uring_sqe& sqe = sqes_[index];
+            std::memset(&sqe, 0, sizeof(sqe));
+
+            sqe.opcode = req.write ? IORING_OP_WRITE : IORING_OP_READ;
+            sqe.fd = req.fd;
+            sqe.addr = reinterpret_cast<std::uint64_t>(req.buff.data.get()
+                                                       + req.done);
+            sqe.len = static_cast<std::uint32_t>(
+                std::min(req.buff.size - req.done, kMaxTransfer));
+            sqe.off = req.done;
+            sqe.user_data = ticket;
+
+            sqArray_[index] = index;
+            __atomic_store_n(sqTail_, tail + 1, __ATOMIC_RELEASE);
+
+            ++inflight_;
+
+            // An entry the kernel did not take would never complete, and
+            // reap() would wait for it forever
+            if (enter(1, 0) != 1) {
+                __atomic_store_n(sqTail_, tail, __ATOMIC_RELEASE);
+                --inflight_;
+
+                broken_ = true;
+                req.error = EIO;
+                req.complete = true;
+            }
+        }
+
+        // Helper: processes completions, blocking for at least min of them
+        // @return false if the kernel refused to deliver completions, now
+        // or before
+        bool reap(const unsigned min)
+        {
+            if (broken_) {
+                return false;
+            }
+
+            unsigned head = *cqHead_;
+            if (head == __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE)
+                && enter(0, min) < 0) {
+                broken_ = true;
+                return false;
+            }
+
+            const unsigned tail = __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE);
+            for (; head != tail; ++head) {
+                const io_uring_cqe& cqe = cqes_[head & *cqMask_];
+                --inflight_;
+
+                auto it = requests_.find(cqe.user_data);
+                if (it == requests_.end()) {
+                    continue;
+                }
+
+                Request& req = it->second;
+                if (advance(req, cqe.res)) {
+                    req.complete = true;
+                } else {
+                    // Short transfer (or EAGAIN), queue the remainder; the
+                    // slot freed above keeps submit() from reaping
+                    submit(it->first, req);
+                }
+            }
+
+            __atomic_store_n(cqHead_, head, __ATOMIC_RELEASE);
+            return true;
+        }
+
+        // Helper: io_uring_enter(2)
+        // @return number of entries submitted, -1 on error
+        long enter(const unsigned submit, const unsigned min)
+        {
+            const unsigned flags = min != 0 ? IORING_ENTER_GETEVENTS : 0;
+            for (;;) {
+                const long ret = ::syscall(
+                    __NR_io_uring_enter, ring_, submit, min, flags, nullptr, 0);
+                if (ret >= 0) {
+                    return ret;
+                }
+
+                if (errno != EINTR) {
+                    steg::Log::error("io_uring_enter", std::strerror(errno));
+                    return -1;
+                }
+            }
+        }
+    };
+#endif
+} // namespace
+
+/*! Factory method
+ */
+steg::AsyncIo* steg::AsyncIo::create(const unsigned depth,
+                                     const Backend backend)
+{
+    const unsigned size = std::max(depth, 1U);
+
+#ifdef STEG_HAVE_IO_URING
+    if (backend != Backend::kThreads) {
+        auto* io = new UringIo;
+        if (io->init(size)) {
+            return io;
+        }
+
+        delete io;
+    }
+#endif
+
+    if (backend == Backend::kUring) {
+        Log::error("io_uring is not available");
+        return nullptr;
+    }
+
+    // One thread per request in flight, within reason
+    return new ThreadIo(std::min(size, 16U));
+}
@@ -0,0 +1,73 @@
+/* async_io.hpp -- v1.0
+   Asynchronous whole-file reads and writes, backed by io_uring when the
+   kernel allows it and by a pool of I/O threads otherwise */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace steg {
+    //! @class IoBuffer
+    //! Owned, uninitialized block of file data
+    struct IoBuffer {
+        std::unique_ptr<unsigned char[]> data;
+        std::size_t size = 0;
+    };
+
+    //! @class AsyncIo
+    //! Overlaps file I/O with compute: reads are started ahead of time and
+    //! collected with wait(), writes run in the background until waited on or
+    //! drained. Requests must be issued and collected from a single thread
+    class AsyncIo {
+    public:
+        //! Request handle, 0 is never a valid ticket
+        using Ticket = std::uint64_t;
+
+        //! I/O backend
+        enum class Backend : std::uint8_t { kAuto, kUring, kThreads };
+
+        //! Factory method, returns an AsyncIo
+        //! @param depth Maximum number of requests in flight
+        //! @param backend kAuto tries io_uring first, then falls back to
+        //! threads
+        //! @return nullptr if the requested backend is unavailable
+        static AsyncIo* create(unsigned depth,
+                               Backend backend = Backend::kAuto);
+
+        //! Dtor.
+        virtual ~AsyncIo() = default;
+
+        //! Starts reading a whole file into memory
+        //! @param path path/to/file
+        //! @return ticket for wait(), 0 if the file couldn't be opened
+        virtual Ticket read(const char* path) = 0;
+
+        //! Starts writing a block of memory to a file
+        //! @param path path/to/file, created or truncated
+        //! @param buff data to write, owned by the request until it completes
+        //! @return ticket for wait(), 0 if the file couldn't be opened
+        virtual Ticket write(const char* path, IoBuffer&& buff) = 0;
+
+        //! Blocks until a request completes
+        //! @param ticket request handle
+        //! @param buff[out] file content, for reads
+        //! @return true on success
+        virtual bool wait(Ticket ticket, IoBuffer& buff) = 0;
+
+        //! Blocks until a request completes, discarding its data
+        bool wait(Ticket ticket)
+        {
+            IoBuffer buff;
+            return wait(ticket, buff);
+        }
+
+        //! Blocks until every outstanding request completes
+        //! @return false if any of them failed
+        virtual bool drain() = 0;
+
+        //! @return Backend name, for reports
+        virtual const char* name() const = 0;
+    };
+} // namespace steg
@@ -1,6 +1,8 @@
 /* base64.cpp -- v1.0 */
 
 #include "base64.hpp"
+#include "scheduler.hpp"
+#include "stats.hpp"
 #include <cstddef>
 #include <cstring>
 
@@ -17,86 +19,87 @@ namespace {
            36, 37, 38, 39, 40, 41, 42, 43, 44, 45, 46, 47, 48, 49, 50, 51};
 } // namespace
 
+namespace {
+    // Triples per parallel piece of base64_encode()
+    constexpr std::size_t kTripleGrain = std::size_t{1} << 15;
+
+    // Helper: encodes three octets to four characters
+    inline char* encode_triple(const char octets[3], char* out)
+    {
+        const int indices[4]
+            = {(octets[0] & 0xfc) >> 2,
+               ((octets[0] & 0x03) << 4) | ((octets[1] & 0xf0) >> 4),
+               ((octets[1] & 0x0f) << 2) | ((octets[2] & 0xc0) >> 6),
+               (octets[2] & 0x3f)};
+
+        *out++ = kBase64Chars[indices[0]];
+        *out++ = kBase64Chars[indices[1]];
+        *out++ = kBase64Chars[indices[2]];
+        *out++ = kBase64Chars[indices[3]];
+        return out;
+    }
+
+} // namespace
+
 /*! Base64 encode
  */
 void steg::base64_encode(const std::span<char>& value, char* out)
 {
-    // Temp. reusable container for the three chars (octets) that are encoded to
-    // a four byte array
-    char octets[3] = {};
+    StageTimer timer(Stage::kBase64Encode, value.size());
 
-    std::size_t i = 0;
-    while (i != value.size()) {
-        octets[i % 3] = value[i];
-        // Encode octets if next character is at the three character boundary
-        if ((++i % 3) == 0) {
-            // Encode
-            const int indices[4]
-                = {(octets[0] & 0xfc) >> 2,
-                   ((octets[0] & 0x03) << 4) | ((octets[1] & 0xf0) >> 4),
-                   ((octets[1] & 0x0f) << 2) | ((octets[2] & 0xc0) >> 6),
-                   (octets[2] & 0x3f)};
-
-            *out++ = kBase64Chars[indices[0]];
-            *out++ = kBase64Chars[indices[1]];
-            *out++ = kBase64Chars[indices[2]];
-            *out++ = kBase64Chars[indices[3]];
-
-            // Zero-out
-            std::memset(octets, 0, sizeof(octets));
+    // Whole triples are independent, large inputs are encoded in parallel
+    const std::size_t triples = value.size() / 3;
+    const char* in = value.data();
+
+    auto piece = [in, out](std::size_t begin, std::size_t end) {
+        char* ptr = out + (begin * 4);
+        for (std::size_t i = begin; i != end; ++i) {
+            ptr = encode_triple(in + (i * 3), ptr);
         }
-    }
+    };
+
+    parallel_for(triples, kTripleGrain, piece);
 
     // Return if no trailing characters
-    if ((i % 3) == 0) {
+    const std::size_t tail = value.size() % 3;
+    if (tail == 0) {
         return;
     }
 
-    for (; i % 3; ++i) {
-        octets[i % 3] = 0;
-    }
-
-    // Encode
-    const int indices[4]
-        = {(octets[0] & 0xfc) >> 2,
-           ((octets[0] & 0x03) << 4) | ((octets[1] & 0xf0) >> 4),
-           ((octets[1] & 0x0f) << 2) | ((octets[2] & 0xc0) >> 6),
-           (octets[2] & 0x3f)};
-
-    *out++ = kBase64Chars[indices[0]];
-    *out++ = kBase64Chars[indices[1]];
-    *out++ = kBase64Chars[indices[2]];
-    *out++ = kBase64Chars[indices[3]];
+    // Zero-pad the trailing characters to a triple
+    char octets[3] = {};
+    std::memcpy(octets, in + (triples * 3), tail);
+    encode_triple(octets, out + (triples * 4));
 }
 
 /*! Base64 in-place decode
  */
 std::size_t steg::base64_decode(char* value, std::size_t size)
 {
-    // Temp. reusable container for the four bytes (hexets) that are decoded to
-    // three octets
-    char hexets[4] = {};
-    char* ptr = value;
+    StageTimer timer(Stage::kBase64Decode, size);
 
-    std::size_t i = 0;
-    while (i != size) {
-        hexets[i % 4] = kBase64Lookup[value[i] - '+'];
+    // Four characters (hexets) decode to three octets, in place; a trailing
+    // partial quad decodes to nothing
+    char* ptr = value;
+    for (std::size_t q = 0; q != size / 4; ++q) {
+        const char* in = value + (q * 4);
 
-        if ((++i % 4) == 0) {
-            auto x1 = static_cast<char>((hexets[0] & 0xff) << 2);
-            auto y1 = static_cast<char>((hexets[1] & 0x30) >> 4);
-            *ptr++ = x1 | y1;
+        char hexets[4];
+        for (std::size_t i = 0; i != 4; ++i) {
+            hexets[i] = kBase64Lookup[in[i] - '+'];
+        }
 
-            auto x2 = static_cast<char>((hexets[1] & 0x0f) << 4);
-            auto y2 = static_cast<char>((hexets[2] & 0x3c) >> 2);
-            *ptr++ = x2 | y2;
+        auto x1 = static_cast<char>((hexets[0] & 0xff) << 2);
+        auto y1 = static_cast<char>((hexets[1] & 0x30) >> 4);
+        *ptr++ = x1 | y1;
 
-            auto x3 = static_cast<char>((hexets[2] & 0x03) << 6);
-            auto y3 = hexets[3];
-            *ptr++ = x3 | y3;
+        auto x2 = static_cast<char>((hexets[1] & 0x0f) << 4);
+        auto y2 = static_cast<char>((hexets[2] & 0x3c) >> 2);
+        *ptr++ = x2 | y2;
 
-            std::memset(hexets, 0, sizeof(hexets));
-        }
+        auto x3 = static_cast<char>((hexets[2] & 0x03) << 6);
+        auto y3 = hexets[3];
+        *ptr++ = x3 | y3;
     }
 
     // Return size
@@ -0,0 +1,763 @@
+/* batch.cpp -- v1.0 */
+
+#include "batch.hpp"
+#include "carrier_index.hpp"
+#include "channel.hpp"
+#include "context.hpp"
+#include "image.hpp"
+#include "job.hpp"
+#include "log.hpp"
+#include "metrics.hpp"
+#include "scheduler.hpp"
+#include "stream.hpp"
+#include "trace.hpp"
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <limits>
+#include <memory>
+#include <string>
+#include <thread>
+#include <utility>
+#include <sys/stat.h>
+#include <vector>
+
+namespace {
+    using Clock = std::chrono::steady_clock;
+    using Ticket = steg::AsyncIo::Ticket;
+
+    // @bag
+    struct Job {
+        // Manifest line number
+        std::size_t line = 0;
+
+        std::string carrier;
+        std::string payload;
+        std::string output;
+        steg::Image::ImageType type = steg::Image::ImageType::kPng;
+
+        // Manifest line was JSON, report in kind
+        bool json = false;
+    };
+
+    // @bag
+    // A job on its way from the reader to the workers and back
+    struct Task {
+        const Job* job = nullptr;
+
+        // Carrier path, from the manifest or the carrier index
+        const char* carrierPath = nullptr;
+
+        // File contents, and the encoded image or decoded payload
+        steg::IoBuffer carrier;
+        steg::IoBuffer payload;
+        steg::IoBuffer result;
+
+        // Carrier between the load and save stages
+        steg::Image image;
+
+        // Pending reads and write
+        Ticket carrierTicket = 0;
+        Ticket payloadTicket = 0;
+        Ticket writeTicket = 0;
+
+        // Failed stage, or "ok"
+        const char* status = "ok";
+
+        // Stage timings, in milliseconds
+        Clock::time_point start;
+        double readMs = 0;
+        double loadMs = 0;
+        double codeMs = 0;
+        double saveMs = 0;
+        double writeMs = 0;
+    };
+
+    using TaskChannel = steg::Channel<std::unique_ptr<Task>>;
+
+    // Helper: milliseconds elapsed since t, which is then reset to now
+    double lap(Clock::time_point& t)
+    {
+        const Clock::time_point now = Clock::now();
+        const std::chrono::duration<double, std::milli> ms = now - t;
+
+        t = now;
+        return ms.count();
+    }
+} // namespace
+
+namespace {
+    // Helper: parses a JSON string starting at line[i], which must be a quote
+    bool parse_string(const std::string& line, std::size_t& i, std::string& out)
+    {
+        if (line[i] != '"') {
+            return false;
+        }
+
+        out.clear();
+        for (++i; i < line.size(); ++i) {
+            char ch = line[i];
+            if (ch == '"') {
+                ++i;
+                return true;
+            }
+
+            if (ch != '\\') {
+                out.push_back(ch);
+                continue;
+            }
+
+            if (++i == line.size()) {
+                return false;
+            }
+
+            switch (line[i]) {
+                case 'b':
+                    out.push_back('\b');
+                    break;
+                case 'f':
+                    out.push_back('\f');
+                    break;
+                case 'n':
+                    out.push_back('\n');
+                    break;
+                case 'r':
+                    out.push_back('\r');
+                    break;
+                case 't':
+                    out.push_back('\t');
+                    break;
+                case 'u':
+                {
+                    // Basic multilingual plane only, encoded to UTF-8
+                    if (i + 4 >= line.size()) {
+                        return false;
+                    }
+
+                    const std::string hex = line.substr(i + 1, 4);
+                    char* end = nullptr;
+                    auto code = static_cast<unsigned>(
+                        std::strtoul(hex.c_str(), &end, 16));
+                    if (end != hex.c_str() + 4) {
+                        return false;
+                    }
+
+                    i += 4;
+
+                    if (code < 0x80) {
+                        out.push_back(static_cast<char>(code));
+                    } else if (code < 0x800) {
+                        out.push_back(static_cast<char>(0xc0 | (code >> 6)));
+                        out.push_back(static_cast<char>(0x80 | (code & 0x3f)));
+                    } else {
+                        out.push_back(static_cast<char>(0xe0 | (code >> 12)));
+                        out.push_back(
+                            static_cast<char>(0x80 | ((code >> 6) & 0x3f)));
+                        out.push_back(static_cast<char>(0x80 | (code & 0x3f)));
+                    }
+
+                    break;
+                }
+                default:
+                    out.push_back(line[i]); // \" \\ \/
+                    break;
+            }
+        }
+
+        return false;
+    }
+
+    // Helper: parses a flat JSON object of string values
+    bool parse_json(const std::string& line, Job& job)
+    {
+        std::size_t i = 0;
+        auto skip = [&line, &i] {
+            while (i < line.size()
+                   && std::isspace(static_cast<unsigned char>(line[i]))) {
+                ++i;
+            }
+        };
+
+        skip();
+        if (i == line.size() || line[i++] != '{') {
+            return false;
+        }
+
+        std::string key;
+        std::string value;
+        for (;;) {
+            skip();
+            if (i < line.size() && line[i] == '}') {
+                return true;
+            }
+
+            if (i == line.size() || !parse_string(line, i, key)) {
+                return false;
+            }
+
+            skip();
+            if (i == line.size() || line[i++] != ':') {
+                return false;
+            }
+
+            skip();
+            if (i == line.size() || !parse_string(line, i, value)) {
+                return false;
+            }
+
+            if (key == "carrier") {
+                job.carrier = value;
+            } else if (key == "payload") {
+                job.payload = value;
+            } else if (key == "output") {
+                job.output = value;
+            } else if (key == "type") {
+                job.type = steg::Image::parse_type(value.c_str());
+            }
+
+            skip();
+            if (i < line.size() && line[i] == ',') {
+                ++i;
+            }
+        }
+    }
+
+    // Helper: parses tab-separated fields
+    void parse_tsv(const std::string& line, Job& job)
+    {
+        std::string* const fields[] = {&job.carrier, &job.payload, &job.output};
+
+        std::size_t pos = 0;
+        for (std::size_t i = 0; pos <= line.size(); ++i) {
+            std::size_t end = std::min(line.find('\t', pos), line.size());
+            std::string field = line.substr(pos, end - pos);
+
+            if (i < 3) {
+                *fields[i] = std::move(field);
+            } else if (i == 3) {
+                job.type = steg::Image::parse_type(field.c_str());
+            }
+
+            pos = end + 1;
+        }
+    }
+
+    // Helper: reads and parses the manifest; carriers may be left empty
+    // if pick is set
+    bool load_manifest(const char* path,
+                       const bool encode,
+                       const bool pick,
+                       std::vector<Job>& jobs)
+    {
+        // "-" is stdin; a read error must not pass for a shorter manifest
+        std::string text;
+        if (!steg::read_all(std::strcmp(path, "-") != 0 ? path : nullptr,
+                            text)) {
+            steg::Log::error("Unable to read manifest", path);
+            return false;
+        }
+
+        std::size_t lineno = 0;
+        for (std::size_t pos = 0; pos < text.size();) {
+            std::size_t end = std::min(text.find('\n', pos), text.size());
+            std::string line = text.substr(pos, end - pos);
+            pos = end + 1;
+            ++lineno;
+
+            if (!line.empty() && line.back() == '\r') {
+                line.pop_back();
+            }
+
+            if (line.empty() || line[0] == '#') {
+                continue;
+            }
+
+            Job job;
+            job.line = lineno;
+            job.json = line.find_first_not_of(" \t") != std::string::npos
+                       && line[line.find_first_not_of(" \t")] == '{';
+
+            if (job.json && !parse_json(line, job)) {
+                steg::Log::error("Malformed manifest line",
+                                 steg::log_field("line", lineno));
+                return false;
+            }
+
+            if (!job.json) {
+                parse_tsv(line, job);
+            }
+
+            const bool picked = encode && pick;
+            if ((job.carrier.empty() && !picked) || job.output.empty()
+                || (encode && job.payload.empty())) {
+                steg::Log::error("Incomplete manifest line",
+                                 steg::log_field("line", lineno));
+                return false;
+            }
+
+            jobs.push_back(std::move(job));
+        }
+
+        return true;
+    }
+} // namespace
+
+namespace {
+    // Helper: appends a JSON string literal
+    void append_json(std::string& out, const std::string& value)
+    {
+        out.push_back('"');
+        for (const char ch: value) {
+            if (ch == '"' || ch == '\\') {
+                out.push_back('\\');
+                out.push_back(ch);
+            } else if (static_cast<unsigned char>(ch) < 0x20) {
+                char esc[8];
+                std::snprintf(esc, sizeof(esc), "\\u%04x", ch);
+                out.append(esc);
+            } else {
+                out.push_back(ch);
+            }
+        }
+
+        out.push_back('"');
+    }
+
+    // Helper: formats the result line of a finished task
+    std::string format_result(const Task& task, const double totalMs)
+    {
+        const Job& job = *task.job;
+        const double times[] = {task.readMs,
+                                task.loadMs,
+                                task.codeMs,
+                                task.saveMs,
+                                task.writeMs,
+                                totalMs};
+        const char* const names[] = {
+            "read_ms", "load_ms", "code_ms", "save_ms", "write_ms", "total_ms"};
+
+        std::string line;
+        char number[32];
+
+        if (job.json) {
+            std::snprintf(number, sizeof(number), "%zu", job.line);
+            line.append("{\"line\":").append(number);
+            line.append(",\"status\":\"").append(task.status).append("\"");
+            line.append(",\"carrier\":");
+            append_json(line, task.carrierPath);
+            line.append(",\"output\":");
+            append_json(line, job.output);
+
+            for (std::size_t i = 0; i != std::size(times); ++i) {
+                std::snprintf(number, sizeof(number), "%.3f", times[i]);
+                line.append(",\"").append(names[i]).append("\":");
+                line.append(number);
+            }
+
+            line.append("}\n");
+            return line;
+        }
+
+        std::snprintf(number, sizeof(number), "%zu", job.line);
+        line.append(number).append("\t").append(task.status);
+        line.append("\t").append(task.carrierPath);
+        line.append("\t").append(job.output);
+
+        for (const double ms: times) {
+            std::snprintf(number, sizeof(number), "\t%.3f", ms);
+            line.append(number);
+        }
+
+        line.append("\n");
+        return line;
+    }
+} // namespace
+
+namespace {
+    // Helper: picks the cheapest indexed carrier for a payload file
+    // @return carrier path, nullptr if none is large enough
+    const char* pick_carrier(const steg::CarrierIndex& index,
+                             const Job& job,
+                             const bool b64)
+    {
+        // Unreadable payloads fail when read
+        struct stat st = {};
+        if (::stat(job.payload.c_str(), &st) != 0) {
+            return job.carrier.c_str();
+        }
+
+        const auto size = static_cast<std::size_t>(st.st_size);
+        const steg::CarrierIndex::Record* record = index.find(size, b64);
+        return record != nullptr ? index.path(*record) : nullptr;
+    }
+
+    // Helper: loads the carrier read for the task
+    void load(Task& task)
+    {
+        Clock::time_point t = Clock::now();
+        if (task.image.open(task.carrier.data.get(), task.carrier.size) == 0) {
+            task.status = "load-failed";
+            return;
+        }
+
+        task.carrier = {};
+        task.loadMs = lap(t);
+    }
+
+    // Helper: encrypts the payload into the carrier, or extracts and
+    // decrypts it
+    void code(steg::Context& ctx, const steg::BatchOptions& opts, Task& task)
+    {
+        steg::JobTimes times;
+        if (opts.encode) {
+            task.status = ctx.embed(
+                task.image,
+                reinterpret_cast<const char*>(task.payload.data.get()),
+                task.payload.size,
+                opts.b64,
+                times);
+            task.payload = {};
+        } else {
+            task.status = ctx.decode(task.image, opts.b64, task.result, times);
+            task.image = {};
+        }
+
+        task.codeMs = times.codeMs;
+    }
+
+    // Helper: encodes the output image
+    void save(Task& task)
+    {
+        steg::JobTimes times;
+        task.status
+            = steg::save_job(task.image, task.job->type, task.result, times);
+
+        task.image = {};
+        task.saveMs = times.saveMs;
+    }
+
+    //! @class Pipeline
+    //! Load, en/decode and save stages, each a few threads taking tasks
+    //! from a bounded queue, running them on the scheduler and queueing
+    //! them for the next stage; a full queue holds up the stage before it
+    class Pipeline {
+    public:
+        //! Ctor. Starts the stages
+        //! @param ctx cipher context
+        //! @param opts stage settings
+        //! @param scheduler runs the work of every stage
+        //! @param done receives finished and failed tasks
+        Pipeline(steg::Context& ctx,
+                 const steg::BatchOptions& opts,
+                 steg::Scheduler& scheduler,
+                 TaskChannel& done)
+            : scheduler_(scheduler)
+            , loaders_(opts.loaders != 0 ? opts.loaders : scheduler.size())
+            , coders_(opts.coders != 0 ? opts.coders : scheduler.size())
+            , savers_(opts.savers != 0 ? opts.savers : scheduler.size())
+            , loadQueue_(loaders_)
+            , codeQueue_(coders_)
+            , saveQueue_(savers_)
+            , loadDepth_("queue_depth",
+                         "Items waiting in a queue.",
+                         "queue=\"load\"",
+                         [this] {
+                             return static_cast<double>(loadQueue_.size());
+                         })
+            , codeDepth_("queue_depth",
+                         "Items waiting in a queue.",
+                         "queue=\"code\"",
+                         [this] {
+                             return static_cast<double>(codeQueue_.size());
+                         })
+            , saveDepth_("queue_depth",
+                         "Items waiting in a queue.",
+                         "queue=\"save\"",
+                         [this] {
+                             return static_cast<double>(saveQueue_.size());
+                         })
+        {
+            start(loadQueue_, codeQueue_, loaders_, "load job", [](Task& task) {
+                load(task);
+            });
+
+            start(codeQueue_,
+                  saveQueue_,
+                  coders_,
+                  "code job",
+                  [&ctx, &opts](Task& task) {
+                      code(ctx, opts, task);
+                  });
+
+            // Decoded payloads need no saving
+            start(saveQueue_, done, savers_, "save job", [&opts](Task& task) {
+                if (opts.encode) {
+                    save(task);
+                }
+            });
+        }
+
+        //! Dtor. Stops the stages once their queues are drained
+        ~Pipeline()
+        {
+            for (TaskChannel* queue: {&loadQueue_, &codeQueue_, &saveQueue_}) {
+                queue->close();
+            }
+
+            for (std::thread& thread: threads_) {
+                thread.join();
+            }
+        }
+
+        // Non-copyable object
+        Pipeline(const Pipeline&) = delete;
+        Pipeline& operator=(const Pipeline&) = delete;
+
+        //! Queues a task, waiting while the first stage is full
+        void push(std::unique_ptr<Task> task)
+        {
+            loadQueue_.push(std::move(task));
+        }
+
+        //! @return tasks the stages and their queues hold when all are full
+        std::size_t capacity() const
+        {
+            return (static_cast<std::size_t>(loaders_) + coders_ + savers_) * 2;
+        }
+    private:
+        // Helper: starts count threads of a stage; failed tasks pass
+        // straight through
+        // @param name trace event of the stage, tagged with the manifest line
+        template <typename Tfunc>
+        void start(TaskChannel& in,
+                   TaskChannel& out,
+                   const unsigned count,
+                   const char* name,
+                   Tfunc fn)
+        {
+            for (unsigned i = 0; i != count; ++i) {
+                threads_.emplace_back([this, &in, &out, name, fn] {
+                    std::unique_ptr<Task> task;
+                    while (in.pop(task)) {
+                        if (std::strcmp(task->status, "ok") == 0) {
+                            scheduler_.run([&fn, &task, name] {
+                                const steg::TraceJob job(task->job->line);
+                                const steg::TraceScope scope(name);
+                                fn(*task);
+                            });
+                        }
+
+                        out.push(std::move(task));
+                    }
+                });
+            }
+        }
+
+        steg::Scheduler& scheduler_;
+
+        // Concurrent tasks per stage
+        const unsigned loaders_;
+        const unsigned coders_;
+        const unsigned savers_;
+
+        // Input queue of each stage, as long as the stage is wide
+        TaskChannel loadQueue_;
+        TaskChannel codeQueue_;
+        TaskChannel saveQueue_;
+
+        // Queue lengths, for --metrics
+        steg::MetricsGauge loadDepth_;
+        steg::MetricsGauge codeDepth_;
+        steg::MetricsGauge saveDepth_;
+
+        std::vector<std::thread> threads_;
+    };
+} // namespace
+
+/*! Runs every job in a manifest.
+ */
+int steg::batch_run(const char* manifest,
+                    const BatchOptions& opts,
+                    OutputStream& report)
+{
+    std::vector<Job> jobs;
+    const bool pick = opts.carriers != nullptr;
+    if (!load_manifest(manifest, opts.encode, pick, jobs)) {
+        return 1;
+    }
+
+    std::unique_ptr<CarrierIndex> carriers;
+    if (pick) {
+        carriers.reset(CarrierIndex::open(opts.carriers));
+        if (carriers == nullptr) {
+            return 1;
+        }
+    }
+
+    const unsigned prefetch = std::max(opts.prefetch, 1U);
+    const unsigned nthreads
+        = opts.threads != 0 ? opts.threads : available_cpus();
+
+    // Room for a carrier, a payload and an output per job in flight
+    std::unique_ptr<AsyncIo> io(AsyncIo::create(prefetch * 3, opts.backend));
+    if (io == nullptr) {
+        return 1;
+    }
+
+    // Ciphers set up here, on the calling thread, before gcrypt is used
+    // concurrently
+    std::unique_ptr<Context> ctx(Context::create(opts.key, opts.vec));
+    if (ctx == nullptr) {
+        return 1;
+    }
+
+    TaskChannel done(std::numeric_limits<std::size_t>::max());
+    Scheduler scheduler(nthreads);
+    Pipeline pipeline(*ctx, opts, scheduler, done);
+
+    // Jobs being read, with the workers, and being written
+    std::deque<std::unique_ptr<Task>> reading;
+    std::deque<std::unique_ptr<Task>> writing;
+    std::size_t busy = 0;
+    std::size_t next = 0;
+
+    std::size_t failed = 0;
+    bool reported = true;
+
+    // Helper: reports a finished task
+    auto finish = [&](const std::unique_ptr<Task>& task) {
+        Clock::time_point start = task->start;
+        const std::string line = format_result(*task, lap(start));
+
+        failed += std::strcmp(task->status, "ok") != 0 ? 1 : 0;
+        Metrics::job(task->status);
+        Log::debug("Job done",
+                   log_field("line", task->job->line),
+                   log_field("status", task->status),
+                   log_field("carrier", task->carrierPath));
+
+        reported = report.write(line.c_str(), line.size()) && report.flush()
+                   && reported;
+    };
+
+    // Helper: waits for the oldest write
+    auto complete_write = [&] {
+        std::unique_ptr<Task> task = std::move(writing.front());
+        writing.pop_front();
+
+        Clock::time_point t = Clock::now();
+        if (!io->wait(task->writeTicket)) {
+            task->status = "write-failed";
+        }
+
+        task->writeMs += lap(t);
+        finish(task);
+    };
+
+    // Helper: takes a task back from the workers and writes its result
+    auto collect = [&](std::unique_ptr<Task> task) {
+        --busy;
+        if (std::strcmp(task->status, "ok") != 0) {
+            finish(task);
+            return;
+        }
+
+        Metrics::add(Metric::kBytesOut, task->result.size);
+
+        Clock::time_point t = Clock::now();
+        task->writeTicket
+            = io->write(task->job->output.c_str(), std::move(task->result));
+        task->writeMs = lap(t);
+
+        if (task->writeTicket == 0) {
+            task->status = "write-failed";
+            finish(task);
+            return;
+        }
+
+        writing.push_back(std::move(task));
+        while (writing.size() > prefetch) {
+            complete_write();
+        }
+    };
+
+    while (next != jobs.size() || !reading.empty() || busy != 0) {
+        // Keep the read-ahead window full
+        while (next != jobs.size() && reading.size() < prefetch) {
+            auto task = std::make_unique<Task>();
+            task->job = &jobs[next++];
+            task->carrierPath = task->job->carrier.c_str();
+            task->start = Clock::now();
+
+            if (task->job->carrier.empty() && carriers != nullptr) {
+                const char* carrier
+                    = pick_carrier(*carriers, *task->job, opts.b64);
+                if (carrier == nullptr) {
+                    task->status = "no-carrier";
+                    finish(task);
+                    continue;
+                }
+
+                task->carrierPath = carrier;
+            }
+
+            task->carrierTicket = io->read(task->carrierPath);
+            if (opts.encode) {
+                task->payloadTicket = io->read(task->job->payload.c_str());
+            }
+
+            reading.push_back(std::move(task));
+        }
+
+        std::unique_ptr<Task> task;
+        while (done.try_pop(task)) {
+            collect(std::move(task));
+        }
+
+        if (!reading.empty()) {
+            task = std::move(reading.front());
+            reading.pop_front();
+
+            bool ok = io->wait(task->carrierTicket, task->carrier);
+            if (opts.encode) {
+                ok = io->wait(task->payloadTicket, task->payload) && ok;
+            }
+
+            Clock::time_point start = task->start;
+            task->readMs = lap(start);
+            Metrics::add(Metric::kBytesIn,
+                         task->carrier.size + task->payload.size);
+
+            if (!ok) {
+                task->status = "read-failed";
+                finish(task);
+                continue;
+            }
+
+            // Stop feeding a full pipeline; the stages already push back on
+            // each other, this keeps the reader from blocking on them
+            std::unique_ptr<Task> finished;
+            while (busy >= pipeline.capacity() && done.pop(finished)) {
+                collect(std::move(finished));
+            }
+
+            ++busy;
+            pipeline.push(std::move(task));
+            continue;
+        }
+
+        if (busy != 0 && done.pop(task)) {
+            collect(std::move(task));
+        }
+    }
+
+    while (!writing.empty()) {
+        complete_write();
+    }
+
+    return failed == 0 && reported && io->drain() ? 0 : 1;
+}
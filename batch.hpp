@@ -0,0 +1,55 @@
+/* batch.hpp -- v1.0
+   Runs many encode/decode jobs listed in a manifest within one process */
+
+#pragma once
+
+#include "async_io.hpp"
+
+namespace steg {
+    // Fwd. decl.
+    class OutputStream;
+
+    //! @bag BatchOptions
+    struct BatchOptions {
+        // Encode jobs if true, decode jobs otherwise
+        bool encode = true;
+        // Encrypted payload is base64 encoded
+        bool b64 = false;
+
+        // Cryptographic vars, shared by every job
+        const char* key = nullptr;
+        const char* vec = nullptr;
+
+        // Optional carrier index; encode jobs that leave the carrier empty
+        // get the cheapest indexed carrier their payload fits in
+        const char* carriers = nullptr;
+
+        // Worker threads, 0 for one per available CPU
+        unsigned threads = 0;
+        // Jobs whose files are read ahead of the workers
+        unsigned prefetch = 8;
+
+        // Jobs each pipeline stage (load, en/decode, save) runs at once,
+        // 0 for one per worker thread
+        unsigned loaders = 0;
+        unsigned coders = 0;
+        unsigned savers = 0;
+
+        // File I/O backend
+        AsyncIo::Backend backend = AsyncIo::Backend::kAuto;
+    };
+
+    //! Runs every job in a manifest
+    //! Each manifest line describes one job, either as tab-separated
+    //! "carrier payload output type" fields or as a JSON object with those
+    //! keys; decode jobs leave payload and type empty. Blank lines and lines
+    //! starting with # are skipped
+    //! @param manifest path/to/manifest, "-" for stdin
+    //! @param opts settings shared by all jobs
+    //! @param report receives one result line per job, with its status and
+    //! per-stage timings, formatted like the job's manifest line
+    //! @return 0 if every job succeeded, 1 otherwise
+    int batch_run(const char* manifest,
+                  const BatchOptions& opts,
+                  OutputStream& report);
+} // namespace steg
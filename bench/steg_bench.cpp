@@ -0,0 +1,369 @@
+/* steg_bench.cpp -- v1.0
+   Microbenchmarks of the steg_core kernels on synthetic, in-process data;
+   prints one JSON object per benchmark, so runs can be diffed across
+   commits and machines */
+
+#include "base64.hpp"
+#include "cipher.hpp"
+#include "cipher_ctl.hpp"
+#include "decoder.hpp"
+#include "encoder.hpp"
+#include "image.hpp"
+#include "log.hpp"
+#include "scheduler.hpp"
+#include "stream.hpp"
+#include "synthetic.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <getopt.h>
+#include <memory>
+#include <span>
+#include <string>
+#include <vector>
+
+namespace {
+    using Clock = std::chrono::steady_clock;
+    using steg::bench::fill;
+    using steg::bench::synthetic_image;
+
+    /*! Helper: Outputs usage statement to stdout
+     */
+    inline void print_usage(const char* app)
+    {
+        printf("Usage: %s\n"
+               "  [-f<filter>]\n"
+               "  [-t<seconds>]\n"
+               "  [-j<threads>]\n"
+               "  [-r<runs>]\n"
+               "  [-o<output-file>]\n\n",
+               app);
+
+        printf("\t%s\n\t%s\n\t%s\n\t%s\n\t%s\n",
+               "-f<filter>                 Runs only benchmarks whose name "
+               "contains filter",
+               "-t<seconds>                Minimum time per benchmark; "
+               "defaults to 0.25",
+               "-j<threads>                Workers for the parallel kernels; "
+               "defaults to 1",
+               "-r<runs>                   Runs the whole suite this many "
+               "times; defaults to 1",
+               "-o<output-file>            JSON lines go to this file; "
+               "defaults to stdout");
+    }
+
+    // @bag
+    struct BenchOptions {
+        std::string filter;
+        double minSeconds = 0.25;
+        unsigned threads = 1;
+        unsigned runs = 1;
+        FILE* out = stdout;
+    };
+
+    // Helper: value at quantile q of sorted samples
+    double quantile(const std::vector<double>& sorted, const double q)
+    {
+        const auto i = static_cast<std::size_t>(
+            q * static_cast<double>(sorted.size() - 1) + 0.5);
+        return sorted[i];
+    }
+
+    // Helper: times fn until minSeconds have passed (at least 3 runs) and
+    // prints the result as one JSON line
+    // @param params extra JSON members describing the case, may be empty
+    // @param bytes bytes processed per run, for MB/s
+    template <typename Tfn>
+    void bench(const BenchOptions& opts,
+               const char* name,
+               const std::string& params,
+               const std::size_t bytes,
+               Tfn fn)
+    {
+        if (!opts.filter.empty()
+            && std::strstr(name, opts.filter.c_str()) == nullptr) {
+            return;
+        }
+
+        // One untimed run, to fault pages in and warm caches
+        fn();
+
+        std::vector<double> samples;
+        const Clock::time_point start = Clock::now();
+        const auto budget = std::chrono::duration<double>(opts.minSeconds);
+
+        while (samples.size() < 3 || Clock::now() - start < budget) {
+            const Clock::time_point t0 = Clock::now();
+            fn();
+            samples.push_back(
+                std::chrono::duration<double, std::nano>(Clock::now() - t0)
+                    .count());
+        }
+
+        std::sort(samples.begin(), samples.end());
+
+        double sum = 0;
+        for (const double ns: samples) {
+            sum += ns;
+        }
+
+        const double median = quantile(samples, 0.5);
+        const double mbps
+            = (static_cast<double>(bytes) / 1e6) / (median / 1e9);
+
+        std::fprintf(opts.out,
+                     "{\"bench\":\"%s\"%s%s,\"threads\":%u,\"bytes\":%zu,"
+                     "\"iters\":%zu,\"ns_min\":%.0f,\"ns_median\":%.0f,"
+                     "\"ns_p90\":%.0f,\"ns_mean\":%.0f,\"mb_per_s\":%.2f}\n",
+                     name,
+                     params.empty() ? "" : ",",
+                     params.c_str(),
+                     opts.threads,
+                     bytes,
+                     samples.size(),
+                     samples.front(),
+                     median,
+                     quantile(samples, 0.9),
+                     sum / static_cast<double>(samples.size()),
+                     mbps);
+        std::fflush(opts.out);
+    }
+
+    // Helper: machine description, first line of the output
+    void print_meta(const BenchOptions& opts)
+    {
+        std::string cpu = "unknown";
+
+        std::ifstream cpuinfo("/proc/cpuinfo");
+        for (std::string line; std::getline(cpuinfo, line);) {
+            if (line.rfind("model name", 0) == 0) {
+                cpu = line.substr(line.find(':') + 2);
+                break;
+            }
+        }
+
+        // Quotes and backslashes would break the JSON string
+        std::replace(cpu.begin(), cpu.end(), '"', '\'');
+        std::replace(cpu.begin(), cpu.end(), '\\', '/');
+
+        std::fprintf(opts.out,
+                     "{\"bench\":\"meta\",\"cpu\":\"%s\",\"cpus\":%u,"
+                     "\"threads\":%u,\"min_seconds\":%.3f}\n",
+                     cpu.c_str(),
+                     steg::available_cpus(),
+                     opts.threads,
+                     opts.minSeconds);
+    }
+
+    // Image::write and Image::read, whole carriers
+    void bench_image_bits(const BenchOptions& opts)
+    {
+        const unsigned sides[] = {256, 1024, 2048};
+
+        for (const unsigned nchanns: {1u, 2u, 3u, 4u}) {
+            for (const unsigned side: sides) {
+                steg::Image image;
+                if (!synthetic_image(side, side, nchanns, image)) {
+                    continue;
+                }
+
+                // A message as large as the carrier holds, so read() has no
+                // early end of message
+                const std::size_t size = image.pixels() / 8;
+                std::vector<char> message(size);
+                fill(message.data(), size, side);
+
+                const std::string params
+                    = "\"channels\":" + std::to_string(nchanns)
+                      + ",\"pixels\":" + std::to_string(image.pixels());
+
+                bench(opts, "image_write", params, size, [&] {
+                    image.write(message.data(), size);
+                });
+
+                std::vector<char> out(size);
+                bench(opts, "image_read", params, size, [&] {
+                    image.read(out.data(), size);
+                });
+            }
+        }
+    }
+
+    // base64_encode and base64_decode
+    void bench_base64(const BenchOptions& opts)
+    {
+        for (const std::size_t size: {std::size_t{1} << 16,
+                                      std::size_t{1} << 20,
+                                      std::size_t{1} << 24}) {
+            std::vector<char> data(size);
+            fill(data.data(), size, size);
+
+            const std::size_t b64size = ((size + 2) / 3) * 4;
+            std::vector<char> chars(b64size);
+            std::vector<char> scratch(b64size);
+
+            const std::string params = "\"size\":" + std::to_string(size);
+
+            bench(opts, "base64_encode", params, size, [&] {
+                steg::base64_encode(std::span{data.data(), size}, chars.data());
+            });
+
+            // Decoding is in place, so it works on a fresh copy each run
+            bench(opts, "base64_decode", params, b64size, [&] {
+                std::memcpy(scratch.data(), chars.data(), b64size);
+                steg::base64_decode(scratch.data(), b64size);
+            });
+        }
+    }
+
+    // Encoder::encode and Decoder::decode, per cipher mode
+    void bench_cipher(const BenchOptions& opts)
+    {
+        char key[steg::kMinKeySize] = {};
+        char vec[steg::kMinKeySize] = {};
+        fill(key, sizeof(key), 1);
+        fill(vec, sizeof(vec), 2);
+
+        const struct {
+            const char* name;
+            steg::CipherMode mode;
+        } kModes[] = {
+            {"cbc", steg::CipherMode::kCbc},
+            {"ctr", steg::CipherMode::kCtr},
+        };
+
+        for (const auto& mode: kModes) {
+            steg::Encoder encoder(steg::cipher_init(key, vec, mode.mode));
+            steg::Decoder decoder(steg::cipher_init(key, vec, mode.mode));
+            if (encoder.get() == nullptr || decoder.get() == nullptr) {
+                continue;
+            }
+
+            for (const std::size_t size: {std::size_t{1} << 16,
+                                          std::size_t{1} << 20,
+                                          std::size_t{1} << 24}) {
+                std::vector<char> data(size);
+                fill(data.data(), size, size);
+
+                const std::string params
+                    = "\"mode\":\"" + std::string(mode.name)
+                      + "\",\"size\":" + std::to_string(size);
+
+                bench(opts, "cipher_encrypt", params, size, [&] {
+                    encoder.encode(data.data(), size);
+                });
+
+                bench(opts, "cipher_decrypt", params, size, [&] {
+                    decoder.decode(data.data(), size);
+                });
+            }
+        }
+    }
+
+    // Image::open and Image::save, per file type
+    void bench_codec(const BenchOptions& opts)
+    {
+        const struct {
+            const char* name;
+            steg::Image::ImageType type;
+        } kTypes[] = {
+            {"png", steg::Image::ImageType::kPng},
+            {"bmp", steg::Image::ImageType::kBmp},
+            {"tga", steg::Image::ImageType::kTga},
+        };
+
+        for (const unsigned side: {256u, 1024u}) {
+            steg::Image image;
+            if (!synthetic_image(side, side, 3, image)) {
+                continue;
+            }
+
+            for (const auto& type: kTypes) {
+                std::vector<unsigned char> file;
+                if (!image.save(type.type, file)) {
+                    continue;
+                }
+
+                const std::string params
+                    = "\"format\":\"" + std::string(type.name)
+                      + "\",\"pixels\":" + std::to_string(image.pixels());
+
+                bench(opts, "image_save", params, image.size(), [&] {
+                    std::vector<unsigned char> out;
+                    image.save(type.type, out);
+                });
+
+                bench(opts, "image_open", params, image.size(), [&] {
+                    steg::Image loaded;
+                    loaded.open(file.data(), file.size());
+                });
+            }
+        }
+    }
+} // namespace
+
+int main(int argc, char** argv)
+{
+    BenchOptions opts;
+    std::string outputPath;
+
+    int opt = 0;
+    while ((opt = getopt(argc, argv, "f:t:j:r:o:h")) != -1) {
+        switch (opt) {
+            case 'f':
+                opts.filter = optarg;
+                break;
+            case 't':
+                opts.minSeconds = std::strtod(optarg, nullptr);
+                break;
+            case 'j':
+                opts.threads
+                    = static_cast<unsigned>(std::strtoul(optarg, nullptr, 10));
+                break;
+            case 'r':
+                opts.runs
+                    = static_cast<unsigned>(std::strtoul(optarg, nullptr, 10));
+                break;
+            case 'o':
+                outputPath = optarg;
+                break;
+            default:
+                print_usage(argv[0]);
+                return opt == 'h' ? 0 : 1;
+        }
+    }
+
+    if (opts.threads == 0) {
+        opts.threads = steg::available_cpus();
+    }
+
+    if (!outputPath.empty()) {
+        opts.out = std::fopen(outputPath.c_str(), "w");
+        if (opts.out == nullptr) {
+            steg::Log::error("Unable to create", outputPath.c_str());
+            return 1;
+        }
+    }
+
+    print_meta(opts);
+
+    // The kernels split themselves over the scheduler's workers when run
+    // on one of them
+    steg::Scheduler scheduler(opts.threads);
+    // Whole suites back to back, rather than each benchmark repeated, so
+    // slow drift on the machine spreads over all of them
+    for (unsigned run = 0; run < opts.runs; ++run) {
+        scheduler.run([&] {
+            bench_image_bits(opts);
+            bench_base64(opts);
+            bench_cipher(opts);
+            bench_codec(opts);
+        });
+    }
+
+    return std::fclose(opts.out) == 0 ? 0 : 1;
+}
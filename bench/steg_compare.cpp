@@ -0,0 +1,435 @@
+/* steg_compare.cpp -- v1.0
+   Regression gate over steg_bench and steg_e2e results: groups the runs of
+   each benchmark case in a baseline and a candidate file, and flags the
+   cases whose slowdown is significant at the given confidence and larger
+   than a threshold. Exits with 1 if any case regressed, and with 2 if a
+   baseline case is missing from the candidate */
+
+#include "log.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <getopt.h>
+#include <iterator>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace {
+    /*! Helper: Outputs usage statement to stdout
+     */
+    inline void print_usage(const char* app)
+    {
+        printf("Usage: %s\n"
+               "  [-c<confidence>]\n"
+               "  [-t<threshold>]\n"
+               "   <baseline-results> <candidate-results>\n\n",
+               app);
+
+        printf("\t%s\n\t%s\n\n%s\n",
+               "-c<confidence>             Confidence level of the intervals; "
+               "defaults to 0.95",
+               "-t<threshold>              Slowdowns below this fraction are "
+               "ignored; defaults to 0.05",
+               "Results are the JSON lines of steg_bench or steg_e2e; run them "
+               "with -r<runs>\n(at least 2, better 5 or more) so each case has "
+               "several samples.\nExit status: 0 no regression, 1 regression, "
+               "2 bad input or a baseline case missing from the candidate.");
+    }
+
+    // @bag
+    struct CompareOptions {
+        double confidence = 0.95;
+        double threshold = 0.05;
+    };
+
+    // @bag
+    // Runs of one benchmark case
+    struct Case {
+        std::string key;
+        const char* unit = "";
+        std::vector<double> values;
+
+        // End-to-end round trips that failed or decoded wrong
+        double failures = 0;
+    };
+
+    // @bag
+    struct Results {
+        std::vector<Case> cases;
+        std::map<std::string, std::size_t> index;
+    };
+
+    // Members that are measurements rather than a description of the case
+    constexpr const char* kMeasures[] = {"iters",
+                                         "ns_min",
+                                         "ns_median",
+                                         "ns_p90",
+                                         "ns_mean",
+                                         "mb_per_s",
+                                         "wall_s",
+                                         "jobs_per_s",
+                                         "ms_p50",
+                                         "ms_p99",
+                                         "encode_ms_p50",
+                                         "decode_ms_p50",
+                                         "peak_rss_kb",
+                                         "failed",
+                                         "mismatched"};
+
+    // Helper: parses one flat JSON object of string, number and boolean
+    // members, as the benchmarks print them
+    bool parse_line(const std::string& line,
+                    std::vector<std::pair<std::string, std::string>>& members)
+    {
+        std::size_t i = line.find('{');
+        if (i == std::string::npos) {
+            return false;
+        }
+
+        auto read_string = [&line, &i](std::string& out) {
+            if (i >= line.size() || line[i] != '"') {
+                return false;
+            }
+
+            for (++i; i < line.size() && line[i] != '"'; ++i) {
+                if (line[i] == '\\' && i + 1 < line.size()) {
+                    ++i;
+                }
+
+                out += line[i];
+            }
+
+            return i++ < line.size();
+        };
+
+        members.clear();
+        for (++i; i < line.size() && line[i] != '}';) {
+            std::string key;
+            std::string value;
+            if (!read_string(key) || i >= line.size() || line[i++] != ':') {
+                return false;
+            }
+
+            if (i < line.size() && line[i] == '"') {
+                if (!read_string(value)) {
+                    return false;
+                }
+            } else {
+                const std::size_t end = line.find_first_of(",}", i);
+                if (end == std::string::npos) {
+                    return false;
+                }
+
+                value = line.substr(i, end - i);
+                i = end;
+            }
+
+            members.emplace_back(std::move(key), std::move(value));
+            if (i < line.size() && line[i] == ',') {
+                ++i;
+            }
+        }
+
+        return true;
+    }
+
+    // Helper: loads a result file, grouping the runs of each case
+    bool load(const char* path, Results& results)
+    {
+        std::ifstream file(path);
+        if (!file) {
+            steg::Log::error("Unable to open", path);
+            return false;
+        }
+
+        std::size_t lineno = 0;
+        std::vector<std::pair<std::string, std::string>> members;
+        for (std::string line; std::getline(file, line);) {
+            ++lineno;
+            if (line.find_first_not_of(" \t\r") == std::string::npos) {
+                continue;
+            }
+
+            if (!parse_line(line, members)) {
+                steg::Log::error("Malformed result",
+                                 steg::log_field("file", path),
+                                 steg::log_field("line", lineno));
+                return false;
+            }
+
+            std::string key;
+            double ns = 0;
+            double jobsPerS = 0;
+            double failures = 0;
+
+            for (const auto& [name, value]: members) {
+                const bool measure = std::any_of(
+                    std::begin(kMeasures),
+                    std::end(kMeasures),
+                    [&name](const char* m) {
+                        return name == m;
+                    });
+
+                if (!measure) {
+                    key += key.empty() ? value : " " + name + "=" + value;
+                } else if (name == "ns_median") {
+                    ns = std::strtod(value.c_str(), nullptr);
+                } else if (name == "jobs_per_s") {
+                    jobsPerS = std::strtod(value.c_str(), nullptr);
+                } else if (name == "failed" || name == "mismatched") {
+                    failures += std::strtod(value.c_str(), nullptr);
+                }
+            }
+
+            // Machine description, not a measurement
+            if (key.rfind("meta", 0) == 0
+                || (ns <= 0 && jobsPerS <= 0 && failures == 0)) {
+                continue;
+            }
+
+            auto [it, added] = results.index.emplace(key, results.cases.size());
+            if (added) {
+                results.cases.emplace_back().key = key;
+            }
+
+            // Lower is better for both: time per run, or per round trip
+            Case& entry = results.cases[it->second];
+            entry.unit = ns > 0 ? "ns" : "ms/job";
+            if (ns > 0 || jobsPerS > 0) {
+                entry.values.push_back(ns > 0 ? ns : 1e3 / jobsPerS);
+            }
+
+            entry.failures += failures;
+        }
+
+        return true;
+    }
+
+    // Helper: mean and sample variance
+    std::pair<double, double> moments(const std::vector<double>& values)
+    {
+        double mean = 0;
+        for (const double v: values) {
+            mean += v;
+        }
+
+        mean /= static_cast<double>(values.size());
+
+        double var = 0;
+        for (const double v: values) {
+            var += (v - mean) * (v - mean);
+        }
+
+        const std::size_t n = values.size();
+        return {mean, n > 1 ? var / static_cast<double>(n - 1) : 0};
+    }
+
+    // Helper: two-sided quantile of the standard normal distribution at a
+    // confidence level, by bisection
+    double normal_quantile(const double confidence)
+    {
+        const double tail = (1 - confidence) / 2;
+
+        double lo = 0;
+        double hi = 10;
+        for (int i = 0; i != 100; ++i) {
+            const double mid = (lo + hi) / 2;
+            (0.5 * std::erfc(mid / std::sqrt(2.0)) > tail ? lo : hi) = mid;
+        }
+
+        return (lo + hi) / 2;
+    }
+
+    // Helper: two-sided quantile of Student's t distribution, from the
+    // normal one by its Cornish-Fisher expansion; good to about 1% from 3
+    // degrees of freedom up
+    double t_quantile(const double confidence, const double df)
+    {
+        const double z = normal_quantile(confidence);
+        const double z3 = z * z * z;
+        const double z5 = z3 * z * z;
+        const double z7 = z5 * z * z;
+        const double z9 = z7 * z * z;
+
+        return z + (z3 + z) / (4 * df)
+               + (5 * z5 + 16 * z3 + 3 * z) / (96 * df * df)
+               + (3 * z7 + 19 * z5 + 17 * z3 - 15 * z) / (384 * df * df * df)
+               + (79 * z9 + 776 * z7 + 1482 * z5 - 1920 * z3 - 945 * z)
+                     / (92160 * df * df * df * df);
+    }
+
+    // @bag
+    struct Verdict {
+        const char* name = "no-ci";
+        double change = 0;
+        double low = 0;
+        double high = 0;
+        bool regressed = false;
+    };
+
+    // Helper: relative change of the candidate's mean with its confidence
+    // interval (Welch), and whether it is a regression
+    Verdict judge(const CompareOptions& opts,
+                  const Case& base,
+                  const Case& cand)
+    {
+        const auto [m1, v1] = moments(base.values);
+        const auto [m2, v2] = moments(cand.values);
+        const auto n1 = static_cast<double>(base.values.size());
+        const auto n2 = static_cast<double>(cand.values.size());
+
+        Verdict verdict;
+        if (cand.failures > 0 || n1 == 0 || n2 == 0) {
+            verdict.name = "failed";
+            verdict.regressed = true;
+            return verdict;
+        }
+
+        verdict.change = (m2 - m1) / m1;
+
+        if (n1 < 2 || n2 < 2) {
+            return verdict; // No spread to judge significance by
+        }
+
+        const double s1 = v1 / n1;
+        const double s2 = v2 / n2;
+        const double se = std::sqrt(s1 + s2);
+
+        // Welch-Satterthwaite degrees of freedom
+        double df = n1 + n2 - 2;
+        if (s1 + s2 > 0) {
+            df = (s1 + s2) * (s1 + s2)
+                 / ((s1 * s1) / (n1 - 1) + (s2 * s2) / (n2 - 1));
+        }
+
+        const double margin
+            = t_quantile(opts.confidence, std::max(df, 1.0)) * se;
+        verdict.low = (m2 - m1 - margin) / m1;
+        verdict.high = (m2 - m1 + margin) / m1;
+
+        if (verdict.low > opts.threshold) {
+            verdict.name = "regressed";
+            verdict.regressed = true;
+        } else if (verdict.high < -opts.threshold) {
+            verdict.name = "improved";
+        } else {
+            verdict.name = "same";
+        }
+
+        return verdict;
+    }
+} // namespace
+
+int main(int argc, char** argv)
+{
+    CompareOptions opts;
+
+    int opt = 0;
+    while ((opt = getopt(argc, argv, "c:t:h")) != -1) {
+        switch (opt) {
+            case 'c':
+                opts.confidence = std::strtod(optarg, nullptr);
+                break;
+            case 't':
+                opts.threshold = std::strtod(optarg, nullptr);
+                break;
+            default:
+                print_usage(argv[0]);
+                return opt == 'h' ? 0 : 2;
+        }
+    }
+
+    if (argc - optind != 2 || opts.confidence <= 0 || opts.confidence >= 1
+        || opts.threshold < 0) {
+        print_usage(argv[0]);
+        return 2;
+    }
+
+    Results base;
+    Results cand;
+    if (!load(argv[optind], base) || !load(argv[optind + 1], cand)) {
+        return 2;
+    }
+
+    const int percent = static_cast<int>(std::lround(opts.confidence * 100));
+    std::printf("%-10s %8s %19s %19s %19s  %s\n",
+                "verdict",
+                "change",
+                (std::to_string(percent) + "% interval").c_str(),
+                "baseline",
+                "candidate",
+                "case");
+
+    std::size_t regressions = 0;
+    std::size_t unjudged = 0;
+    std::size_t missing = 0;
+
+    for (const Case& entry: base.cases) {
+        // A case the candidate no longer produces may have failed outright
+        const auto it = cand.index.find(entry.key);
+        if (it == cand.index.end()) {
+            steg::Log::error("Not in candidate", entry.key.c_str());
+            std::printf("%-10s %8s %19s %12.4g %-6s %12s %-6s  %s\n",
+                        "missing",
+                        "",
+                        "",
+                        moments(entry.values).first,
+                        entry.unit,
+                        "",
+                        "",
+                        entry.key.c_str());
+            ++missing;
+            continue;
+        }
+
+        const Case& other = cand.cases[it->second];
+        const Verdict verdict = judge(opts, entry, other);
+        regressions += verdict.regressed ? 1 : 0;
+        unjudged += std::strcmp(verdict.name, "no-ci") == 0 ? 1 : 0;
+
+        char interval[32] = "";
+        if (verdict.low != verdict.high) {
+            std::snprintf(interval,
+                          sizeof(interval),
+                          "[%+.1f%%, %+.1f%%]",
+                          verdict.low * 100,
+                          verdict.high * 100);
+        }
+
+        std::printf("%-10s %+7.1f%% %19s %12.4g %-6s %12.4g %-6s  %s\n",
+                    verdict.name,
+                    verdict.change * 100,
+                    interval,
+                    moments(entry.values).first,
+                    entry.unit,
+                    moments(other.values).first,
+                    other.unit,
+                    entry.key.c_str());
+    }
+
+    for (const Case& entry: cand.cases) {
+        if (base.index.count(entry.key) == 0) {
+            steg::Log::warning("Not in baseline", entry.key.c_str());
+        }
+    }
+
+    if (unjudged != 0) {
+        steg::Log::warning("Cases with fewer than 2 runs were not judged",
+                           steg::log_field("count", unjudged));
+    }
+
+    std::printf("\n%zu of %zu cases regressed, %zu missing\n",
+                regressions,
+                base.cases.size(),
+                missing);
+    if (missing != 0) {
+        return 2;
+    }
+
+    return regressions != 0 ? 1 : 0;
+}
@@ -0,0 +1,543 @@
+/* steg_e2e.cpp -- v1.0
+   End-to-end throughput of the steg binary: generates carriers and payloads
+   into a scratch directory (tmpfs when there is one), runs encode/decode
+   round trips as separate processes at several thread counts, checks every
+   decoded payload bit for bit and prints one JSON line per thread count */
+
+#include "image.hpp"
+#include "log.hpp"
+#include "scheduler.hpp"
+#include "stream.hpp"
+#include "synthetic.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <getopt.h>
+#include <spawn.h>
+#include <string>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <thread>
+#include <vector>
+
+extern char** environ;
+
+namespace {
+    using Clock = std::chrono::steady_clock;
+
+    /*! Helper: Outputs usage statement to stdout
+     */
+    inline void print_usage(const char* app)
+    {
+        printf("Usage: %s\n"
+               "  [-x<steg-binary>]\n"
+               "  [-n<jobs>]\n"
+               "  [-T<threads>[,<threads>...]] [-r<runs>]\n"
+               "  [-W<width>] [-H<height>] [-c<channels>] [-t<file-type>]\n"
+               "  [-s<payload-size>] [-e<entropy-bits>]\n"
+               "  [-b] [-m<cipher-mode>]\n"
+               "  [-d<work-dir>] [-K]\n"
+               "  [-o<output-file>]\n\n",
+               app);
+
+        printf("\t%s\n\t%s\n\t%s\n\t%s\n\t%s\n\t%s\n\t%s\n\t%s\n\t%s\n\t%s\n"
+               "\t%s\n\t%s\n\t%s\n\t%s\n\t%s\n",
+               "-x<steg-binary>            Binary to run; defaults to steg "
+               "next to this one",
+               "-n<jobs>                   Round trips per thread count; "
+               "defaults to 16",
+               "-T<threads>                Comma separated thread counts; "
+               "defaults to 1,2,4",
+               "-r<runs>                   Runs every thread count this many "
+               "times; defaults to 1",
+               "-W<width>                  Carrier width; defaults to 512",
+               "-H<height>                 Carrier height; defaults to 512",
+               "-c<channels>               Carrier channels, 1 to 4; "
+               "defaults to 3",
+               "-t<file-type>              Carrier and output file type; "
+               "defaults to png",
+               "-s<payload-size>           Payload bytes; defaults to 8192",
+               "-e<entropy-bits>           Payload entropy per byte, 0 to 8; "
+               "defaults to 8",
+               "-b                         Encode to base64",
+               "-m<cipher-mode>            cbc (default) or ctr",
+               "-d<work-dir>               Scratch directory; defaults to a "
+               "new one in /dev/shm, or /tmp",
+               "-K                         Keeps the scratch directory",
+               "-o<output-file>            JSON lines go to this file; "
+               "defaults to stdout");
+    }
+
+    // @bag
+    struct E2eOptions {
+        std::string app;
+        unsigned jobs = 16;
+        std::vector<unsigned> threads = {1, 2, 4};
+        unsigned runs = 1;
+
+        // Carriers
+        unsigned width = 512;
+        unsigned height = 512;
+        unsigned channels = 3;
+        steg::Image::ImageType type = steg::Image::ImageType::kPng;
+
+        // Payloads
+        std::size_t size = 8192;
+        unsigned entropy = 8;
+
+        bool b64 = false;
+        std::string mode = "cbc";
+
+        std::string dir;
+        bool keep = false;
+        FILE* out = stdout;
+    };
+
+    // @bag
+    struct Job {
+        double encodeMs = 0;
+        double decodeMs = 0;
+        bool failed = false;
+        bool mismatched = false;
+    };
+
+    // Helper: value at quantile q of sorted samples
+    double quantile(const std::vector<double>& sorted, const double q)
+    {
+        if (sorted.empty()) {
+            return 0;
+        }
+
+        const auto i = static_cast<std::size_t>(
+            q * static_cast<double>(sorted.size() - 1) + 0.5);
+        return sorted[i];
+    }
+
+    // Helper: writes a buffer to a new file
+    bool write_file(const std::string& path,
+                    const char* data,
+                    const std::size_t size)
+    {
+        steg::OutputStream out;
+        return out.open(path.c_str()) && out.write(data, size) && out.close();
+    }
+
+    // Helper: runs a command to completion, stdout discarded
+    // @param peakKb[out] raised to the child's peak RSS
+    // @return true if it exited with status 0
+    bool run(const std::vector<std::string>& args, long& peakKb)
+    {
+        std::vector<char*> argv;
+        for (const std::string& arg: args) {
+            argv.push_back(const_cast<char*>(arg.c_str()));
+        }
+
+        argv.push_back(nullptr);
+
+        posix_spawn_file_actions_t actions;
+        ::posix_spawn_file_actions_init(&actions);
+        ::posix_spawn_file_actions_addopen(
+            &actions, STDOUT_FILENO, "/dev/null", O_WRONLY, 0);
+
+        pid_t pid = 0;
+        const int err = ::posix_spawn(
+            &pid, argv[0], &actions, nullptr, argv.data(), environ);
+        ::posix_spawn_file_actions_destroy(&actions);
+
+        if (err != 0) {
+            steg::Log::error("Unable to run", argv[0]);
+            return false;
+        }
+
+        int status = 0;
+        rusage usage = {};
+        if (::wait4(pid, &status, 0, &usage) != pid) {
+            return false;
+        }
+
+        peakKb = std::max(peakKb, usage.ru_maxrss);
+        return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    }
+
+    // Helper: checks a decoded payload against the original; cbc output
+    // keeps the zero padding of its last block
+    bool matches(const std::string& path,
+                 const std::string& payload,
+                 const bool padded)
+    {
+        std::string decoded;
+        if (!steg::read_all(path.c_str(), decoded)
+            || decoded.size() < payload.size()
+            || decoded.compare(0, payload.size(), payload) != 0) {
+            return false;
+        }
+
+        const std::size_t extra = decoded.size() - payload.size();
+        if (extra != 0 && (!padded || extra >= 16)) {
+            return false;
+        }
+
+        return std::all_of(decoded.begin() + payload.size(),
+                           decoded.end(),
+                           [](const char c) {
+                               return c == '\0';
+                           });
+    }
+
+    // Helper: key, initialization vector, one carrier and one payload per
+    // job, in the scratch directory
+    bool generate(const E2eOptions& opts, std::vector<std::string>& payloads)
+    {
+        char key[16];
+        char vec[16];
+        steg::bench::fill_entropy(key, sizeof(key), 6, 1);
+        steg::bench::fill_entropy(vec, sizeof(vec), 6, 2);
+
+        // Printable, so the files can be inspected
+        for (std::size_t i = 0; i != sizeof(key); ++i) {
+            key[i] = static_cast<char>(key[i] + '0');
+            vec[i] = static_cast<char>(vec[i] + '0');
+        }
+
+        if (!write_file(opts.dir + "/key", key, sizeof(key))
+            || !write_file(opts.dir + "/vec", vec, sizeof(vec))) {
+            return false;
+        }
+
+        const char* ext = steg::Image::type_name(opts.type);
+
+        payloads.resize(opts.jobs);
+        for (unsigned i = 0; i != opts.jobs; ++i) {
+            std::string tga = steg::bench::synthetic_tga(
+                opts.width, opts.height, opts.channels);
+            steg::bench::fill(tga.data() + 18, tga.size() - 18, i + 1);
+
+            steg::Image carrier;
+            const std::string name = opts.dir + "/carrier" + std::to_string(i);
+            if (carrier.open(reinterpret_cast<const unsigned char*>(tga.data()),
+                             tga.size())
+                    == 0
+                || !carrier.save((name + "." + ext).c_str(), opts.type)) {
+                return false;
+            }
+
+            std::string& payload = payloads[i];
+            payload.resize(opts.size);
+            steg::bench::fill_entropy(
+                payload.data(), payload.size(), opts.entropy, i + 1);
+
+            const std::string path = opts.dir + "/payload" + std::to_string(i);
+            if (!write_file(path, payload.data(), payload.size())) {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    // Helper: encode and decode of job i, timed and checked
+    Job round_trip(const E2eOptions& opts,
+                   const std::string& payload,
+                   const unsigned i,
+                   long& peakKb)
+    {
+        const char* ext = steg::Image::type_name(opts.type);
+        const std::string n = std::to_string(i);
+        const std::string carrier = opts.dir + "/carrier" + n + "." + ext;
+        const std::string encoded = opts.dir + "/encoded" + n + "." + ext;
+        const std::string decoded = opts.dir + "/decoded" + n;
+
+        std::vector<std::string> common = {"-k",
+                                           opts.dir + "/key",
+                                           "-v",
+                                           opts.dir + "/vec",
+                                           "-m",
+                                           opts.mode};
+        if (opts.b64) {
+            common.push_back("-b");
+        }
+
+        std::vector<std::string> encode = {opts.app,
+                                           "--encode",
+                                           "-f",
+                                           carrier,
+                                           "-i",
+                                           opts.dir + "/payload" + n,
+                                           "-o",
+                                           encoded,
+                                           "-t",
+                                           ext};
+        encode.insert(encode.end(), common.begin(), common.end());
+
+        std::vector<std::string> decode
+            = {opts.app, "--decode", "-f", encoded, "-o", decoded};
+        decode.insert(decode.end(), common.begin(), common.end());
+
+        using Ms = std::chrono::duration<double, std::milli>;
+
+        Job job;
+        Clock::time_point t0 = Clock::now();
+        job.failed = !run(encode, peakKb);
+        job.encodeMs = Ms(Clock::now() - t0).count();
+
+        if (!job.failed) {
+            t0 = Clock::now();
+            job.failed = !run(decode, peakKb);
+            job.decodeMs = Ms(Clock::now() - t0).count();
+        }
+
+        if (!job.failed) {
+            job.mismatched = !matches(decoded, payload, opts.mode == "cbc");
+        }
+
+        return job;
+    }
+
+    // Helper: all jobs on a number of threads, printed as one JSON line
+    // @return true if every round trip succeeded
+    bool bench(const E2eOptions& opts,
+               const std::vector<std::string>& payloads,
+               const unsigned threads)
+    {
+        std::vector<Job> jobs(opts.jobs);
+        std::vector<long> peaks(threads, 0);
+        std::atomic<unsigned> next = 0;
+
+        const Clock::time_point start = Clock::now();
+
+        std::vector<std::thread> workers;
+        for (unsigned t = 0; t != threads; ++t) {
+            workers.emplace_back([&, t] {
+                for (unsigned i = next++; i < opts.jobs; i = next++) {
+                    jobs[i] = round_trip(opts, payloads[i], i, peaks[t]);
+                }
+            });
+        }
+
+        for (std::thread& worker: workers) {
+            worker.join();
+        }
+
+        const double wallS
+            = std::chrono::duration<double>(Clock::now() - start).count();
+
+        std::vector<double> totals;
+        std::vector<double> encodes;
+        std::vector<double> decodes;
+        unsigned failed = 0;
+        unsigned mismatched = 0;
+
+        for (const Job& job: jobs) {
+            failed += job.failed ? 1 : 0;
+            mismatched += job.mismatched ? 1 : 0;
+            if (!job.failed) {
+                totals.push_back(job.encodeMs + job.decodeMs);
+                encodes.push_back(job.encodeMs);
+                decodes.push_back(job.decodeMs);
+            }
+        }
+
+        std::sort(totals.begin(), totals.end());
+        std::sort(encodes.begin(), encodes.end());
+        std::sort(decodes.begin(), decodes.end());
+
+        const auto done = static_cast<double>(totals.size());
+        const double bytes = done * static_cast<double>(opts.size);
+
+        std::fprintf(
+            opts.out,
+            "{\"bench\":\"e2e\",\"threads\":%u,\"jobs\":%u,\"width\":%u,"
+            "\"height\":%u,\"channels\":%u,\"format\":\"%s\",\"payload\":%zu,"
+            "\"entropy\":%u,\"b64\":%s,\"mode\":\"%s\",\"wall_s\":%.3f,"
+            "\"jobs_per_s\":%.2f,\"mb_per_s\":%.3f,\"ms_p50\":%.3f,"
+            "\"ms_p99\":%.3f,\"encode_ms_p50\":%.3f,\"decode_ms_p50\":%.3f,"
+            "\"peak_rss_kb\":%ld,\"failed\":%u,\"mismatched\":%u}\n",
+            threads,
+            opts.jobs,
+            opts.width,
+            opts.height,
+            opts.channels,
+            steg::Image::type_name(opts.type),
+            opts.size,
+            opts.entropy,
+            opts.b64 ? "true" : "false",
+            opts.mode.c_str(),
+            wallS,
+            done / wallS,
+            (bytes / 1e6) / wallS,
+            quantile(totals, 0.5),
+            quantile(totals, 0.99),
+            quantile(encodes, 0.5),
+            quantile(decodes, 0.5),
+            *std::max_element(peaks.begin(), peaks.end()),
+            failed,
+            mismatched);
+        std::fflush(opts.out);
+
+        return failed == 0 && mismatched == 0;
+    }
+
+    // Helper: new scratch directory, on tmpfs if there is one
+    std::string make_dir()
+    {
+        for (const char* base: {"/dev/shm", "/tmp"}) {
+            std::string dir = std::string(base) + "/steg_e2e.XXXXXX";
+            if (::mkdtemp(dir.data()) != nullptr) {
+                return dir;
+            }
+        }
+
+        return {};
+    }
+
+    // Helper: parses a comma separated list of thread counts
+    std::vector<unsigned> parse_threads(const char* list)
+    {
+        std::vector<unsigned> threads;
+        for (const char* p = list; *p != '\0';) {
+            char* end = nullptr;
+            const unsigned long n = std::strtoul(p, &end, 10);
+            if (end == p) {
+                return {};
+            }
+
+            threads.push_back(n == 0 ? steg::available_cpus()
+                                     : static_cast<unsigned>(n));
+            p = *end == ',' ? end + 1 : end;
+        }
+
+        return threads;
+    }
+} // namespace
+
+int main(int argc, char** argv)
+{
+    E2eOptions opts;
+    std::string outputPath;
+
+    auto number = [] {
+        return std::strtoul(optarg, nullptr, 10);
+    };
+
+    int opt = 0;
+    while ((opt = getopt(argc, argv, "x:n:T:r:W:H:c:t:s:e:bm:d:Ko:h")) != -1) {
+        switch (opt) {
+            case 'x':
+                opts.app = optarg;
+                break;
+            case 'n':
+                opts.jobs = static_cast<unsigned>(number());
+                break;
+            case 'T':
+                opts.threads = parse_threads(optarg);
+                break;
+            case 'r':
+                opts.runs = static_cast<unsigned>(number());
+                break;
+            case 'W':
+                opts.width = static_cast<unsigned>(number());
+                break;
+            case 'H':
+                opts.height = static_cast<unsigned>(number());
+                break;
+            case 'c':
+                opts.channels = static_cast<unsigned>(number());
+                break;
+            case 't':
+                opts.type = steg::Image::parse_type(optarg);
+                break;
+            case 's':
+                opts.size = number();
+                break;
+            case 'e':
+                opts.entropy = static_cast<unsigned>(number());
+                break;
+            case 'b':
+                opts.b64 = true;
+                break;
+            case 'm':
+                opts.mode = optarg;
+                break;
+            case 'd':
+                opts.dir = optarg;
+                opts.keep = true;
+                break;
+            case 'K':
+                opts.keep = true;
+                break;
+            case 'o':
+                outputPath = optarg;
+                break;
+            default:
+                print_usage(argv[0]);
+                return opt == 'h' ? 0 : 1;
+        }
+    }
+
+    if (opts.jobs == 0 || opts.threads.empty() || opts.width == 0
+        || opts.width > UINT16_MAX || opts.height == 0
+        || opts.height > UINT16_MAX || opts.channels == 0 || opts.channels > 4
+        || opts.type == steg::Image::ImageType::kNil || opts.entropy > 8
+        || (opts.mode != "cbc" && opts.mode != "ctr")) {
+        steg::Log::error("Bad arguments, exiting");
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    if (opts.app.empty()) {
+        opts.app = (std::filesystem::path(argv[0]).parent_path() / "steg")
+                       .string();
+    }
+
+    if (opts.dir.empty()) {
+        opts.dir = make_dir();
+    } else {
+        std::filesystem::create_directories(opts.dir);
+    }
+
+    if (opts.dir.empty()) {
+        steg::Log::error("Unable to create a work dir");
+        return 1;
+    }
+
+    if (!outputPath.empty()) {
+        opts.out = std::fopen(outputPath.c_str(), "w");
+        if (opts.out == nullptr) {
+            steg::Log::error("Unable to create", outputPath.c_str());
+            return 1;
+        }
+    }
+
+    bool ok = false;
+    std::vector<std::string> payloads;
+    if (generate(opts, payloads)) {
+        std::fprintf(opts.out,
+                     "{\"bench\":\"meta\",\"app\":\"%s\",\"dir\":\"%s\","
+                     "\"cpus\":%u}\n",
+                     opts.app.c_str(),
+                     opts.dir.c_str(),
+                     steg::available_cpus());
+
+        ok = true;
+        for (unsigned run = 0; run < opts.runs; ++run) {
+            for (const unsigned threads: opts.threads) {
+                ok = bench(opts, payloads, threads) && ok;
+            }
+        }
+    } else {
+        steg::Log::error("Unable to generate inputs in", opts.dir.c_str());
+    }
+
+    if (!opts.keep) {
+        std::error_code error;
+        std::filesystem::remove_all(opts.dir, error);
+    }
+
+    return std::fclose(opts.out) == 0 && ok ? 0 : 1;
+}
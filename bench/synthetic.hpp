@@ -0,0 +1,88 @@
+/* synthetic.hpp -- v1.0
+   Deterministic carriers and payloads for the benchmarks, generated in
+   memory */
+
+#pragma once
+
+#include "image.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace steg::bench {
+    //! Fills a buffer with pseudo-random bytes; the same seed gives the same
+    //! bytes on every run
+    //! @param data[out] buffer to fill
+    //! @param size size of data
+    //! @param seed non-zero seed
+    inline void fill(char* data, const std::size_t size, std::uint64_t seed)
+    {
+        for (std::size_t i = 0; i != size; ++i) {
+            seed ^= seed << 13;
+            seed ^= seed >> 7;
+            seed ^= seed << 17;
+            data[i] = static_cast<char>(seed);
+        }
+    }
+
+    //! Fills a buffer with bytes of a given entropy: each byte is drawn
+    //! uniformly from 2^bits values, so 8 is incompressible and 0 is all
+    //! zeros
+    //! @param data[out] buffer to fill
+    //! @param size size of data
+    //! @param bits entropy per byte, 0 to 8
+    //! @param seed non-zero seed
+    inline void fill_entropy(char* data,
+                             const std::size_t size,
+                             const unsigned bits,
+                             const std::uint64_t seed)
+    {
+        fill(data, size, seed);
+
+        const auto mask = static_cast<unsigned char>((1u << bits) - 1);
+        for (std::size_t i = 0; i != size; ++i) {
+            data[i] = static_cast<char>(data[i] & mask);
+        }
+    }
+
+    //! Uncompressed TGA file of random pixels
+    //! @param w width, at most 65535
+    //! @param h height, at most 65535
+    //! @param nchanns 1 to 4: grey, grey + alpha, RGB or RGBA
+    //! @return TGA file content
+    inline std::string synthetic_tga(const unsigned w,
+                                     const unsigned h,
+                                     const unsigned nchanns)
+    {
+        std::string file(18, '\0');
+        file[2] = static_cast<char>(nchanns <= 2 ? 3 : 2);
+        file[12] = static_cast<char>(w & 0xff);
+        file[13] = static_cast<char>(w >> 8);
+        file[14] = static_cast<char>(h & 0xff);
+        file[15] = static_cast<char>(h >> 8);
+        file[16] = static_cast<char>(8 * nchanns);
+        file[17] = static_cast<char>(nchanns % 2 == 0 ? 0x28 : 0x20);
+
+        const std::size_t header = file.size();
+        file.resize(header + (std::size_t{w} * h * nchanns));
+        fill(file.data() + header, file.size() - header, w * 31 + nchanns);
+        return file;
+    }
+
+    //! Loads a synthetic carrier of random pixels
+    //! @param w width, at most 65535
+    //! @param h height, at most 65535
+    //! @param nchanns 1 to 4
+    //! @param image[out] loaded image, must be empty
+    //! @return true on success
+    inline bool synthetic_image(const unsigned w,
+                                const unsigned h,
+                                const unsigned nchanns,
+                                Image& image)
+    {
+        const std::string file = synthetic_tga(w, h, nchanns);
+        return image.open(reinterpret_cast<const unsigned char*>(file.data()),
+                          file.size())
+               != 0;
+    }
+} // namespace steg::bench
@@ -28,6 +28,9 @@ namespace steg {
         template <typename Tinp, typename Tout>
         bool run(Tinp& inp, Tout& out);
 
+        //! Rewinds the cipher between messages
+        using Decoder::reset;
+
         ~BlockDecoder() override = default;
     private:
         /*! Helper
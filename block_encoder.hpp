@@ -9,6 +9,7 @@
 #include "decoder.hpp"
 #include "encoder.hpp"
 #include <cmath>
+#include <cstring>
 #include <span>
 #include <type_traits>
 #include <utility>
@@ -36,7 +37,40 @@ namespace steg {
         //! @return Boolean flag indicating success or failure
         template <typename Tinp, typename Tout>
         bool run(Tinp& inp, Tout& out);
+
+        //! Rewinds the cipher between messages
+        using Encoder::reset;
     private:
+        // Initial read size for input of unknown size
+        static constexpr std::size_t kStreamChunk = 1 << 20;
+
+        /* Helper
+         * Reads input of unknown size (pipes, terminals) until EOF
+         */
+        template <typename Tinp, typename Tout>
+        bool run_stream(Tinp& inp, Tout& out);
+
+        /* Helper
+         * Encrypts input that is already in memory (e.g. a mapped file)
+         * without copying it into an intermediate buffer first
+         */
+        template <typename Tout>
+        bool run_mapped(const char* data, std::size_t size, Tout& out);
+
+        /* Helper
+         * True if the input stream reports a failed read; a short read is
+         * then a truncated input rather than EOF
+         */
+        template <typename Tinp>
+        static bool read_failed(const Tinp& inp)
+        {
+            if constexpr (requires { inp.failed(); }) {
+                return inp.failed();
+            }
+
+            return false;
+        }
+
         /* Helper
          * Pads the buffer size to a multiple of the digest length
          */
@@ -51,32 +85,33 @@ namespace steg {
         }
 
         /* Helper
-         * Generates a digest from the message
+         * Generates a digest from the message in-place and pipes it to output
          */
-        template <typename Tout, bool vvb64 = b64>
-        bool encode_digest(Tout& out,
-                           char* buff,
-                           std::enable_if_t<!vvb64, std::size_t> size)
+        template <typename Tout>
+        bool encode_digest(Tout& out, char* buff, std::size_t size)
         {
-            // Try to encode raw data to digest
-            // and pipe to output
-            return Encoder::encode(buff, size) && out.write(buff, size);
+            return Encoder::encode(buff, size) && write_digest(out, buff, size);
         }
 
         /* Helper
-         * Generates a digest from the message and encodes the result to base64
+         * Pipes the digest to output
          */
         template <typename Tout, bool vvb64 = b64>
-        bool encode_digest(Tout& out,
-                           char* buff,
-                           std::enable_if_t<vvb64, std::size_t> size)
+        bool write_digest(Tout& out,
+                          char* buff,
+                          std::enable_if_t<!vvb64, std::size_t> size)
         {
-            // Encode raw data to digest
-            if (!Encoder::encode(buff, size)) {
-                return false;
-            }
+            return out.write(buff, size);
+        }
 
-            // Encode digest to base64...
+        /* Helper
+         * Encodes the digest to base64 and pipes the result to output
+         */
+        template <typename Tout, bool vvb64 = b64>
+        bool write_digest(Tout& out,
+                          char* buff,
+                          std::enable_if_t<vvb64, std::size_t> size)
+        {
             // Calculate base64 size
             std::size_t b64size = ((size + 2) / 3) * 4;
 
@@ -122,7 +157,14 @@ namespace steg {
         // Input read size
         std::size_t inpSize = inp.size();
         if (inpSize == 0) {
-            inpSize = 100000; // Default size for unknown size input
+            return run_stream(inp, out); // Unknown size input
+        }
+
+        // Encrypt straight from the input's memory when it has any
+        if constexpr (requires { inp.data(); }) {
+            if (const char* data = inp.data(); data != nullptr) {
+                return run_mapped(data, inpSize, out);
+            }
         }
 
         // Padded to a multiple of the block size
@@ -131,8 +173,87 @@ namespace steg {
         // Run...
         bool ret = false;
 
-        if (std::size_t size = inp.read(buff, inpSize); size != 0) {
-            ret = encode_digest(out, buff, calc_digest_size(size));
+        if (std::size_t size = inp.read(buff, inpSize);
+            size != 0 && !read_failed(inp)) {
+            const std::size_t digestSize = calc_digest_size(size);
+            std::memset(buff + size, 0, digestSize - size);
+            ret = encode_digest(out, buff, digestSize);
+        }
+
+        // Clean up & return
+        Talloc::deallocate(buff);
+        return ret;
+    }
+
+    /*! Reads unknown size input until EOF, then encrypts it
+     */
+    template <bool b64, typename Talloc>
+    template <typename Tinp, typename Tout>
+    bool BlockEncoder<b64, Talloc>::run_stream(Tinp& inp, Tout& out)
+    {
+        // Spare room past capacity for the block padding
+        const std::size_t pad = (Encoder::get())->length;
+
+        std::size_t capacity = kStreamChunk;
+        std::size_t size = 0;
+        char* buff = Talloc::allocate(capacity + pad);
+
+        // Read in large chunks, doubling the buffer whenever it fills up
+        for (;;) {
+            const std::size_t want = capacity - size;
+            const std::size_t n = inp.read(buff + size, want);
+
+            size += n;
+            if (n != want) {
+                break; // EOF
+            }
+
+            char* grown = Talloc::allocate((capacity * 2) + pad);
+            std::memcpy(grown, buff, size);
+            Talloc::deallocate(buff);
+
+            buff = grown;
+            capacity *= 2;
+        }
+
+        // Run...
+        bool ret = false;
+
+        if (size != 0 && !read_failed(inp)) {
+            const std::size_t digestSize = calc_digest_size(size);
+            std::memset(buff + size, 0, digestSize - size);
+            ret = encode_digest(out, buff, digestSize);
+        }
+
+        // Clean up & return
+        Talloc::deallocate(buff);
+        return ret;
+    }
+
+    /*! Encrypts input held in memory directly into the output buffer
+     */
+    template <bool b64, typename Talloc>
+    template <typename Tout>
+    bool BlockEncoder<b64, Talloc>::run_mapped(const char* data,
+                                               const std::size_t size,
+                                               Tout& out)
+    {
+        const std::size_t digestSize = calc_digest_size(size);
+        char* buff = Talloc::allocate(digestSize);
+
+        // Whole blocks are encrypted from the source into buff...
+        const std::size_t head = size - (size % (Encoder::get())->length);
+        bool ret = head == 0 || Encoder::encode(data, head, buff, head);
+
+        // ...and the trailing partial block is padded and encrypted in-place
+        if (ret && head != digestSize) {
+            std::memcpy(buff + head, data + head, size - head);
+            std::memset(buff + size, 0, digestSize - size);
+            ret = Encoder::encode(buff + head, digestSize - head);
+        }
+
+        if (ret) {
+            ret = write_digest(out, buff, digestSize);
         }
 
         // Clean up & return
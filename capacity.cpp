@@ -0,0 +1,195 @@
+/* capacity.cpp -- v1.0 */
+
+#include "capacity.hpp"
+#include "log.hpp"
+#include "scheduler.hpp"
+#include "stream.hpp"
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <dirent.h>
+#include <memory>
+#include <sys/stat.h>
+
+namespace {
+    // AES block size (see cipher_init()); encrypted payloads are padded to
+    // a multiple of it
+    constexpr std::size_t kBlockSize = 16;
+
+    // Headers read per parallel piece
+    constexpr std::size_t kProbeGrain = 64;
+
+    // @bag
+    struct Entry {
+        std::string path;
+
+        // Named on the command line rather than found in a directory
+        bool named = false;
+
+        steg::CarrierInfo info;
+        bool ok = false;
+    };
+
+    // Helper: fills in the capacities of a probed image
+    void set_capacity(steg::CarrierInfo& info)
+    {
+        const std::uint64_t pixels
+            = static_cast<std::uint64_t>(info.header.w) * info.header.h;
+
+        info.capacity = steg::payload_capacity(pixels, false);
+        info.capacity64 = steg::payload_capacity(pixels, true);
+    }
+
+    // Helper: lists the regular files of a directory, in name order
+    void list_dir(const std::string& dir, std::vector<Entry>& entries)
+    {
+        std::unique_ptr<DIR, int (*)(DIR*)> handle(::opendir(dir.c_str()),
+                                                  ::closedir);
+        if (handle == nullptr) {
+            return;
+        }
+
+        std::vector<std::string> names;
+        while (const dirent* ent = ::readdir(handle.get())) {
+            if (ent->d_name[0] != '.'
+                && (ent->d_type == DT_REG || ent->d_type == DT_UNKNOWN)) {
+                names.emplace_back(ent->d_name);
+            }
+        }
+
+        std::sort(names.begin(), names.end());
+
+        const bool slash = !dir.empty() && dir.back() == '/';
+        for (std::string& name: names) {
+            entries.emplace_back().path = slash ? dir + name : dir + "/" + name;
+        }
+    }
+} // namespace
+
+/*! Largest payload an image holds.
+ */
+std::size_t steg::payload_capacity(const std::uint64_t pixels, const bool b64)
+{
+    // One message bit per pixel
+    std::uint64_t bytes = pixels / 8;
+
+    // Base64 turns every 3 bytes into 4
+    if (b64) {
+        bytes = (bytes / 4) * 3;
+    }
+
+    return static_cast<std::size_t>(bytes - (bytes % kBlockSize));
+}
+
+/*! Reads an image file's header and works out its capacity.
+ */
+bool steg::probe_carrier(const char* path, CarrierInfo& info)
+{
+    info = {};
+    if (!Image::probe(path, info.header)) {
+        return false;
+    }
+
+    set_capacity(info);
+    return true;
+}
+
+/*! Reads an in-memory image file's header and works out its capacity.
+ */
+bool steg::probe_carrier(const unsigned char* data,
+                         const std::size_t size,
+                         CarrierInfo& info)
+{
+    info = {};
+    if (!Image::probe(data, size, info.header)) {
+        return false;
+    }
+
+    set_capacity(info);
+    return true;
+}
+
+/*! Reads the headers of image files.
+ */
+bool steg::scan_carriers(const std::vector<std::string>& paths,
+                         const unsigned threads,
+                         std::vector<Carrier>& carriers)
+{
+    std::vector<Entry> entries;
+    for (const std::string& path: paths) {
+        struct stat st = {};
+        if (::stat(path.c_str(), &st) == 0 && S_ISDIR(st.st_mode)) {
+            list_dir(path, entries);
+            continue;
+        }
+
+        Entry& entry = entries.emplace_back();
+        entry.path = path;
+        entry.named = true;
+    }
+
+    // Reading a header is mostly waiting on the disk; spread the files
+    // over the workers
+    auto probe = [&entries](std::size_t begin, std::size_t end) {
+        for (std::size_t i = begin; i != end; ++i) {
+            entries[i].ok
+                = probe_carrier(entries[i].path.c_str(), entries[i].info);
+        }
+    };
+
+    Scheduler scheduler(threads);
+    scheduler.parallel_for(entries.size(), kProbeGrain, probe);
+
+    bool ret = true;
+    for (Entry& entry: entries) {
+        if (entry.ok) {
+            carriers.push_back(
+                Carrier{.path = std::move(entry.path), .info = entry.info});
+            continue;
+        }
+
+        // Directories may hold anything, only named files must be images
+        if (entry.named) {
+            constexpr const char* kMessage = "Unable to read image header";
+            Log::error(kMessage, entry.path.c_str());
+            ret = false;
+        }
+    }
+
+    return ret;
+}
+
+/*! Reports the capacity of image files.
+ */
+int steg::capacity_run(const std::vector<std::string>& paths,
+                       const unsigned threads,
+                       OutputStream& report)
+{
+    std::vector<Carrier> carriers;
+    const bool ok = scan_carriers(paths, threads, carriers);
+
+    std::string out;
+    for (const Carrier& carrier: carriers) {
+        const Image::Header& header = carrier.info.header;
+
+        char fields[160];
+        std::snprintf(fields,
+                      sizeof(fields),
+                      "\t%s\t%u\t%u\t%u\t%" PRIu64 "\t%zu\t%zu\n",
+                      Image::type_name(header.type),
+                      header.w,
+                      header.h,
+                      header.nchanns,
+                      header.fileSize,
+                      carrier.info.capacity,
+                      carrier.info.capacity64);
+
+        out.append(carrier.path).append(fields);
+    }
+
+    if (!report.write(out.data(), out.size()) || !report.flush()) {
+        return 1;
+    }
+
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,74 @@
+/* capacity.hpp -- v1.0
+   Payload capacity of carrier images, read from their file headers alone */
+
+#pragma once
+
+#include "image.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace steg {
+    // Fwd. decl.
+    class OutputStream;
+
+    //! @bag CarrierInfo
+    struct CarrierInfo {
+        Image::Header header;
+
+        // Largest payload in bytes, as is and base64 encoded
+        std::size_t capacity = 0;
+        std::size_t capacity64 = 0;
+    };
+
+    //! @bag Carrier
+    struct Carrier {
+        std::string path;
+        CarrierInfo info;
+    };
+
+    //! Largest payload an image holds: one bit per pixel, once encrypted
+    //! and padded to the cipher block size (and base64 encoded)
+    //! @param pixels width x height of the image
+    //! @param b64 the encrypted payload is base64 encoded
+    //! @return payload size in bytes
+    std::size_t payload_capacity(std::uint64_t pixels, bool b64);
+
+    //! Reads an image file's header and works out its capacity
+    //! @param path path/to/image/file
+    //! @param info[out] header and capacities
+    //! @return true if the file is a readable image
+    bool probe_carrier(const char* path, CarrierInfo& info);
+
+    //! Reads the header of an image file held in memory and works out its
+    //! capacity
+    //! @param data encoded image file content
+    //! @param size size of data
+    //! @param info[out] header and capacities
+    //! @return true if data is a readable image
+    bool probe_carrier(const unsigned char* data,
+                       std::size_t size,
+                       CarrierInfo& info);
+
+    //! Reads the headers of image files
+    //! Directories are scanned one level deep, skipping files that are not
+    //! images; headers are read in parallel
+    //! @param paths image files and directories
+    //! @param threads worker threads, 0 for one per available CPU
+    //! @param carriers[out] the readable images, in path order per directory
+    //! @return false if a named file was not a readable image
+    bool scan_carriers(const std::vector<std::string>& paths,
+                       unsigned threads,
+                       std::vector<Carrier>& carriers);
+
+    //! Reports the capacity of image files, see scan_carriers()
+    //! @param paths image files and directories
+    //! @param threads worker threads, 0 for one per available CPU
+    //! @param report receives one tab-separated "path type width height
+    //! channels file-size capacity capacity-base64" line per image
+    //! @return 0 if every named file was a readable image, 1 otherwise
+    int capacity_run(const std::vector<std::string>& paths,
+                     unsigned threads,
+                     OutputStream& report);
+} // namespace steg
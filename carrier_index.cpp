@@ -0,0 +1,214 @@
+/* carrier_index.cpp -- v1.0 */
+
+#include "carrier_index.hpp"
+#include "log.hpp"
+#include "stream.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <memory>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+    // File identification; the version changes with the record layout
+    constexpr char kMagic[8] = {'S', 'T', 'E', 'G', 'I', 'D', 'X', '\0'};
+    constexpr std::uint32_t kVersion = 1;
+
+    // @bag
+    struct FileHeader {
+        char magic[8];
+        std::uint32_t version;
+        // Tells a file written on a host of another byte order or ABI
+        std::uint32_t recordSize;
+        std::uint64_t count;
+        std::uint64_t stringsSize;
+    };
+
+    using Record = steg::CarrierIndex::Record;
+
+    static_assert(sizeof(FileHeader) == 32);
+    static_assert(sizeof(Record) == 48);
+} // namespace
+
+/*! Writes an index file.
+ */
+bool steg::CarrierIndex::build(const std::vector<Carrier>& carriers,
+                               const char* path)
+{
+    // Cheapest first; ties go to the smaller file, which is quicker to read
+    std::vector<const Carrier*> order;
+    order.reserve(carriers.size());
+    for (const Carrier& carrier: carriers) {
+        order.push_back(&carrier);
+    }
+
+    auto pixels = [](const Carrier* carrier) {
+        return static_cast<std::uint64_t>(carrier->info.header.w)
+               * carrier->info.header.h;
+    };
+
+    auto cheaper = [&pixels](const Carrier* a, const Carrier* b) {
+        if (pixels(a) != pixels(b)) {
+            return pixels(a) < pixels(b);
+        }
+
+        if (a->info.header.fileSize != b->info.header.fileSize) {
+            return a->info.header.fileSize < b->info.header.fileSize;
+        }
+
+        return a->path < b->path;
+    };
+
+    std::sort(order.begin(), order.end(), cheaper);
+
+    std::vector<Record> records;
+    std::string strings;
+    records.reserve(order.size());
+
+    for (const Carrier* carrier: order) {
+        const Image::Header& header = carrier->info.header;
+        if (strings.size() + carrier->path.size() >= UINT32_MAX) {
+            Log::error("Carrier index too large", path);
+            return false;
+        }
+
+        Record& record = records.emplace_back();
+        record.pixels = pixels(carrier);
+        record.fileSize = header.fileSize;
+        record.capacity = carrier->info.capacity;
+        record.capacity64 = carrier->info.capacity64;
+        record.w = header.w;
+        record.h = header.h;
+        record.path = static_cast<std::uint32_t>(strings.size());
+        record.nchanns = static_cast<std::uint8_t>(header.nchanns);
+        record.type = static_cast<std::uint8_t>(header.type);
+
+        strings.append(carrier->path).push_back('\0');
+    }
+
+    FileHeader fileHeader = {};
+    std::memcpy(fileHeader.magic, kMagic, sizeof(kMagic));
+    fileHeader.version = kVersion;
+    fileHeader.recordSize = sizeof(Record);
+    fileHeader.count = records.size();
+    fileHeader.stringsSize = strings.size();
+
+    // Written aside and renamed over, so readers never see half a file
+    const std::string tmp = std::string(path) + ".tmp";
+
+    OutputStream out;
+    if (!out.open(tmp.c_str())) {
+        Log::error("Unable to create", tmp.c_str());
+        return false;
+    }
+
+    bool ret = out.write(reinterpret_cast<const char*>(&fileHeader),
+                         sizeof(fileHeader))
+               && out.write(reinterpret_cast<const char*>(records.data()),
+                            records.size() * sizeof(Record))
+               && out.write(strings.data(), strings.size());
+
+    ret = out.close() && ret;
+    if (!ret || std::rename(tmp.c_str(), path) != 0) {
+        Log::error("Unable to write carrier index", path);
+        std::remove(tmp.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+/*! Maps an index file.
+ */
+steg::CarrierIndex* steg::CarrierIndex::open(const char* path)
+{
+    const int fd = ::open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        Log::error("Unable to open carrier index", path);
+        return nullptr;
+    }
+
+    struct stat st = {};
+    void* map = MAP_FAILED;
+    if (::fstat(fd, &st) == 0
+        && static_cast<std::size_t>(st.st_size) >= sizeof(FileHeader)) {
+        map = ::mmap(nullptr,
+                     static_cast<std::size_t>(st.st_size),
+                     PROT_READ,
+                     MAP_SHARED,
+                     fd,
+                     0);
+    }
+
+    ::close(fd);
+    if (map == MAP_FAILED) {
+        Log::error("Unable to map carrier index", path);
+        return nullptr;
+    }
+
+    std::unique_ptr<CarrierIndex> index(new CarrierIndex);
+    index->map_ = map;
+    index->mapSize_ = static_cast<std::size_t>(st.st_size);
+
+    const auto* base = static_cast<const char*>(map);
+    const auto* header = reinterpret_cast<const FileHeader*>(base);
+
+    // Everything a lookup touches must lie within the file
+    const std::size_t room = index->mapSize_ - sizeof(FileHeader);
+    bool ok = std::memcmp(header->magic, kMagic, sizeof(kMagic)) == 0
+              && header->version == kVersion
+              && header->recordSize == sizeof(Record)
+              && header->count <= room / sizeof(Record)
+              && header->stringsSize
+                     == room - (header->count * sizeof(Record));
+
+    if (ok) {
+        index->count_ = header->count;
+        index->records_
+            = reinterpret_cast<const Record*>(base + sizeof(FileHeader));
+        index->strings_
+            = reinterpret_cast<const char*>(index->records_ + index->count_);
+
+        const std::size_t stringsSize = header->stringsSize;
+        ok = stringsSize == 0 || index->strings_[stringsSize - 1] == '\0';
+        for (const Record& record: *index) {
+            ok = ok && record.path < stringsSize;
+        }
+    }
+
+    if (!ok) {
+        Log::error("Malformed carrier index", path);
+        return nullptr;
+    }
+
+    // Lookups hop around the records
+    ::madvise(map, index->mapSize_, MADV_RANDOM);
+    return index.release();
+}
+
+steg::CarrierIndex::~CarrierIndex()
+{
+    if (map_ != nullptr) {
+        ::munmap(map_, mapSize_);
+    }
+}
+
+/*! Finds the cheapest carrier that holds a payload.
+ */
+const steg::CarrierIndex::Record* steg::CarrierIndex::find(
+    const std::size_t size,
+    const bool b64) const
+{
+    // Capacity grows with the pixel count the records are sorted by
+    auto tooSmall = [size, b64](const Record& record) {
+        return (b64 ? record.capacity64 : record.capacity) < size;
+    };
+
+    const Record* found = std::partition_point(begin(), end(), tooSmall);
+    return found != end() ? found : nullptr;
+}
@@ -0,0 +1,102 @@
+/* carrier_index.hpp -- v1.0
+   Persistent, memory-mapped index of carrier images for picking the
+   cheapest carrier a payload fits in
+
+   The file is a header, an array of fixed-size records sorted by pixel
+   count, then the NUL-terminated paths the records point to, all in host
+   byte order. Since capacity grows with the pixel count, the first record
+   whose capacity fits a payload is also the cheapest one to decode and
+   re-encode, found by binary search. */
+
+#pragma once
+
+#include "capacity.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace steg {
+    //! @class CarrierIndex
+    //! Read-only view of an index file; lookups may run from any number of
+    //! threads at once
+    class CarrierIndex {
+    public:
+        //! @bag Record
+        //! One carrier, as stored in the file
+        struct Record {
+            std::uint64_t pixels;
+            std::uint64_t fileSize;
+            std::uint64_t capacity;
+            std::uint64_t capacity64;
+            std::uint32_t w;
+            std::uint32_t h;
+
+            // Offset of the path in the string table
+            std::uint32_t path;
+
+            std::uint8_t nchanns;
+            std::uint8_t type;
+            std::uint8_t reserved[2];
+        };
+
+        //! Writes an index file, replacing any previous one atomically
+        //! @param carriers probed images, in any order
+        //! @param path path/to/index
+        //! @return true on success
+        static bool build(const std::vector<Carrier>& carriers,
+                          const char* path);
+
+        //! Factory method, maps an index file
+        //! @param path path/to/index
+        //! @return index, nullptr if the file is missing or malformed
+        static CarrierIndex* open(const char* path);
+
+        //! Dtor. Unmaps the file
+        ~CarrierIndex();
+
+        // Non-copyable object
+        CarrierIndex(const CarrierIndex&) = delete;
+        CarrierIndex& operator=(const CarrierIndex&) = delete;
+
+        //! Finds the carrier with the fewest pixels that holds a payload;
+        //! O(log n)
+        //! @param size payload size in bytes
+        //! @param b64 the encrypted payload will be base64 encoded
+        //! @return record, nullptr if no carrier is large enough
+        const Record* find(std::size_t size, bool b64) const;
+
+        //! @return path of a record's image file
+        const char* path(const Record& record) const
+        {
+            return strings_ + record.path;
+        }
+
+        //! @return number of carriers
+        std::size_t size() const
+        {
+            return count_;
+        }
+
+        //! @return records, sorted by pixel count
+        const Record* begin() const
+        {
+            return records_;
+        }
+
+        const Record* end() const
+        {
+            return records_ + count_;
+        }
+    private:
+        // Ctor. Private, use factory method open() instead
+        CarrierIndex() = default;
+
+        // Mapped file
+        void* map_ = nullptr;
+        std::size_t mapSize_ = 0;
+
+        const Record* records_ = nullptr;
+        std::size_t count_ = 0;
+        const char* strings_ = nullptr;
+    };
+} // namespace steg
@@ -0,0 +1,107 @@
+/* channel.hpp -- v1.0
+   Bounded blocking queue used to hand work between threads */
+
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <utility>
+
+namespace steg {
+    //! @class Channel
+    //! Multi-producer, multi-consumer FIFO; producers block while it is
+    //! full, consumers block while it is empty
+    template <typename T>
+    class Channel {
+    public:
+        //! Ctor.
+        //! @param capacity maximum number of queued items
+        explicit Channel(std::size_t capacity)
+            : capacity_(capacity == 0 ? 1 : capacity)
+        {}
+
+        //! Queues an item, waiting for room
+        //! @return false if the channel was closed
+        bool push(T&& value)
+        {
+            std::unique_lock lock(mutex_);
+            notFull_.wait(lock, [this] {
+                return closed_ || items_.size() < capacity_;
+            });
+
+            if (closed_) {
+                return false;
+            }
+
+            items_.push_back(std::move(value));
+            lock.unlock();
+
+            notEmpty_.notify_one();
+            return true;
+        }
+
+        //! Takes the oldest item, waiting for one
+        //! @return false once the channel is closed and drained
+        bool pop(T& value)
+        {
+            std::unique_lock lock(mutex_);
+            notEmpty_.wait(lock, [this] {
+                return closed_ || !items_.empty();
+            });
+
+            return take(lock, value);
+        }
+
+        //! Takes the oldest item if there is one
+        //! @return false if the channel is empty
+        bool try_pop(T& value)
+        {
+            std::unique_lock lock(mutex_);
+            return take(lock, value);
+        }
+
+        //! Wakes everyone up; pending items can still be popped
+        void close()
+        {
+            {
+                std::lock_guard lock(mutex_);
+                closed_ = true;
+            }
+
+            notEmpty_.notify_all();
+            notFull_.notify_all();
+        }
+
+        //! @return number of queued items
+        std::size_t size() const
+        {
+            std::lock_guard lock(mutex_);
+            return items_.size();
+        }
+    private:
+        // Helper: pops under lock
+        bool take(std::unique_lock<std::mutex>& lock, T& value)
+        {
+            if (items_.empty()) {
+                return false;
+            }
+
+            value = std::move(items_.front());
+            items_.pop_front();
+            lock.unlock();
+
+            notFull_.notify_one();
+            return true;
+        }
+
+        mutable std::mutex mutex_;
+        std::condition_variable notEmpty_;
+        std::condition_variable notFull_;
+
+        std::deque<T> items_;
+        std::size_t capacity_ = 1;
+        bool closed_ = false;
+    };
+} // namespace steg
@@ -6,11 +6,18 @@
 #include <cstdint>
 
 namespace steg {
+    //! Block cipher mode of operation
+    //! kCbc chains every block to the one before it; kCtr encrypts a counter
+    //! per block, so any block can be decrypted on its own
+    enum class CipherMode : std::uint8_t { kCbc, kCtr };
+
     //! @class cipher
     struct Cipher {
         // Handle to cipher
         void* hd = nullptr;
         // Digest length
         std::size_t length = 0;
+        // Mode of operation
+        CipherMode mode = CipherMode::kCbc;
     };
 } // namespace steg
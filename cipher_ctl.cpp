@@ -2,31 +2,50 @@
 
 #include "cipher_ctl.hpp"
 #include "cipher.hpp"
-#include "error.hpp"
+#include "log.hpp"
+#include "stats.hpp"
+#include <cstring>
 #include <gcrypt.h>
 
 namespace {
     // Helper
     inline void log(unsigned ret)
     {
-        (steg::Error::get())
-            ->log("Error: ", gcry_strsource(ret), ", ", gcry_strerror(ret));
+        steg::Log::error(gcry_strsource(ret), ", ", gcry_strerror(ret));
+    }
+
+    // Helper: sets the IV in kCbc mode, or the initial counter in kCtr mode
+    unsigned set_start(gcry_cipher_hd_t hd,
+                       const char* initvec,
+                       const steg::Cipher& cph)
+    {
+        return cph.mode == steg::CipherMode::kCtr
+                   ? gcry_cipher_setctr(hd, initvec, cph.length)
+                   : gcry_cipher_setiv(hd, initvec, cph.length);
     }
 } // namespace
 
 /*! Initializes cipher
  */
 struct steg::Cipher* steg::cipher_init(const char* const key,
-                                       const char* const initvec)
+                                       const char* const initvec,
+                                       const CipherMode mode)
 {
+    // Initializes the library, once; must happen before threads use it
+    static const char* const kVersion = gcry_check_version(nullptr);
+    static_cast<void>(kVersion);
+
+    StageTimer timer(Stage::kCipherInit);
+
     gcry_cipher_hd_t hd;
     std::size_t keylen = gcry_cipher_get_algo_keylen(GCRY_CIPHER_AES128);
     std::size_t blklen = gcry_cipher_get_algo_blklen(GCRY_CIPHER_AES128);
 
     // Create a handle for algorithm ALGO to be used in MODE.  FLAGS may
     // be given as an bitwise OR of the gcry_cipher_flags values.
-    unsigned ret
-        = gcry_cipher_open(&hd, GCRY_CIPHER_AES128, GCRY_CIPHER_MODE_CBC, 0);
+    const int algoMode = mode == CipherMode::kCtr ? GCRY_CIPHER_MODE_CTR
+                                                  : GCRY_CIPHER_MODE_CBC;
+    unsigned ret = gcry_cipher_open(&hd, GCRY_CIPHER_AES128, algoMode, 0);
     if (ret != 0) {
         log(ret);
         return nullptr;
@@ -41,17 +60,73 @@ struct steg::Cipher* steg::cipher_init(const char* const key,
         return nullptr;
     }
 
-    ret = gcry_cipher_setiv(hd, initvec, blklen);
+    const Cipher cph = {
+        .hd = hd,
+        .length = blklen, // AES block size in bytes
+        .mode = mode,
+    };
+
+    ret = set_start(hd, initvec, cph);
     if (ret != 0) {
         gcry_cipher_close(hd);
         log(ret);
         return nullptr;
     }
 
-    return new Cipher({
-        .hd = hd,
-        .length = blklen // AES block size in bytes
-    });
+    return new Cipher(cph);
+}
+
+/*! Rewinds cipher for reuse
+ */
+bool steg::cipher_reset(steg::Cipher& cph, const char* const initvec)
+{
+    auto* hd = static_cast<gcry_cipher_hd_t>(cph.hd);
+
+    // Keeps the key schedule, drops the chaining state
+    unsigned ret = gcry_cipher_reset(hd);
+    if (ret == 0) {
+        ret = set_start(hd, initvec, cph);
+    }
+
+    if (ret != 0) {
+        log(ret);
+        return false;
+    }
+
+    return true;
+}
+
+/*! Moves a counter mode cipher to the start of a block
+ */
+bool steg::cipher_seek(steg::Cipher& cph,
+                       const char* const initvec,
+                       std::uint64_t block)
+{
+    auto* hd = static_cast<gcry_cipher_hd_t>(cph.hd);
+
+    // The counter is a big-endian integer that starts at the IV and goes up
+    // by one per block
+    unsigned char counter[32] = {};
+    std::memcpy(counter, initvec, cph.length);
+
+    for (std::size_t i = cph.length; i != 0 && block != 0; --i) {
+        const unsigned sum
+            = counter[i - 1] + static_cast<unsigned>(block & 0xff);
+        counter[i - 1] = static_cast<unsigned char>(sum);
+        block = (block >> 8) + (sum >> 8);
+    }
+
+    unsigned ret = gcry_cipher_reset(hd);
+    if (ret == 0) {
+        ret = gcry_cipher_setctr(hd, counter, cph.length);
+    }
+
+    if (ret != 0) {
+        log(ret);
+        return false;
+    }
+
+    return true;
 }
 
 /*! Closes cipher and deallocates memory
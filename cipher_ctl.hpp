@@ -3,10 +3,10 @@
 
 #pragma once
 
-namespace steg {
-    // Fwd. decl.
-    struct Cipher;
+#include "cipher.hpp"
+#include <cstdint>
 
+namespace steg {
     /*! @brief Closes cipher and deallocates memory
      */
     void cipher_close(Cipher& cph);
@@ -15,8 +15,34 @@ namespace steg {
     //! @param key
     //!     AES key string
     //! @param initvec
-    //!     Initialization vector string
+    //!     Initialization vector string; the initial counter in kCtr mode
+    //! @param mode
+    //!     Mode of operation
     //! @return
     //!     On success, returns a non-null pointer to an initialized cipher
-    Cipher* cipher_init(const char* key, const char* initvec);
+    Cipher* cipher_init(const char* key,
+                        const char* initvec,
+                        CipherMode mode = CipherMode::kCbc);
+
+    //! Rewinds the cipher to its initial state so that it can be reused for
+    //! another message
+    //! @param cph
+    //!     Cipher returned by cipher_init()
+    //! @param initvec
+    //!     Initialization vector string
+    //! @return
+    //!     True on success
+    bool cipher_reset(Cipher& cph, const char* initvec);
+
+    //! Moves a kCtr cipher to the start of a block, so that decryption can
+    //! begin anywhere in a message
+    //! @param cph
+    //!     Cipher returned by cipher_init() in kCtr mode
+    //! @param initvec
+    //!     Initialization vector string
+    //! @param block
+    //!     Index of the block, counted from the start of the message
+    //! @return
+    //!     True on success
+    bool cipher_seek(Cipher& cph, const char* initvec, std::uint64_t block);
 } // namespace steg
@@ -0,0 +1,300 @@
+/* context.cpp -- v1.0 */
+
+#include "context.hpp"
+#include "allocator.hpp"
+#include "block_decoder.hpp"
+#include "block_encoder.hpp"
+#include "metrics.hpp"
+#include "seekable.hpp"
+#include "stream.hpp"
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace {
+    //! @class Pool
+    //! Idle ciphers of one mode; a miss creates a new one, so the pool grows
+    //! to the number of requests served concurrently
+    template <typename T>
+    class Pool {
+    public:
+        //! Takes an idle cipher or creates one
+        //! @return cipher, nullptr on error
+        std::unique_ptr<T> acquire(const char* key, const char* vec)
+        {
+            {
+                std::lock_guard lock(mutex_);
+                if (!idle_.empty()) {
+                    std::unique_ptr<T> coder = std::move(idle_.back());
+                    idle_.pop_back();
+
+                    ++hits_;
+                    steg::Metrics::add(steg::Metric::kPoolHits);
+                    return coder;
+                }
+            }
+
+            ++misses_;
+            steg::Metrics::add(steg::Metric::kPoolMisses);
+            return std::unique_ptr<T>(T::create(key, vec));
+        }
+
+        //! Returns a cipher for reuse
+        void release(std::unique_ptr<T> coder)
+        {
+            std::lock_guard lock(mutex_);
+            idle_.push_back(std::move(coder));
+        }
+
+        std::size_t hits() const
+        {
+            return hits_;
+        }
+
+        std::size_t misses() const
+        {
+            return misses_;
+        }
+    private:
+        std::mutex mutex_;
+        std::vector<std::unique_ptr<T>> idle_;
+
+        std::atomic<std::size_t> hits_ = 0;
+        std::atomic<std::size_t> misses_ = 0;
+    };
+
+    // Helper: copies a key, zero-padded like steg::read_key()
+    std::unique_ptr<char[]> copy_key(const char* key)
+    {
+        std::unique_ptr<char[]> copy(new char[steg::kMinKeySize]);
+        std::memcpy(copy.get(), key, steg::kMinKeySize);
+        return copy;
+    }
+} // namespace
+
+// @bag
+struct steg::Context::Pools {
+    using Talloc = CountingAllocator<ScratchAllocator>;
+
+    Pool<BlockEncoder<false, Talloc>> encoders;
+    Pool<BlockEncoder<true, Talloc>> encoders64;
+    Pool<BlockDecoder<false, Talloc>> decoders;
+    Pool<BlockDecoder<true, Talloc>> decoders64;
+    Pool<Seekable> seekables;
+};
+
+namespace {
+    // Helper: runs fn on a pooled cipher
+    template <typename T, typename Tfunc>
+    const char* with(Pool<T>& pool, const char* key, const char* vec, Tfunc fn)
+    {
+        std::unique_ptr<T> coder = pool.acquire(key, vec);
+        if (coder == nullptr) {
+            return "cipher-failed";
+        }
+
+        const char* status = fn(*coder);
+        pool.release(std::move(coder));
+        return status;
+    }
+} // namespace
+
+/*! Creates a context, setting up one cipher per mode.
+ */
+steg::Context* steg::Context::create(const char* const key,
+                                     const char* const initvec)
+{
+    std::unique_ptr<Context> ctx(new Context);
+    ctx->pools_ = std::make_unique<Pools>();
+    ctx->key_ = copy_key(key);
+    ctx->vec_ = copy_key(initvec);
+
+    // Warm each pool, on this thread, before gcrypt is used concurrently;
+    // this also rejects bad keys up front
+    auto warm = [&ctx](auto& pool) {
+        auto coder = pool.acquire(ctx->key_.get(), ctx->vec_.get());
+        if (coder == nullptr) {
+            return false;
+        }
+
+        pool.release(std::move(coder));
+        return true;
+    };
+
+    Pools& pools = *ctx->pools_;
+    if (!warm(pools.encoders) || !warm(pools.encoders64)
+        || !warm(pools.decoders) || !warm(pools.decoders64)
+        || !warm(pools.seekables)) {
+        return nullptr;
+    }
+
+    return ctx.release();
+}
+
+steg::Context::~Context() = default;
+
+/*! Encrypts a payload into a loaded carrier.
+ */
+const char* steg::Context::encode(Image& image,
+                                  const char* const payload,
+                                  const std::size_t size,
+                                  const Image::ImageType type,
+                                  const bool b64,
+                                  IoBuffer& out,
+                                  JobTimes& times)
+{
+    const char* vec = vec_.get();
+    auto fn = [&](auto& encoder) {
+        return encode_job(encoder, vec, image, payload, size, type, out, times);
+    };
+
+    return b64 ? with(pools_->encoders64, key_.get(), vec, fn)
+               : with(pools_->encoders, key_.get(), vec, fn);
+}
+
+/*! Encrypts a payload into a loaded carrier, without encoding the image.
+ */
+const char* steg::Context::embed(Image& image,
+                                 const char* const payload,
+                                 const std::size_t size,
+                                 const bool b64,
+                                 JobTimes& times)
+{
+    const char* vec = vec_.get();
+    auto fn = [&](auto& encoder) {
+        return embed_job(encoder, vec, image, payload, size, times);
+    };
+
+    return b64 ? with(pools_->encoders64, key_.get(), vec, fn)
+               : with(pools_->encoders, key_.get(), vec, fn);
+}
+
+/*! Extracts and decrypts the payload of a loaded carrier.
+ */
+const char* steg::Context::decode(Image& image,
+                                  const bool b64,
+                                  IoBuffer& out,
+                                  JobTimes& times)
+{
+    const char* vec = vec_.get();
+    auto fn = [&](auto& decoder) {
+        return decode_job(decoder, vec, image, out, times);
+    };
+
+    return b64 ? with(pools_->decoders64, key_.get(), vec, fn)
+               : with(pools_->decoders, key_.get(), vec, fn);
+}
+
+/*! Encrypts a payload into a loaded carrier in counter mode.
+ */
+const char* steg::Context::encode_seekable(Image& image,
+                                           const char* const payload,
+                                           const std::size_t size,
+                                           const Image::ImageType type,
+                                           const bool b64,
+                                           IoBuffer& out,
+                                           JobTimes& times)
+{
+    using Clock = std::chrono::steady_clock;
+    using Ms = std::chrono::duration<double, std::milli>;
+
+    const Clock::time_point t0 = Clock::now();
+
+    auto fn = [&](Seekable& seekable) {
+        return seekable.embed(image, payload, size, b64);
+    };
+
+    const char* status = with(pools_->seekables, key_.get(), vec_.get(), fn);
+    if (std::strcmp(status, "ok") != 0) {
+        return status;
+    }
+
+    times.codeMs = Ms(Clock::now() - t0).count();
+    return save_job(image, type, out, times);
+}
+
+/*! Extracts and decrypts a byte range of a counter mode payload.
+ */
+const char* steg::Context::decode_range(const Image& image,
+                                        const std::uint64_t offset,
+                                        const std::uint64_t size,
+                                        const bool b64,
+                                        IoBuffer& out,
+                                        JobTimes& times)
+{
+    using Clock = std::chrono::steady_clock;
+    using Ms = std::chrono::duration<double, std::milli>;
+
+    const Clock::time_point t0 = Clock::now();
+
+    auto fn = [&](Seekable& seekable) {
+        return seekable.extract(image, offset, size, b64, out);
+    };
+
+    const char* status = with(pools_->seekables, key_.get(), vec_.get(), fn);
+    times.codeMs = Ms(Clock::now() - t0).count();
+    return status;
+}
+
+/*! Encrypts a payload to memory.
+ */
+const char* steg::Context::encrypt(const char* const payload,
+                                   const std::size_t size,
+                                   const bool b64,
+                                   IoBuffer& out)
+{
+    const char* vec = vec_.get();
+    auto fn = [&](auto& encoder) {
+        BufferInputStream input(payload, size);
+        BufferOutputStream output;
+        if (!encoder.reset(vec) || !encoder.run(input, output)) {
+            return "encode-failed";
+        }
+
+        out = output.release();
+        return "ok";
+    };
+
+    return b64 ? with(pools_->encoders64, key_.get(), vec, fn)
+               : with(pools_->encoders, key_.get(), vec, fn);
+}
+
+/*! Decrypts a payload produced by encrypt().
+ */
+const char* steg::Context::decrypt(const char* const data,
+                                   const std::size_t size,
+                                   const bool b64,
+                                   IoBuffer& out)
+{
+    const char* vec = vec_.get();
+    auto fn = [&](auto& decoder) {
+        BufferInputStream input(data, size);
+        BufferOutputStream output;
+        if (!decoder.reset(vec) || !decoder.run(input, output)) {
+            return "decode-failed";
+        }
+
+        out = output.release();
+        return "ok";
+    };
+
+    return b64 ? with(pools_->decoders64, key_.get(), vec, fn)
+               : with(pools_->decoders, key_.get(), vec, fn);
+}
+
+std::size_t steg::Context::hits() const
+{
+    return pools_->encoders.hits() + pools_->encoders64.hits()
+           + pools_->decoders.hits() + pools_->decoders64.hits()
+           + pools_->seekables.hits();
+}
+
+std::size_t steg::Context::misses() const
+{
+    return pools_->encoders.misses() + pools_->encoders64.misses()
+           + pools_->decoders.misses() + pools_->decoders64.misses()
+           + pools_->seekables.misses();
+}
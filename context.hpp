@@ -0,0 +1,147 @@
+/* context.hpp -- v1.0
+   A key with its pooled ciphers; encodes and decodes loaded images from any
+   number of threads at once */
+
+#pragma once
+
+#include "async_io.hpp"
+#include "image.hpp"
+#include "job.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace steg {
+    //! @class Context
+    class Context {
+    public:
+        //! Factory method, returns a Context
+        //! @param key AES key, kMinKeySize bytes, copied
+        //! @param initvec Initialization vector, kMinKeySize bytes, copied
+        //! @return nullptr if the cipher cannot be set up with this key
+        static Context* create(const char* key, const char* initvec);
+
+        //! Dtor.
+        ~Context();
+
+        // Non-copyable object
+        Context(const Context&) = delete;
+        Context& operator=(const Context&) = delete;
+
+        //! Encrypts a payload into a loaded carrier and encodes the result
+        //! @param image loaded carrier, modified in place
+        //! @param payload plain message
+        //! @param size size of payload
+        //! @param type output image file type
+        //! @param b64 base64 encode the encrypted payload
+        //! @param out[out] encoded image file content
+        //! @param times[out] stage timings
+        //! @return "ok", or the name of the stage that failed
+        const char* encode(Image& image,
+                           const char* payload,
+                           std::size_t size,
+                           Image::ImageType type,
+                           bool b64,
+                           IoBuffer& out,
+                           JobTimes& times);
+
+        //! Encrypts a payload into a loaded carrier, leaving it to the
+        //! caller to encode the image
+        //! @param image loaded carrier, modified in place
+        //! @param payload plain message
+        //! @param size size of payload
+        //! @param b64 base64 encode the encrypted payload
+        //! @param times[out] stage timings
+        //! @return "ok", or the name of the stage that failed
+        const char* embed(Image& image,
+                          const char* payload,
+                          std::size_t size,
+                          bool b64,
+                          JobTimes& times);
+
+        //! Extracts and decrypts the payload of a loaded carrier
+        //! @param image loaded carrier
+        //! @param b64 the encrypted payload is base64 encoded
+        //! @param out[out] decoded payload
+        //! @param times[out] stage timings
+        //! @return "ok", or the name of the stage that failed
+        const char* decode(Image& image,
+                           bool b64,
+                           IoBuffer& out,
+                           JobTimes& times);
+
+        //! Encrypts a payload into a loaded carrier in counter mode, behind
+        //! a length header, and encodes the result; see seekable.hpp
+        //! @param image loaded carrier, modified in place
+        //! @param payload plain message
+        //! @param size size of payload
+        //! @param type output image file type
+        //! @param b64 base64 encode the encrypted payload
+        //! @param out[out] encoded image file content
+        //! @param times[out] stage timings
+        //! @return "ok", or the name of the stage that failed
+        const char* encode_seekable(Image& image,
+                                    const char* payload,
+                                    std::size_t size,
+                                    Image::ImageType type,
+                                    bool b64,
+                                    IoBuffer& out,
+                                    JobTimes& times);
+
+        //! Extracts and decrypts bytes [offset, offset + size) of a payload
+        //! embedded by encode_seekable(), touching only the pixels and
+        //! cipher blocks that hold them
+        //! @param image loaded carrier
+        //! @param offset first payload byte
+        //! @param size number of bytes, clamped to the payload
+        //! @param b64 the encrypted payload is base64 encoded
+        //! @param out[out] decoded bytes
+        //! @param times[out] stage timings
+        //! @return "ok", or the name of the stage that failed
+        const char* decode_range(const Image& image,
+                                 std::uint64_t offset,
+                                 std::uint64_t size,
+                                 bool b64,
+                                 IoBuffer& out,
+                                 JobTimes& times);
+
+        //! Encrypts a payload to memory, as it would be embedded
+        //! @param payload plain message
+        //! @param size size of payload
+        //! @param b64 base64 encode the encrypted payload
+        //! @param out[out] encrypted payload
+        //! @return "ok", or the name of the stage that failed
+        const char* encrypt(const char* payload,
+                            std::size_t size,
+                            bool b64,
+                            IoBuffer& out);
+
+        //! Decrypts a payload produced by encrypt()
+        //! @param data encrypted payload
+        //! @param size size of data
+        //! @param b64 the encrypted payload is base64 encoded
+        //! @param out[out] decoded payload
+        //! @return "ok", or the name of the stage that failed
+        const char* decrypt(const char* data,
+                            std::size_t size,
+                            bool b64,
+                            IoBuffer& out);
+
+        //! @return requests served by an idle pooled cipher
+        std::size_t hits() const;
+
+        //! @return requests that had to set up a new cipher
+        std::size_t misses() const;
+    private:
+        // Ctor. Private, use factory method create() instead
+        Context() = default;
+
+        // Idle ciphers, one pool per mode
+        struct Pools;
+        std::unique_ptr<Pools> pools_;
+
+        // Cryptographic vars, for ciphers created on a pool miss
+        std::unique_ptr<char[]> key_;
+        std::unique_ptr<char[]> vec_;
+    };
+} // namespace steg
@@ -3,7 +3,8 @@
 #include "decoder.hpp"
 #include "cipher.hpp"
 #include "cipher_ctl.hpp"
-#include "error.hpp"
+#include "log.hpp"
+#include "stats.hpp"
 #include <cstddef>
 #include <gcrypt.h>
 
@@ -19,6 +20,8 @@ steg::Decoder::~Decoder()
  */
 bool steg::Decoder::decode(char* const data, const std::size_t size)
 {
+    StageTimer timer(Stage::kDecrypt, size);
+
     Cipher& cph = *cph_;
     // Do an in-place decryption
     unsigned ret = gcry_cipher_decrypt(
@@ -30,7 +33,9 @@ bool steg::Decoder::decode(char* const data, const std::size_t size)
     const char* const strerror = gcry_strerror(ret);
     const char* const strsource = gcry_strsource(ret);
     // Report error
-    (Error::get())->log("Error: ", strsource, ", ", strerror);
+    Log::error("Decryption failed",
+               log_field("source", strsource),
+               log_field("reason", strerror));
     return false;
 }
 
@@ -41,6 +46,8 @@ bool steg::Decoder::decode(const char* const data,
                            char* const out,
                            const std::size_t outSize)
 {
+    StageTimer timer(Stage::kDecrypt, size);
+
     Cipher& cph = *cph_;
     // Do an in-place decryption
     unsigned ret = gcry_cipher_decrypt(
@@ -52,6 +59,15 @@ bool steg::Decoder::decode(const char* const data,
     const char* const strerror = gcry_strerror(ret);
     const char* const strsource = gcry_strsource(ret);
     // Report error
-    (Error::get())->log("Error: ", strsource, ", ", strerror);
+    Log::error("Decryption failed",
+               log_field("source", strsource),
+               log_field("reason", strerror));
     return false;
 }
+
+/*! Restarts the cipher from the initialization vector
+ */
+bool steg::Decoder::reset(const char* const initvec)
+{
+    return cipher_reset(*cph_, initvec);
+}
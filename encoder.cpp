@@ -3,7 +3,8 @@
 #include "encoder.hpp"
 #include "cipher.hpp"
 #include "cipher_ctl.hpp"
-#include "error.hpp"
+#include "log.hpp"
+#include "stats.hpp"
 #include <cstddef>
 #include <gcrypt.h>
 
@@ -19,6 +20,8 @@ steg::Encoder::~Encoder()
  */
 bool steg::Encoder::encode(char* const data, std::size_t size)
 {
+    StageTimer timer(Stage::kEncrypt, size);
+
     Cipher& cph = *cph_;
     // Do an in-place encryption
     unsigned ret = gcry_cipher_encrypt(
@@ -30,7 +33,9 @@ bool steg::Encoder::encode(char* const data, std::size_t size)
     const char* const strerror = gcry_strerror(ret);
     const char* const strsource = gcry_strsource(ret);
     // Report error
-    (Error::get())->log("Error: ", strsource, ", ", strerror);
+    Log::error("Encryption failed",
+               log_field("source", strsource),
+               log_field("reason", strerror));
     return false;
 }
 
@@ -41,6 +46,8 @@ bool steg::Encoder::encode(const char* data,
                            char* const out,
                            std::size_t outSize)
 {
+    StageTimer timer(Stage::kEncrypt, size);
+
     Cipher& cph = *cph_;
     // Do an in-place encryption
     unsigned ret = gcry_cipher_encrypt(
@@ -52,6 +59,15 @@ bool steg::Encoder::encode(const char* data,
     const char* const strerror = gcry_strerror(ret);
     const char* const strsource = gcry_strsource(ret);
     // Report error
-    (Error::get())->log("Error: ", strsource, ", ", strerror);
+    Log::error("Encryption failed",
+               log_field("source", strsource),
+               log_field("reason", strerror));
     return false;
 }
+
+/*! Restarts the cipher from the initialization vector
+ */
+bool steg::Encoder::reset(const char* const initvec)
+{
+    return cipher_reset(*cph_, initvec);
+}
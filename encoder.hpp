@@ -43,6 +43,12 @@ namespace steg {
                     char* out,
                     std::size_t outSize);
 
+        //! Restarts the cipher from the initialization vector, so that the
+        //! next message is encoded independently of the previous one
+        //! @param initvec Initialization vector string
+        //! @return True on success, false otherwise
+        bool reset(const char* initvec);
+
         //! @return Encapsulated cipher
         Cipher* get()
         {
@@ -1,9 +1,314 @@
 /* image.cpp -- v1.0 */
 
 #include "image.hpp"
-#include "error.hpp"
+#include "log.hpp"
+#include "multiversion.hpp"
+#include "scheduler.hpp"
+#include "stats.hpp"
 #include "stb.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <climits>
+#include <cstdio>
 #include <cstring>
+#include <fcntl.h>
+#include <strings.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <type_traits>
+#include <unistd.h>
+
+namespace {
+    // Pixels per parallel piece of read() and write(); a multiple of 8, so
+    // pieces never share a message byte
+    constexpr std::size_t kPixelGrain = std::size_t{1} << 16;
+
+    // Helper: appends encoded image data to a std::vector
+    void append(void* context, void* data, int size)
+    {
+        auto* out = static_cast<std::vector<unsigned char>*>(context);
+        auto* ptr = static_cast<unsigned char*>(data);
+        out->insert(out->end(), ptr, ptr + size);
+    }
+
+    // Helper: stbi reader over a file descriptor
+    struct FdReader {
+        int fd = -1;
+        bool eof = false;
+
+        // stbi expects every read to be filled unless the input ends
+        static int read(void* user, char* data, int size)
+        {
+            auto* self = static_cast<FdReader*>(user);
+
+            int total = 0;
+            while (total != size) {
+                ssize_t n = ::read(
+                    self->fd, data + total, static_cast<size_t>(size - total));
+                if (n < 0 && errno == EINTR) {
+                    continue;
+                }
+
+                if (n <= 0) {
+                    self->eof = true;
+                    break;
+                }
+
+                total += static_cast<int>(n);
+            }
+
+            return total;
+        }
+
+        static void skip(void* user, int n)
+        {
+            auto* self = static_cast<FdReader*>(user);
+            if (::lseek(self->fd, n, SEEK_CUR) >= 0) {
+                return;
+            }
+
+            // Not seekable (pipe, socket), read past the bytes instead
+            char scratch[4096];
+            while (n > 0 && !self->eof) {
+                int size = n < static_cast<int>(sizeof(scratch))
+                               ? n
+                               : static_cast<int>(sizeof(scratch));
+                int got = read(user, scratch, size);
+                n -= got;
+            }
+        }
+
+        static int at_eof(void* user)
+        {
+            return static_cast<FdReader*>(user)->eof ? 1 : 0;
+        }
+    };
+
+    // Helper: reads an image header through stbi, without decoding pixels
+    bool probe_context(stbi__context& s, steg::Image::Header& header)
+    {
+        using enum steg::Image::ImageType;
+
+        // The type tests look at the first few bytes only and rewind, so run
+        // them before stbi__info_main(), which may read further
+        header.type = stbi__png_test(&s)   ? kPng
+                      : stbi__bmp_test(&s) ? kBmp
+                      : stbi__tga_test(&s) ? kTga
+                                           : kNil;
+
+        int w = 0;
+        int h = 0;
+        int nchanns = 0;
+        if (stbi__info_main(&s, &w, &h, &nchanns) == 0 || w <= 0 || h <= 0) {
+            return false;
+        }
+
+        header.w = static_cast<unsigned>(w);
+        header.h = static_cast<unsigned>(h);
+        header.nchanns = static_cast<unsigned>(nchanns);
+        return true;
+    }
+} // namespace
+
+namespace {
+    // Helper: calls fn with the channel count, a compile-time constant for
+    // the usual counts, so the kernels below get a fixed stride
+    template <typename Tfunc>
+    inline void with_stride(const unsigned nchanns, Tfunc fn)
+    {
+        switch (nchanns) {
+            case 1:
+                fn(std::integral_constant<std::size_t, 1>());
+                break;
+            case 3:
+                fn(std::integral_constant<std::size_t, 3>());
+                break;
+            case 4:
+                fn(std::integral_constant<std::size_t, 4>());
+                break;
+            default:
+                fn(static_cast<std::size_t>(nchanns));
+                break;
+        }
+    }
+
+    // Helper: embeds message bits in pixels [begin, end), and the
+    // terminator in those past the message; begin is a multiple of 8. The
+    // AVX2 and AVX-512 clones measure faster; the extraction kernels'
+    // clones did not, so those have none
+    STEG_TARGET_CLONES
+    void embed_pixels(unsigned char* data,
+                      const unsigned nchanns,
+                      const char* buff,
+                      const std::size_t bits,
+                      const std::size_t begin,
+                      const std::size_t end)
+    {
+        with_stride(nchanns, [=](const std::size_t stride) {
+            // A whole message byte, one bit per pixel, at a time; bits is a
+            // multiple of 8 too
+            const std::size_t mid = std::clamp(bits, begin, end);
+            for (std::size_t k = begin / 8; k != mid / 8; ++k) {
+                const auto byte = static_cast<unsigned char>(buff[k]);
+                unsigned char* pixel = data + (stride * k * 8);
+
+                for (unsigned bit = 0; bit != 8; ++bit) {
+                    // Clear the two lower-order bits and add the message bit
+                    unsigned char& value = pixel[stride * bit];
+                    value = static_cast<unsigned char>(
+                        (value & ~0x03) | ((byte >> bit) & 0x01));
+                }
+            }
+
+            // Past the message, "zero-out" remaining cells using 0x02 as
+            // terminating character
+            for (std::size_t i = mid; i != end; ++i) {
+                unsigned char& value = data[stride * i];
+                value = static_cast<unsigned char>((value & ~0x03) | 0x02);
+            }
+        });
+    }
+
+    // Helper: extracts message bits from pixels [begin, end) up to the
+    // first terminator; begin is a multiple of 8
+    // @return pixel of the terminator, end if there is none
+    std::size_t extract_pixels(const unsigned char* data,
+                               const unsigned nchanns,
+                               char* buff,
+                               const std::size_t begin,
+                               const std::size_t end)
+    {
+        std::size_t stop = end;
+        with_stride(nchanns, [=, &stop](const std::size_t stride) {
+            for (std::size_t i = begin; i != end; ++i) {
+                if ((data[stride * i] & 0x03) == 0x02) {
+                    stop = i;
+                    break;
+                }
+            }
+
+            // Whole bytes first, then the bits of the last partial one
+            const std::size_t whole = begin + ((stop - begin) / 8 * 8);
+            for (std::size_t k = begin / 8; k != whole / 8; ++k) {
+                const unsigned char* pixel = data + (stride * k * 8);
+
+                unsigned byte = 0;
+                for (unsigned bit = 0; bit != 8; ++bit) {
+                    byte |= (pixel[stride * bit] & 0x03u) << bit;
+                }
+
+                buff[k] = static_cast<char>(byte);
+            }
+
+            for (std::size_t i = whole; i != stop; ++i) {
+                const int bit = data[stride * i] & 0x03;
+                buff[i / 8] = static_cast<char>(buff[i / 8] | (bit << (i % 8)));
+            }
+        });
+
+        return stop;
+    }
+
+    // Helper: extracts message bytes [begin, end), counted from byte first
+    void extract_bytes(const unsigned char* data,
+                       const unsigned nchanns,
+                       const std::size_t first,
+                       char* buff,
+                       const std::size_t begin,
+                       const std::size_t end)
+    {
+        with_stride(nchanns, [=](const std::size_t stride) {
+            for (std::size_t k = begin; k != end; ++k) {
+                const unsigned char* pixel = data + (stride * (first + k) * 8);
+
+                unsigned byte = 0;
+                for (unsigned bit = 0; bit != 8; ++bit) {
+                    byte |= (pixel[stride * bit] & 0x01u) << bit;
+                }
+
+                buff[k] = static_cast<char>(byte);
+            }
+        });
+    }
+} // namespace
+
+/*! Parses an image file type name.
+ */
+steg::Image::ImageType steg::Image::parse_type(const char* name)
+{
+    using enum ImageType;
+
+    if (::strcasecmp(name, "bmp") == 0) {
+        return kBmp;
+    }
+
+    if (::strcasecmp(name, "tga") == 0) {
+        return kTga;
+    }
+
+    return kPng;
+}
+
+/*! Image file type name.
+ */
+const char* steg::Image::type_name(const ImageType type)
+{
+    switch (type) {
+        case ImageType::kPng:
+            return "png";
+        case ImageType::kBmp:
+            return "bmp";
+        case ImageType::kTga:
+            return "tga";
+        default:
+            return "other";
+    }
+}
+
+/*! Reads the header of an image file.
+ */
+bool steg::Image::probe(const char* path, Header& header)
+{
+    std::FILE* file = std::fopen(path, "rb");
+    if (file == nullptr) {
+        return false;
+    }
+
+    struct stat st = {};
+    if (::fstat(::fileno(file), &st) != 0 || !S_ISREG(st.st_mode)) {
+        std::fclose(file);
+        return false;
+    }
+
+    header = {};
+    header.fileSize = static_cast<std::uint64_t>(st.st_size);
+
+    stbi__context s;
+    stbi__start_file(&s, file);
+    const bool ret = probe_context(s, header);
+
+    std::fclose(file);
+    return ret;
+}
+
+/*! Reads the header of an image file held in memory.
+ */
+bool steg::Image::probe(const unsigned char* data,
+                        const std::size_t size,
+                        Header& header)
+{
+    if (size > INT_MAX) {
+        return false;
+    }
+
+    header = {};
+    header.fileSize = size;
+
+    stbi__context s;
+    stbi__start_mem(&s, data, static_cast<int>(size));
+    return probe_context(s, header);
+}
 
 steg::Image::~Image()
 {
@@ -53,10 +358,12 @@ bool steg::Image::save(const char* path, const ImageType type) const
 {
     // Just in case
     if (!path) {
-        (Error::get())->log("Error:", "Invalid save path");
+        Log::error("Invalid save path");
         return false;
     }
 
+    StageTimer timer(Stage::kSave, size());
+
     auto w = static_cast<int>(w_);
     auto h = static_cast<int>(h_);
     auto nchanns = static_cast<int>(nchanns_);
@@ -91,12 +398,72 @@ bool steg::Image::save(const char* path, const ImageType type) const
 
     bool success = write_ret != 0;
     if (!success) {
-        (Error::get())->log("Error:", "Unable to save image", path);
+        Log::error("Unable to save image", path);
     }
 
     return success;
 }
 
+/*! Encodes image to a sink.
+ */
+bool steg::Image::save(const ImageType type,
+                       const WriteFunc func,
+                       void* context) const
+{
+    StageTimer timer(Stage::kSave, size());
+
+    auto w = static_cast<int>(w_);
+    auto h = static_cast<int>(h_);
+    auto nchanns = static_cast<int>(nchanns_);
+
+    int write_ret = 0;
+    switch (type) {
+        case ImageType::kNil:
+        {
+            return false;
+        }
+
+        case ImageType::kPng:
+        {
+            int stride = nchanns * w;
+
+            write_ret = stbi_write_png_to_func(
+                func, context, w, h, nchanns, data_, stride);
+            break;
+        }
+
+        case ImageType::kBmp:
+        {
+            write_ret
+                = stbi_write_bmp_to_func(func, context, w, h, nchanns, data_);
+            break;
+        }
+
+        case ImageType::kTga:
+        {
+            write_ret
+                = stbi_write_tga_to_func(func, context, w, h, nchanns, data_);
+            break;
+        }
+    }
+
+    bool success = write_ret != 0;
+    if (!success) {
+        Log::error("Unable to encode image");
+    }
+
+    return success;
+}
+
+/*! Encodes image to memory.
+ */
+bool steg::Image::save(const ImageType type,
+                       std::vector<unsigned char>& out) const
+{
+    out.clear();
+    return save(type, append, &out);
+}
+
 /*! Loads image from file.
  */
 std::size_t steg::Image::open(const char* path)
@@ -110,27 +477,148 @@ std::size_t steg::Image::open(const char* path)
     int h = 0;
     int nchanns = 0;
 
+    StageTimer timer(Stage::kLoad);
+
     // Get the data
     unsigned char* data = stbi_load(path, &w, &h, &nchanns, 0);
     if (data == nullptr) {
         constexpr const char* kMessage = "Unable to load image";
-        return ((Error::get())->log("Error:", kMessage, path), 0);
+        return (Log::error(kMessage, path), 0);
+    }
+
+    const std::size_t ret = adopt(data, w, h, nchanns);
+    timer.bytes(ret);
+    return ret;
+}
+
+/*! Loads image from memory.
+ */
+std::size_t steg::Image::open(const unsigned char* buff, const std::size_t size)
+{
+    // Return if image already loaded
+    if (data_ != nullptr) {
+        return 0;
+    }
+
+    if (size > INT_MAX) {
+        constexpr const char* kMessage = "Image file is too large";
+        return (Log::error(kMessage), 0);
+    }
+
+    int w = 0;
+    int h = 0;
+    int nchanns = 0;
+
+    StageTimer timer(Stage::kLoad);
+
+    // Get the data
+    unsigned char* data = stbi_load_from_memory(
+        buff, static_cast<int>(size), &w, &h, &nchanns, 0);
+    if (data == nullptr) {
+        constexpr const char* kMessage = "Unable to load image from memory";
+        return (Log::error(kMessage), 0);
+    }
+
+    const std::size_t ret = adopt(data, w, h, nchanns);
+    timer.bytes(ret);
+    return ret;
+}
+
+/*! Loads image from a file descriptor.
+ */
+std::size_t steg::Image::open(const int fd)
+{
+    // Return if image already loaded
+    if (data_ != nullptr) {
+        return 0;
+    }
+
+    FdReader reader{.fd = fd};
+    const stbi_io_callbacks callbacks = {
+        .read = FdReader::read,
+        .skip = FdReader::skip,
+        .eof = FdReader::at_eof,
+    };
+
+    int w = 0;
+    int h = 0;
+    int nchanns = 0;
+
+    StageTimer timer(Stage::kLoad);
+
+    // Get the data
+    unsigned char* data
+        = stbi_load_from_callbacks(&callbacks, &reader, &w, &h, &nchanns, 0);
+    if (data == nullptr) {
+        constexpr const char* kMessage = "Unable to load image from stream";
+        return (Log::error(kMessage), 0);
+    }
+
+    const std::size_t ret = adopt(data, w, h, nchanns);
+    timer.bytes(ret);
+    return ret;
+}
+
+/*! Loads image from a mapped file.
+ */
+std::size_t steg::Image::map(const char* path)
+{
+    // Return if image already loaded
+    if (data_ != nullptr) {
+        return 0;
+    }
+
+    const int fd = ::open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        constexpr const char* kMessage = "Unable to load image";
+        return (Log::error(kMessage, path), 0);
     }
 
+    struct stat st = {};
+    void* map = MAP_FAILED;
+    if (::fstat(fd, &st) == 0 && st.st_size > 0) {
+        const auto size = static_cast<std::size_t>(st.st_size);
+        map = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+
+    ::close(fd);
+    if (map == MAP_FAILED) {
+        constexpr const char* kMessage = "Unable to map image";
+        return (Log::error(kMessage, path), 0);
+    }
+
+    // The decoder walks the file front to back
+    const auto size = static_cast<std::size_t>(st.st_size);
+    ::madvise(map, size, MADV_SEQUENTIAL);
+
+    std::size_t ret = open(static_cast<const unsigned char*>(map), size);
+    ::munmap(map, size);
+    return ret;
+}
+
+/*! Takes ownership of decoded pixels.
+ */
+std::size_t steg::Image::adopt(unsigned char* data,
+                               const int w,
+                               const int h,
+                               const int nchanns)
+{
     w_ = static_cast<unsigned>(w);
     h_ = static_cast<unsigned>(h);
     nchanns_ = static_cast<unsigned>(nchanns);
 
     data_ = data;
-    return (w_ * h_ * nchanns_);
+    return size();
 }
 
 /*! Reads back message from image.
  */
 std::size_t steg::Image::read(char* buff, const std::size_t buffSize) const
 {
+    StageTimer timer(Stage::kExtract);
+
     // Width x height
-    unsigned size = w_ * h_;
+    const std::size_t size = static_cast<std::size_t>(w_) * h_;
 
     // Zero-out buffer
     std::memset(buff, 0, buffSize);
@@ -141,74 +629,84 @@ std::size_t steg::Image::read(char* buff, const std::size_t buffSize) const
         constexpr const char* kMessage
             = "Output buffer is too small to accommodate "
               "message size, exiting";
-        return (Error::get())->log("Error:", kMessage), 0;
+        return Log::error(kMessage), 0;
     }
 
-    // Unapply steganography
-    std::size_t i = 0;
-    while (i != size) {
-        unsigned char r = data_[nchanns_ * i];
-        int bit = (r & 0x03);
-        // Check for end of message
-        if (bit == 0x02) {
-            break;
+    // First terminating pixel found so far
+    std::atomic<std::size_t> end = size;
+
+    // Unapply steganography, whole bytes per piece; pieces past the end of
+    // the message stop early
+    parallel_for(size, kPixelGrain, [&](std::size_t begin, std::size_t last) {
+        if (begin >= end.load(std::memory_order_relaxed)) {
+            return;
         }
 
-        *buff |= (bit << (i % 8));
-        if ((++i % 8) == 0) {
-            ++buff;
+        const std::size_t i
+            = extract_pixels(data_, nchanns_, buff, begin, last);
+
+        // Check for end of message
+        if (i != last) {
+            std::size_t found = end;
+            while (i < found && !end.compare_exchange_weak(found, i)) {
+            }
         }
-    }
+    });
 
-    // Terminate and return
-    *buff = 0;
+    // Terminate, dropping anything decoded past the end
+    const std::size_t i = end;
+    std::memset(buff + (i / 8), 0, buffSize - std::min(i / 8, buffSize));
+    timer.bytes(i / 8);
     return i / 8;
 }
 
+/*! Reads back part of the message from image.
+ */
+std::size_t steg::Image::read(char* buff,
+                              const std::size_t offset,
+                              std::size_t size) const
+{
+    StageTimer timer(Stage::kExtract, size);
+
+    // Whole message bytes the image holds
+    const std::size_t bytes = (static_cast<std::size_t>(w_) * h_) / 8;
+    if (offset >= bytes) {
+        return 0;
+    }
+
+    size = std::min(size, bytes - offset);
+
+    // Eight pixels per byte, from pixel offset * 8 on
+    const std::size_t grain = kPixelGrain / 8;
+    parallel_for(size, grain, [&](std::size_t begin, std::size_t end) {
+        extract_bytes(data_, nchanns_, offset, buff, begin, end);
+    });
+
+    return size;
+}
+
 /*! Writes message to image.
  */
 std::size_t steg::Image::write(const char* buff, std::size_t buffSize)
 {
+    StageTimer timer(Stage::kEmbed, buffSize);
+
     // Width x height
-    const std::size_t size = w_ * h_;
+    const std::size_t size = static_cast<std::size_t>(w_) * h_;
 
     // Ensure that file size is large enough to hold image
-    const char* ptr = buff;
     if ((buffSize * 8) > size) {
         constexpr const char* kMessage
             = "Source image is too small to encode entire "
               "message, exiting";
-        return ((Error::get())->log("Error:", kMessage), 0);
-    }
-
-    // Apply steganography
-    // Insert message
-    std::size_t i = 0;
-    while (i != size && (static_cast<std::size_t>(ptr - buff) != buffSize)) {
-        std::size_t j = nchanns_ * i;
-
-        // Encode single bit
-        unsigned char value = data_[j];
-        unsigned char bit
-            = (static_cast<unsigned char>(*ptr >> (i % 8)) & 0x01);
-
-        // Clear the two lower-order bits
-        // and add low order bit
-        data_[j] = (value & ~0x03) | bit;
-
-        // When done encoding all bits, advance message pointer to next byte
-        if ((++i % 8) == 0) {
-            ++ptr;
-        }
+        return (Log::error(kMessage), 0);
     }
 
-    // "Zero-out" remaining cells using 0x02 as terminating character
-    for (; i != size; ++i) {
-        std::size_t j = nchanns_ * i;
-
-        unsigned char value = data_[j];
-        data_[j] = (value & ~0x03) | 0x02;
-    }
+    // Apply steganography, independently per pixel
+    const std::size_t bits = buffSize * 8;
+    parallel_for(size, kPixelGrain, [&](std::size_t begin, std::size_t end) {
+        embed_pixels(data_, nchanns_, buff, bits, begin, end);
+    });
 
     return size;
 }
@@ -4,6 +4,7 @@
 #pragma once
 
 #include <cstdint>
+#include <vector>
 
 namespace steg {
     //! @class
@@ -12,6 +13,46 @@ namespace steg {
         //! Type of image file
         enum class ImageType : std::uint8_t { kNil, kPng, kBmp, kTga };
 
+        //! Sink for encoded image data, may be called several times per save
+        //! (same signature as stbi_write_func)
+        using WriteFunc = void (*)(void* context, void* data, int size);
+
+        //! @bag Header
+        //! What an image file's header tells without decoding its pixels
+        struct Header {
+            unsigned w = 0;
+            unsigned h = 0;
+            unsigned nchanns = 0;
+
+            // File type, kNil for formats that can be read but not written
+            ImageType type = ImageType::kNil;
+            // File size in bytes
+            std::uint64_t fileSize = 0;
+        };
+
+        //! Parses an image file type name
+        //! @param name one of png, bmp or tga, in any case
+        //! @return the file type, kPng if name is not recognized
+        static ImageType parse_type(const char* name);
+
+        //! @return name of an image file type, "other" for kNil
+        static const char* type_name(ImageType type);
+
+        //! Reads the header of an image file
+        //! @param path path/to/image/file
+        //! @param header[out] image dimensions and file type
+        //! @return true if the file is a readable image
+        static bool probe(const char* path, Header& header);
+
+        //! Reads the header of an image file held in memory
+        //! @param data encoded image file content
+        //! @param size size of data
+        //! @param header[out] image dimensions and file type
+        //! @return true if data is a readable image
+        static bool probe(const unsigned char* data,
+                          std::size_t size,
+                          Header& header);
+
         //! dtor.
         ~Image();
 
@@ -33,29 +74,80 @@ namespace steg {
         //! @return the size of the message
         std::size_t size() const;
 
+        //! @return width x height, one message bit each
+        std::size_t pixels() const
+        {
+            return static_cast<std::size_t>(w_) * h_;
+        }
+
         //! Saves file
         //! @param path output image path
         //! @param type output image file type
         //! @return true on success, false otherwise
         bool save(const char* path, ImageType type) const;
 
+        //! Encodes image and hands the result to a sink
+        //! @param type output image file type
+        //! @param func sink receiving the encoded data
+        //! @param context passed through to func
+        //! @return true on success, false otherwise
+        bool save(ImageType type, WriteFunc func, void* context) const;
+
+        //! Encodes image to memory
+        //! @param type output image file type
+        //! @param out[out] encoded image file content
+        //! @return true on success, false otherwise
+        bool save(ImageType type, std::vector<unsigned char>& out) const;
+
         //! Loads file
         //! @param path path/to/image/file
         //! @return image size
         std::size_t open(const char* path);
 
+        //! Loads image from memory
+        //! @param data encoded image file content (png, bmp, tga, ...)
+        //! @param size size of data
+        //! @return image size
+        std::size_t open(const unsigned char* data, std::size_t size);
+
+        //! Loads image from a file descriptor, reading from its current
+        //! position; works on files, pipes and sockets
+        //! @param fd readable file descriptor, left open
+        //! @return image size
+        std::size_t open(int fd);
+
+        //! Loads file by mapping it into memory instead of reading it
+        //! @param path path/to/image/file
+        //! @return image size
+        std::size_t map(const char* path);
+
         //! Reads message from image
         //! @param buff[out] unallocated output buffer
         //! @param buffSize size of buff
         //! @return number of bytes read
         std::size_t read(char* buff, std::size_t buffSize) const;
 
+        //! Reads part of the message from image, touching only the pixels
+        //! that hold it; unlike read(), does not look for the end of message
+        //! @param buff[out] output buffer of at least size bytes
+        //! @param offset first message byte to read
+        //! @param size number of bytes to read
+        //! @return number of bytes read, fewer if the image ends first
+        std::size_t read(char* buff,
+                         std::size_t offset,
+                         std::size_t size) const;
+
         //! Writes message to image
         //! @param buff input message [in]
         //! @param buffSize input message size [in]
         //! @return number of bytes written
         std::size_t write(const char* buff, std::size_t buffSize);
     private:
+        /* Helper
+         * Takes ownership of decoded pixels
+         */
+        std::size_t adopt(unsigned char* data, int w, int h, int nchanns);
+
         // Image data
         unsigned char* data_ = nullptr;
 
@@ -0,0 +1,135 @@
+/* job.hpp -- v1.0
+   Encodes or decodes one loaded carrier entirely in memory; shared by the
+   batch and server modes */
+
+#pragma once
+
+#include "async_io.hpp"
+#include "image.hpp"
+#include "stream.hpp"
+#include <chrono>
+#include <cstddef>
+#include <cstring>
+
+namespace steg {
+    //! @bag JobTimes
+    //! Stage timings of a job, in milliseconds
+    struct JobTimes {
+        double codeMs = 0;
+        double saveMs = 0;
+    };
+
+    //! Encrypts a payload into a loaded carrier
+    //! @param encoder BlockEncoder, rewound before use
+    //! @param initvec initialization vector the encoder was created with
+    //! @param image loaded carrier, modified in place
+    //! @param payload plain message
+    //! @param size size of payload
+    //! @param times[out] stage timings
+    //! @return "ok", or the name of the stage that failed
+    template <typename Tencoder>
+    const char* embed_job(Tencoder& encoder,
+                          const char* initvec,
+                          Image& image,
+                          const char* payload,
+                          std::size_t size,
+                          JobTimes& times)
+    {
+        using Clock = std::chrono::steady_clock;
+        using Ms = std::chrono::duration<double, std::milli>;
+
+        const Clock::time_point t0 = Clock::now();
+
+        BufferInputStream input(payload, size);
+        if (!encoder.reset(initvec) || !encoder.run(input, image)) {
+            return "encode-failed";
+        }
+
+        times.codeMs = Ms(Clock::now() - t0).count();
+        return "ok";
+    }
+
+    //! Encodes an image file
+    //! @param image image to encode
+    //! @param type output image file type
+    //! @param out[out] encoded image file content
+    //! @param times[out] stage timings
+    //! @return "ok", or the name of the stage that failed
+    inline const char* save_job(const Image& image,
+                                Image::ImageType type,
+                                IoBuffer& out,
+                                JobTimes& times)
+    {
+        using Clock = std::chrono::steady_clock;
+        using Ms = std::chrono::duration<double, std::milli>;
+
+        const Clock::time_point t0 = Clock::now();
+
+        BufferOutputStream output;
+        if (!image.save(type, BufferOutputStream::sink, &output)) {
+            return "save-failed";
+        }
+
+        out = output.release();
+        times.saveMs = Ms(Clock::now() - t0).count();
+        return "ok";
+    }
+
+    //! Encrypts a payload into a loaded carrier and encodes the result
+    //! @param encoder BlockEncoder, rewound before use
+    //! @param initvec initialization vector the encoder was created with
+    //! @param image loaded carrier, modified in place
+    //! @param payload plain message
+    //! @param size size of payload
+    //! @param type output image file type
+    //! @param out[out] encoded image file content
+    //! @param times[out] stage timings
+    //! @return "ok", or the name of the stage that failed
+    template <typename Tencoder>
+    const char* encode_job(Tencoder& encoder,
+                           const char* initvec,
+                           Image& image,
+                           const char* payload,
+                           std::size_t size,
+                           Image::ImageType type,
+                           IoBuffer& out,
+                           JobTimes& times)
+    {
+        const char* status
+            = embed_job(encoder, initvec, image, payload, size, times);
+        if (std::strcmp(status, "ok") != 0) {
+            return status;
+        }
+
+        return save_job(image, type, out, times);
+    }
+
+    //! Extracts and decrypts the payload of a loaded carrier
+    //! @param decoder BlockDecoder, rewound before use
+    //! @param initvec initialization vector the decoder was created with
+    //! @param image loaded carrier
+    //! @param out[out] decoded payload
+    //! @param times[out] stage timings
+    //! @return "ok", or the name of the stage that failed
+    template <typename Tdecoder>
+    const char* decode_job(Tdecoder& decoder,
+                           const char* initvec,
+                           Image& image,
+                           IoBuffer& out,
+                           JobTimes& times)
+    {
+        using Clock = std::chrono::steady_clock;
+        using Ms = std::chrono::duration<double, std::milli>;
+
+        const Clock::time_point t0 = Clock::now();
+
+        BufferOutputStream output;
+        if (!decoder.reset(initvec) || !decoder.run(image, output)) {
+            return "decode-failed";
+        }
+
+        out = output.release();
+        times.codeMs = Ms(Clock::now() - t0).count();
+        return "ok";
+    }
+} // namespace steg
@@ -0,0 +1,98 @@
+/* log.cpp -- v1.0 */
+
+#include "log.hpp"
+#include <cerrno>
+#include <strings.h>
+#include <unistd.h>
+
+/*! Lowest level written.
+ */
+std::atomic<steg::LogLevel> steg::Log::level_ = steg::LogLevel::kInfo;
+
+/*! Sets the lowest level written.
+ */
+void steg::Log::set_level(const LogLevel level)
+{
+    level_.store(level, std::memory_order_relaxed);
+}
+
+/*! Parses a level name.
+ */
+bool steg::Log::parse_level(const char* name, LogLevel& level)
+{
+    static constexpr struct {
+        const char* name;
+        LogLevel level;
+    } kLevels[] = {
+        {"debug", LogLevel::kDebug},
+        {"info", LogLevel::kInfo},
+        {"warning", LogLevel::kWarning},
+        {"error", LogLevel::kError},
+        {"off", LogLevel::kOff},
+    };
+
+    for (const auto& entry: kLevels) {
+        if (::strcasecmp(name, entry.name) == 0) {
+            level = entry.level;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/*! Buffer of the calling thread, holding the level prefix.
+ */
+std::string& steg::Log::begin(const LogLevel level)
+{
+    static constexpr const char* kPrefixes[]
+        = {"Debug:", "Info:", "Warning:", "Error:"};
+
+    // Kept per thread, so a warmed up thread does not allocate to log
+    thread_local std::string line;
+    line.assign(kPrefixes[static_cast<std::size_t>(level)]);
+    return line;
+}
+
+/*! Ends the line and writes it out.
+ */
+void steg::Log::end(std::string& line)
+{
+    line += '\n';
+
+    // One write per line; stderr is unbuffered, so nothing else interleaves
+    const char* data = line.data();
+    std::size_t size = line.size();
+    while (size != 0) {
+        const ssize_t n = ::write(STDERR_FILENO, data, size);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            return; // Nowhere left to report it
+        }
+
+        data += n;
+        size -= static_cast<std::size_t>(n);
+    }
+}
+
+/*! Quotes line[start...] if needed.
+ */
+void steg::Log::quote(std::string& line, const std::size_t start)
+{
+    if (line.find_first_of(" \"", start) == std::string::npos
+        && line.size() != start) {
+        return;
+    }
+
+    for (std::size_t i = start; i != line.size(); ++i) {
+        if (line[i] == '"' || line[i] == '\\') {
+            line.insert(i++, 1, '\\');
+        }
+    }
+
+    line.insert(start, 1, '"');
+    line += '"';
+}
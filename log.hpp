@@ -0,0 +1,144 @@
+/* log.hpp -- v1.0
+   Thread-safe logger to stderr. Each thread formats a whole line into its
+   own buffer and writes it with one write(2), so lines from concurrent
+   workers never interleave and no lock is taken; nothing is formatted for
+   lines below the set level */
+
+#pragma once
+
+#include <atomic>
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <type_traits>
+
+namespace steg {
+    //! Severity of a log line
+    enum class LogLevel : std::uint8_t {
+        kDebug,
+        kInfo,
+        kWarning,
+        kError,
+        kOff
+    };
+
+    //! @bag LogField
+    //! key=value pair on a log line; value is formatted only if the line is
+    //! written
+    template <typename T>
+    struct LogField {
+        const char* key;
+        const T& value;
+    };
+
+    //! @return a key=value field referring to value, which must outlive the
+    //! log call
+    template <typename T>
+    LogField<T> log_field(const char* key, const T& value)
+    {
+        return {key, value};
+    }
+
+    //! @class Log
+    //! Level-filtered lines of space-separated strings, numbers and
+    //! key=value fields
+    class Log {
+    public:
+        //! @return true if lines of this level are written
+        static bool enabled(const LogLevel level)
+        {
+            return level >= level_.load(std::memory_order_relaxed);
+        }
+
+        //! Sets the lowest level written; defaults to LogLevel::kInfo
+        static void set_level(LogLevel level);
+
+        //! Parses "debug", "info", "warning", "error" or "off"
+        //! @param level[out] parsed level
+        //! @return false if name is none of them
+        static bool parse_level(const char* name, LogLevel& level);
+
+        //! Writes "Error: args..."
+        template <typename... T>
+        static void error(const T&... args)
+        {
+            write(LogLevel::kError, args...);
+        }
+
+        //! Writes "Warning: args..."
+        template <typename... T>
+        static void warning(const T&... args)
+        {
+            write(LogLevel::kWarning, args...);
+        }
+
+        //! Writes "Info: args..."
+        template <typename... T>
+        static void info(const T&... args)
+        {
+            write(LogLevel::kInfo, args...);
+        }
+
+        //! Writes "Debug: args..."
+        template <typename... T>
+        static void debug(const T&... args)
+        {
+            write(LogLevel::kDebug, args...);
+        }
+
+        //! Writes one line, if its level is enabled
+        //! @param args strings, numbers and log_field()s, separated by spaces
+        template <typename... T>
+        static void write(const LogLevel level, const T&... args)
+        {
+            if (!enabled(level)) {
+                return;
+            }
+
+            std::string& line = begin(level);
+            ((line += ' ', append(line, args)), ...);
+            end(line);
+        }
+    private:
+        // Buffer of the calling thread, holding the level prefix
+        static std::string& begin(LogLevel level);
+
+        // Ends the line and writes it out
+        static void end(std::string& line);
+
+        template <typename T>
+        static void append(std::string& line, const T& value)
+        {
+            if constexpr (std::is_same_v<T, bool>) {
+                line += value ? "true" : "false";
+            } else if constexpr (std::is_arithmetic_v<T>) {
+                char number[32];
+                const auto result
+                    = std::to_chars(number, number + sizeof(number), value);
+                line.append(number, result.ptr);
+            } else if constexpr (std::is_pointer_v<T>) {
+                line += value != nullptr ? value : "(null)";
+            } else {
+                line += value;
+            }
+        }
+
+        // Values with spaces or quotes are quoted, so fields stay parseable
+        template <typename T>
+        static void append(std::string& line, const LogField<T>& field)
+        {
+            line += field.key;
+            line += '=';
+
+            const std::size_t start = line.size();
+            append(line, field.value);
+            quote(line, start);
+        }
+
+        // Quotes line[start...] if needed
+        static void quote(std::string& line, std::size_t start);
+
+        static std::atomic<LogLevel> level_;
+    };
+} // namespace steg
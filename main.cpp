@@ -1,168 +1,82 @@
 /* main.cpp -- v1.0 */
 
+#include "allocator.hpp"
+#include "archive.hpp"
+#include "batch.hpp"
 #include "block_decoder.hpp"
 #include "block_encoder.hpp"
-#include "error.hpp"
+#include "capacity.hpp"
+#include "carrier_index.hpp"
 #include "image.hpp"
+#include "log.hpp"
+#include "metrics.hpp"
+#include "seekable.hpp"
+#include "server.hpp"
+#include "shard.hpp"
+#include "stats.hpp"
+#include "stream.hpp"
+#include "trace.hpp"
 #include <cassert>
-#include <cctype>
+#include <cerrno>
+#include <cstdint>
 #include <cstdio>
+#include <cstdlib>
 #include <cstring>
 #include <getopt.h>
 #include <memory>
 #include <string>
 #include <unistd.h>
+#include <vector>
 
 namespace {
-    /*! @class: writes to file
-     */
-    class OutputStream {
-        // Output file
-        FILE* fd_ = stdout;
-    public:
-        ~OutputStream()
-        {
-            if (fd_ && fd_ != stdout) {
-                std::fclose(fd_);
-            }
-        }
-
-        OutputStream() = default;
-
-        OutputStream(OutputStream&& other) noexcept
-            : fd_(other.fd_)
-        {
-            other.fd_ = nullptr;
-        }
-
-        bool open(const char* const filePath)
-        {
-            if (fd_ != stdout) {
-                return false;
-            }
-
-            fd_ = std::fopen(filePath, "wb");
-            return fd_ != nullptr;
-        }
-
-        std::size_t write(const char* const buff, const std::size_t size)
-        {
-            // Write from buff to fd
-            return std::fwrite(buff, sizeof(char), size, fd_);
-        }
-    };
 
-    /*! @class: reads from file
+    /*! Helper: Outputs to stdout
      */
-    class InputStream {
-        // Encapsulated file descriptor
-        FILE* fd_ = stdin;
-    public:
-        ~InputStream()
-        {
-            // Cleanup
-            if (fd_ && fd_ != stdin) {
-                std::fclose(fd_);
-            }
-        }
-
-        /// ctor.
-        InputStream() = default;
-
-        InputStream(InputStream&& other) noexcept
-            : fd_(other.fd_)
-        {
-            other.fd_ = nullptr;
-        }
-
-        /// assignment
-        InputStream& operator()(InputStream&& other)
-        {
-            fd_ = std::move(other.fd_);
-            other.fd_ = nullptr;
-            return *this;
-        }
-
-        /// File size
-        std::size_t size() const
-        {
-            // Get file size
-            std::fseek(fd_, 0, SEEK_END);
-            std::int64_t size = ftell(fd_);
-            std::fseek(fd_, 0, SEEK_SET);
+    inline void print_out(const char* app, const char* str)
+    {
+        std::fprintf(stdout, "%s: %s.\n", app, str);
+    }
 
-            return size < 0 ? 0 : static_cast<std::size_t>(size);
-        }
+    /*! Helper: Outputs to stderr
+     */
+    inline void print_file_error(const char* path)
+    {
+        steg::Log::error("Unable to open file",
+                         path,
+                         "(check that it exists and that its permissions "
+                         "are correct)");
+    }
 
-        /// Open file
-        bool open(const char* const filePath)
-        {
-            if (fd_ != stdin) {
+    /*! Helper: Parses a --range "first:last", either end optional
+     */
+    bool parse_range(const char* arg, std::uint64_t& first, std::uint64_t& last)
+    {
+        // Digits only, so that strtoull() skips no sign or whitespace
+        auto number = [](const char*& field, std::uint64_t& value) {
+            if (*field < '0' || *field > '9') {
                 return false;
             }
 
-            // Open and initialize file
-            fd_ = std::fopen(filePath, "r");
-            return fd_ != nullptr;
-        }
+            char* end = nullptr;
+            errno = 0;
+            value = std::strtoull(field, &end, 10);
+            field = end;
+            return errno == 0;
+        };
 
-        /// Read from file
-        std::size_t read(char* buff, std::size_t size)
-        {
-            // Sanity check
-            if (fd_ == nullptr) {
-                return 0;
-            }
-
-            // Read raw data
-            size = std::fread(buff, sizeof(char), size, fd_);
-            if (size > 0 && fd_ == stdin) {
-                // Remove trailing newline (stdin has different rules)
-                buff[strcspn(buff, "\n")] = 0;
-            }
-
-            return size;
+        if (*arg != ':' && !number(arg, first)) {
+            return false;
         }
-    };
-} // namespace
 
-namespace {
-    /*! @class: allocates/deallocates using new/delete
-     */
-    class BasicAllocator {
-    public:
-        static void deallocate(const char* const v)
-        {
-            delete[] v;
+        if (*arg == '\0') {
+            return true;
         }
 
-        static char* allocate(const std::size_t size)
-        {
-            auto* value = new char[size];
-            std::memset(value, 0, size);
-            return value;
+        if (*arg++ != ':' || (*arg != '\0' && !number(arg, last))) {
+            return false;
         }
-    };
-} // namespace
 
-namespace {
-
-    /*! Helper: Outputs to stdout
-     */
-    inline void print_out(const char* app, const char* str)
-    {
-        std::fprintf(stdout, "%s: %s.\n", app, str);
-    }
-
-    /*! Helper: Outputs to stderr
-     */
-    inline void print_file_error(const char* path)
-    {
-        std::fprintf(
-            stderr,
-            "Error opening file %s, check that file exists and that file "
-            "permissions are correct.\n",
-            path);
+        return *arg == '\0' && first <= last;
     }
 
     /*! Helper: Outputs usage statement to stdout
@@ -178,13 +92,72 @@ namespace {
                "   -k<crypt-key-file>\n"
                "   -v<init-vec-file>\n"
                "  [-i<message-file>]\n"
-               "  [-b]\n",
+               "  [-b]\n"
+               "  [-m<cipher-mode>] [--range <first>:<last>]\n"
+               "  [--stats[=text|json]] [--perf-counters] [--trace <file>]\n"
+               "  [--log-level <level>] [--metrics <target> "
+               "[--metrics-interval <seconds>]]\n"
+               "  [--batch <manifest> [-j<threads>] [-p<depth>]\n"
+               "     [--stages <load>:<code>:<save>] [--carriers <index>]]\n"
+               "\n"
+               "       %s --serve <socket> "
+               "[-k<crypt-key-file> -v<init-vec-file>]\n"
+               "  [--keys <keyring>] [--carriers <index>] [-j<threads>]\n"
+               "  [--metrics <target>]\n"
+               "\n"
+               "       %s --capacity <image-or-dir>... [-o<output-file>] "
+               "[-j<threads>]\n"
+               "       %s --index <index> <image-or-dir>... [-j<threads>]\n"
+               "\n"
+               "       %s {--encode|--decode} --shards <image>... "
+               "-k<crypt-key-file>\n"
+               "  -v<init-vec-file> [-o<output>] [-t<output-file-type>] "
+               "[-i<message-file>]\n"
+               "  [-b] [-j<threads>]\n"
+               "\n"
+               "       %s --encode --archive <file>... -f<image-source> "
+               "-o<output-file>\n"
+               "  -k<crypt-key-file> -v<init-vec-file> [-t<output-file-type>] "
+               "[-b] [-m<cipher-mode>]\n"
+               "       %s --decode --archive [<entry>] -f<encoded-image> "
+               "[-o<output-file>]\n"
+               "  -k<crypt-key-file> -v<init-vec-file> [-b] "
+               "[-m<cipher-mode>]\n",
+               app,
+               app,
+               app,
+               app,
+               app,
+               app,
                app);
 
         printf("\n");
-        printf("  %s\n  %s\n  %s\n",
+        printf("  %s\n  %s\n  %s\n  %s\n  %s\n  %s\n  %s\n  %s\n  %s\n",
                "--encode                     Encoding mode",
                "--decode                     Decoding mode",
+               "--stats[=text|json]          Reports time, bytes and MB/s per "
+               "stage and\n"
+               "                               peak memory to stderr on exit",
+               "--perf-counters              Adds cycles, instructions, IPC, "
+               "cache and\n"
+               "                               branch misses per stage to "
+               "--stats",
+               "--trace <file>               Writes stage, tile and job events "
+               "to file on\n"
+               "                               exit, in Chrome trace-event "
+               "format",
+               "--log-level <level>          debug, info (default), warning, "
+               "error or off",
+               "--metrics <target>           Prometheus metrics: jobs, bytes, "
+               "errors, stage\n"
+               "                               latencies, cipher pool and "
+               "queue depths;\n"
+               "                               \"unix:<socket>\" serves them "
+               "per connection,\n"
+               "                               a file path gets them dumped "
+               "periodically",
+               "--metrics-interval <seconds> Time between --metrics file "
+               "dumps; defaults to 10",
                "--help (-h)                  Prints this message");
 
         printf("\n");
@@ -195,6 +168,7 @@ namespace {
                "\t%s\n\t%s\n\n"
                "\t%s\n\t%s\n\n"
                "\t%s\n"
+               "\t%s\n\n"
                "\t%s\n",
 
                "-f<image-source>           Source file for image that the "
@@ -212,7 +186,11 @@ namespace {
                "                           source is the terminal (stdin)",
 
                "-b                         Encodes the encrypted output as a "
-               "base64 string");
+               "base64 string",
+
+               "-m<cipher-mode>            cbc (default), or ctr for a "
+               "payload that can be\n\t"
+               "                           decoded in part with --range");
 
         printf("\n");
         printf(
@@ -222,6 +200,8 @@ namespace {
                "\t%s\n\n"
                "\t%s\n\n"
                "\t%s\n"
+               "\t%s\n\n"
+               "\t%s\n"
                "\t%s\n",
 
                "-f<encoded-image>          Source file of encoded message",
@@ -235,10 +215,189 @@ namespace {
                "-v<init-vec-file>          Initialization vector file",
                "-b                         Required if the encryption output "
                "was a base64\n\t"
-               "                           string");
+               "                           string",
+
+               "-m<cipher-mode>            The mode it was encoded with",
+               "--range <first>:<last>     Decodes payload bytes [first, last) "
+               "only, reading\n\t"
+               "                           just the pixels and cipher blocks "
+               "that hold them;\n\t"
+               "                           either end may be left out; "
+               "implies -m ctr");
+
+        printf("\n");
+        printf(
+            "------------Batch Mode"
+            "-----------------------------------------------------------\n");
+        printf("\t%s\n\n"
+               "\t%s\n\n"
+               "\t%s\n"
+               "\t%s\n"
+               "\t%s\n\n"
+               "\t%s\n",
+
+               "--batch <manifest>         Runs every job in the manifest "
+               "(with --encode or\n\t"
+               "                           --decode); one job per line, as "
+               "tab-separated\n\t"
+               "                           carrier, payload, output, type "
+               "fields or a JSON\n\t"
+               "                           object with those keys",
+
+               "-o<output-file>            Per-job result lines go to this "
+               "file; if left\n\t"
+               "                           unspecified, outputs to the "
+               "terminal (stdout)",
+
+               "-j<threads>                Worker threads; defaults to one "
+               "per available CPU",
+               "-p<depth>                  Jobs read ahead of the workers; "
+               "defaults to 8",
+               "--stages <l>:<c>:<s>       Jobs loading, en/decoding and "
+               "saving at once;\n\t"
+               "                           each defaults to the thread count",
+
+               "--carriers <index>         Encode jobs with no carrier get "
+               "the smallest\n\t"
+               "                           indexed carrier their payload fits "
+               "in");
+
+        printf("\n");
+        printf(
+            "------------Server "
+            "Mode----------------------------------------------------------\n");
+        printf("\t%s\n\n"
+               "\t%s\n\n"
+               "\t%s\n\n"
+               "\t%s\n\n"
+               "\t%s\n",
+
+               "--serve <socket>           Serves encode/decode requests on "
+               "a UNIX domain\n\t"
+               "                           socket until interrupted; see "
+               "protocol.hpp",
+
+               "-k<crypt-key-file>         Key of the \"default\" key id",
+               "--keys <keyring>           More keys, one \"id key-file "
+               "init-vec-file\"\n\t"
+               "                           line per key",
+
+               "--carriers <index>         Encode requests with no carrier "
+               "get the smallest\n\t"
+               "                           indexed carrier their payload fits "
+               "in",
+
+               "-j<threads>                Worker threads, serving four "
+               "connections each;\n\t"
+               "                           defaults to one per available CPU");
+
+        printf("\n");
+        printf(
+            "------------Capacity "
+            "Mode--------------------------------------------------------\n");
+        printf("\t%s\n\n"
+               "\t%s\n\n"
+               "\t%s\n",
+
+               "--capacity <image-or-dir>  Reports the largest payload each "
+               "image holds,\n\t"
+               "                           raw and base64, from its header "
+               "alone; one\n\t"
+               "                           \"path type width height channels "
+               "file-size\n\t"
+               "                           capacity capacity-base64\" line "
+               "per image",
+
+               "-o<output-file>            Report lines go to this file; if "
+               "left\n\t"
+               "                           unspecified, outputs to the "
+               "terminal (stdout)",
+
+               "--index <index>            Instead of reporting, writes the "
+               "images to a\n\t"
+               "                           carrier index, sorted by size, for "
+               "--carriers");
+
+        printf("\n");
+        printf(
+            "------------Shard Mode"
+            "-----------------------------------------------------------\n");
+        printf("\t%s\n\n"
+               "\t%s\n\n"
+               "\t%s\n",
+
+               "--shards <image>...        Encrypts one payload and spreads it "
+               "over the\n\t"
+               "                           given carriers (with --encode), or "
+               "joins it back\n\t"
+               "                           from the images in any order (with "
+               "--decode)",
+
+               "-o<output>                 Encode: images are written to "
+               "<output>.<n>.<type>\n\t"
+               "                           Decode: payload file; defaults to "
+               "stdout",
+
+               "-b                         Encode only; decoding reads it "
+               "from the shards");
+
+        printf("\n");
+        printf(
+            "------------Archive "
+            "Mode---------------------------------------------------------\n");
+        printf("\t%s\n\n"
+               "\t%s\n\n"
+               "\t%s\n",
+
+               "--archive <file>...        Encode: packs the files, with an "
+               "index of names,\n\t"
+               "                           lengths and CRC-32s, into one "
+               "payload",
+
+               "--archive [<entry>]        Decode: lists the entries as "
+               "\"name length crc32\"\n\t"
+               "                           lines, or extracts the named "
+               "entry and checks it",
+
+               "-m ctr                     Listing and extracting decrypt "
+               "only the index\n\t"
+               "                           and the entry asked for");
     }
 } // namespace
 
+namespace {
+    //! @class StatsReport
+    //! Prints the --stats report to stderr when main() returns
+    class StatsReport {
+    public:
+        ~StatsReport()
+        {
+            if (steg::Stats::enabled()) {
+                const std::string report = (steg::Stats::get())->report(json);
+                std::fputs(report.c_str(), stderr);
+            }
+        }
+
+        // Report as JSON rather than text
+        bool json = false;
+    };
+
+    //! @class TraceReport
+    //! Writes the --trace events when main() returns
+    class TraceReport {
+    public:
+        ~TraceReport()
+        {
+            if (!path.empty()) {
+                steg::Trace::write(path.c_str());
+            }
+        }
+
+        // Output file, empty unless tracing
+        std::string path;
+    };
+} // namespace
+
 namespace {
 
     // @bag
@@ -254,7 +413,7 @@ namespace {
         // Encoded image output
         steg::Image output;
         // Message input
-        InputStream input;
+        steg::InputStream input;
     };
 
     // @bag
@@ -266,7 +425,7 @@ namespace {
         // Image input
         steg::Image input;
         // Input message
-        OutputStream output;
+        steg::OutputStream output;
     };
 } // namespace
 
@@ -299,8 +458,9 @@ namespace {
             return 1; // Error code
         }
 
-        // Decrypt the message & return
-        return decoder->run(io.input, io.output) ? 0 : 1;
+        // Decrypt the message & return; buffered output may still fail
+        bool ret = decoder->run(io.input, io.output);
+        return (io.output).close() && ret ? 0 : 1;
     }
 } // namespace
 
@@ -320,11 +480,108 @@ int main(int argc, char** argv)
     // Input file
     std::string inputPath;
 
+    // Batch manifest file
+    std::string manifestPath;
+
+    // Capacity mode, and the image files and directories it probes
+    bool capacity = false;
+    std::vector<std::string> operands;
+
+    // Spread one payload over the images given as arguments
+    bool shards = false;
+
+    // Pack the files given as arguments, or list or extract entries
+    bool archive = false;
+
+    // Cipher mode, and the payload bytes to decode, [first, last)
+    std::string cipherMode;
+    bool range = false;
+    std::uint64_t rangeFirst = 0;
+    std::uint64_t rangeLast = UINT64_MAX;
+
+    // Carrier index to build, or to pick carriers from
+    std::string indexPath;
+    std::string carriersPath;
+
+    // Server socket and keyring files
+    std::string socketPath;
+    std::string keyringPath;
+
+    // Worker threads (0 = one per available CPU) and batch read-ahead depth
+    unsigned threads = 0;
+    unsigned prefetch = 8;
+
+    // Batch jobs per pipeline stage (0 = one per worker thread)
+    unsigned stages[3] = {};
+
+    // Stage timings, printed on the way out
+    StatsReport statsReport;
+    TraceReport traceReport;
+
+    // Prometheus metrics target, exported until main() returns
+    std::string metricsTarget;
+    unsigned metricsInterval = 10;
+
     // Long command line options
     const option longOptions[] = {
         {.name = "help", .has_arg = no_argument, .flag = nullptr, .val = 0},
         {.name = "encode", .has_arg = no_argument, .flag = nullptr, .val = 0},
         {.name = "decode", .has_arg = no_argument, .flag = nullptr, .val = 0},
+        {.name = "batch",
+         .has_arg = required_argument,
+         .flag = nullptr,
+         .val = 0},
+        {.name = "serve",
+         .has_arg = required_argument,
+         .flag = nullptr,
+         .val = 0},
+        {.name = "keys",
+         .has_arg = required_argument,
+         .flag = nullptr,
+         .val = 0},
+        {.name = "stages",
+         .has_arg = required_argument,
+         .flag = nullptr,
+         .val = 0},
+        {.name = "capacity", .has_arg = no_argument, .flag = nullptr, .val = 0},
+        {.name = "index",
+         .has_arg = required_argument,
+         .flag = nullptr,
+         .val = 0},
+        {.name = "carriers",
+         .has_arg = required_argument,
+         .flag = nullptr,
+         .val = 0},
+        {.name = "shards", .has_arg = no_argument, .flag = nullptr, .val = 0},
+        {.name = "range",
+         .has_arg = required_argument,
+         .flag = nullptr,
+         .val = 0},
+        {.name = "archive", .has_arg = no_argument, .flag = nullptr, .val = 0},
+        {.name = "stats",
+         .has_arg = optional_argument,
+         .flag = nullptr,
+         .val = 0},
+        {.name = "perf-counters",
+         .has_arg = no_argument,
+         .flag = nullptr,
+         .val = 0},
+        {.name = "trace",
+         .has_arg = required_argument,
+         .flag = nullptr,
+         .val = 0},
+        {.name = "log-level",
+         .has_arg = required_argument,
+         .flag = nullptr,
+         .val = 0},
+        {.name = "metrics",
+         .has_arg = required_argument,
+         .flag = nullptr,
+         .val = 0},
+        {.name = "metrics-interval",
+         .has_arg = required_argument,
+         .flag = nullptr,
+         .val = 0},
         {.name = nullptr, .has_arg = 0, .flag = nullptr, .val = 0},
     };
 
@@ -340,7 +597,7 @@ int main(int argc, char** argv)
     int opt = 0;
     int optindex = 0;
     while ((opt = getopt_long(
-                argc, argv, "-f:t:o:k:v:i:bh", longOptions, &optindex))
+                argc, argv, "-f:t:o:k:v:i:j:p:m:bh", longOptions, &optindex))
            != -1) {
         switch (opt) {
             // Encoding source
@@ -385,6 +642,29 @@ int main(int argc, char** argv)
                 break;
             }
 
+            // Batch worker threads
+            case 'j':
+            {
+                threads
+                    = static_cast<unsigned>(std::strtoul(optarg, nullptr, 10));
+                break;
+            }
+
+            // Batch read-ahead depth
+            case 'p':
+            {
+                prefetch
+                    = static_cast<unsigned>(std::strtoul(optarg, nullptr, 10));
+                break;
+            }
+
+            // Cipher mode
+            case 'm':
+            {
+                cipherMode = optarg;
+                break;
+            }
+
             // Use base 64 encoding
             case 'b':
             {
@@ -412,9 +692,8 @@ int main(int argc, char** argv)
                     case 1:
                     {
                         if (mode != 0) {
-                            (steg::Error::get())
-                                ->log("Error: either select encode or "
-                                      "decode, I can't do both");
+                            steg::Log::error("either select encode or "
+                                             "decode, I can't do both");
                             print_usage(argv[0]);
                             return 1;
                         }
@@ -427,9 +706,8 @@ int main(int argc, char** argv)
                     case 2:
                     {
                         if (mode != 0) {
-                            (steg::Error::get())
-                                ->log("Error: either select encode or "
-                                      "decode, I can't do both");
+                            steg::Log::error("either select encode or "
+                                             "decode, I can't do both");
                             print_usage(argv[0]);
                             return 1;
                         }
@@ -438,6 +716,150 @@ int main(int argc, char** argv)
                         break;
                     }
 
+                    // Batch mode, on top of encode or decode
+                    case 3:
+                    {
+                        manifestPath = optarg;
+                        break;
+                    }
+
+                    // Server mode
+                    case 4:
+                    {
+                        socketPath = optarg;
+                        break;
+                    }
+
+                    // Server keyring
+                    case 5:
+                    {
+                        keyringPath = optarg;
+                        break;
+                    }
+
+                    // Batch stage concurrency, "load:code:save"
+                    case 6:
+                    {
+                        char* field = optarg;
+                        for (unsigned& stage: stages) {
+                            stage = static_cast<unsigned>(
+                                std::strtoul(field, &field, 10));
+                            if (*field == ':') {
+                                ++field;
+                            }
+                        }
+
+                        break;
+                    }
+
+                    // Capacity mode
+                    case 7:
+                    {
+                        capacity = true;
+                        break;
+                    }
+
+                    // Build a carrier index
+                    case 8:
+                    {
+                        indexPath = optarg;
+                        break;
+                    }
+
+                    // Carrier index for batch and server encode jobs
+                    case 9:
+                    {
+                        carriersPath = optarg;
+                        break;
+                    }
+
+                    // One payload over several images
+                    case 10:
+                    {
+                        shards = true;
+                        break;
+                    }
+
+                    // Partial decode, "first:last" with either end optional
+                    case 11:
+                    {
+                        if (!parse_range(optarg, rangeFirst, rangeLast)) {
+                            steg::Log::error("bad --range", optarg);
+                            print_usage(argv[0]);
+                            return 1;
+                        }
+
+                        range = true;
+                        break;
+                    }
+
+                    // Multi-file archive
+                    case 12:
+                    {
+                        archive = true;
+                        break;
+                    }
+
+                    // Stage timings, "text" (default) or "json"
+                    case 13:
+                    {
+                        statsReport.json = optarg != nullptr
+                                           && std::strcmp(optarg, "json") == 0;
+                        (steg::Stats::get())->enable();
+                        break;
+                    }
+
+                    // Hardware counters per stage, on top of --stats
+                    case 14:
+                    {
+                        steg::Stats* stats = steg::Stats::get();
+                        stats->enable();
+                        if (!stats->enable_perf()) {
+                            constexpr const char* kMessage
+                                = "Hardware counters unavailable, reporting "
+                                  "without them";
+                            steg::Log::warning(kMessage);
+                        }
+
+                        break;
+                    }
+
+                    // Chrome trace-event output
+                    case 15:
+                    {
+                        traceReport.path = optarg;
+                        steg::Trace::enable();
+                        break;
+                    }
+
+                    // Lowest severity logged
+                    case 16:
+                    {
+                        steg::LogLevel level = steg::LogLevel::kInfo;
+                        if (!steg::Log::parse_level(optarg, level)) {
+                            steg::Log::error("unknown log level", optarg);
+                            return 1;
+                        }
+
+                        steg::Log::set_level(level);
+                        break;
+                    }
+
+                    // Prometheus metrics, on a socket or in a file
+                    case 17:
+                    {
+                        metricsTarget = optarg;
+                        break;
+                    }
+
+                    // Seconds between metrics file dumps
+                    case 18:
+                    {
+                        metricsInterval = static_cast<unsigned>(
+                            std::strtoul(optarg, nullptr, 10));
+                        break;
+                    }
+
                     default:
                     {
                         break;
@@ -447,6 +869,13 @@ int main(int argc, char** argv)
                 break;
             }
 
+            // Non-option arguments, files for capacity mode
+            case 1:
+            {
+                operands.emplace_back(optarg);
+                break;
+            }
+
             // Print help blurb
             case 'h':
                 [[fallthrough]];
@@ -462,74 +891,223 @@ int main(int argc, char** argv)
         }
     }
 
+    std::unique_ptr<steg::MetricsExporter> metricsExporter;
+    if (!metricsTarget.empty()) {
+        metricsExporter.reset(steg::MetricsExporter::create(
+            metricsTarget.c_str(), metricsInterval));
+        if (metricsExporter == nullptr) {
+            return 1;
+        }
+    }
+
+    // Loose arguments only make sense in capacity, index, shard and archive
+    // modes
+    if (!operands.empty() && !capacity && indexPath.empty() && !shards
+        && !archive) {
+        print_out("steganography program that uses gcrypt to "
+                  "encode/decode a secret message to/from an image "
+                  "file; outputs the result to a new file",
+                  argv[0]);
+        print_usage(argv[0]);
+        return 0;
+    }
+
+    // Header-only capacity report, no keys needed
+    if (capacity) {
+        if (operands.empty()) {
+            steg::Log::error("no image files or directories given, exiting");
+            return 1;
+        }
+
+        // Report lines go to stdout unless -o is given
+        steg::OutputStream report;
+        if (!outputPath.empty() && !report.open(outputPath.c_str())) {
+            print_file_error(outputPath.c_str());
+            return 1;
+        }
+
+        int ret = steg::capacity_run(operands, threads, report);
+        return report.close() ? ret : 1;
+    }
+
+    // Carrier index from image headers, no keys needed
+    if (!indexPath.empty()) {
+        if (operands.empty()) {
+            steg::Log::error("no image files or directories given, exiting");
+            return 1;
+        }
+
+        std::vector<steg::Carrier> carriers;
+        const bool ok = steg::scan_carriers(operands, threads, carriers);
+
+        if (!steg::CarrierIndex::build(carriers, indexPath.c_str())) {
+            return 1;
+        }
+
+        std::printf("Indexed %zu carriers\n", carriers.size());
+        return ok ? 0 : 1;
+    }
+
+    // Long-running server, keys come from -k/-v and/or the keyring
+    if (!socketPath.empty()) {
+        if (keyFilePath.empty() != vecFilePath.empty()) {
+            steg::Log::error("-k and -v go together, exiting");
+            return 1;
+        }
+
+        const steg::ServeOptions opts = {
+            .keyPath = keyFilePath.empty() ? nullptr : keyFilePath.c_str(),
+            .vecPath = vecFilePath.empty() ? nullptr : vecFilePath.c_str(),
+            .keyring = keyringPath.empty() ? nullptr : keyringPath.c_str(),
+            .carriers = carriersPath.empty() ? nullptr : carriersPath.c_str(),
+            .threads = threads,
+        };
+
+        return steg::serve(socketPath.c_str(), opts);
+    }
+
     // Ensure all necessary parameters specified; exit otherwise...
     if (mode == 0) {
-        (steg::Error::get())
-            ->log("Error: you forgot to select the program mode; either "
-                  "select encode (--encode) or decode (--decode)");
+        steg::Log::error("you forgot to select the program mode; either "
+                         "select encode (--encode) or decode (--decode)");
         print_usage(argv[0]);
         return 1;
     }
 
-    if (imagePath.empty()) {
-        (steg::Error::get())
-            ->log("Error: no image file specified (one of bmp, bmp, or "
-                  "tga formats), exiting");
+    const bool batch = !manifestPath.empty();
+
+    if (shards && operands.empty()) {
+        steg::Log::error("no image files given, exiting");
+        return 1;
+    }
+
+    if (imagePath.empty() && !batch && !shards) {
+        steg::Log::error("no image file specified (one of bmp, bmp, or "
+                         "tga formats), exiting");
         return 1;
     }
 
     if (keyFilePath.empty()) {
-        (steg::Error::get())
-            ->log("Error: no encryption key specified (use -k), exiting");
+        steg::Log::error("no encryption key specified (use -k), exiting");
         return 1;
     }
 
     if (vecFilePath.empty()) {
-        (steg::Error::get())
-            ->log("Error: no initialization vector specified (use -v), "
-                  "exiting");
+        steg::Log::error("no initialization vector specified (use -v), "
+                         "exiting");
         return 1;
     }
 
-    if (outputPath.empty()) {
-        (steg::Error::get())
-            ->log("Error: no output file specified (use -o), exiting");
+    if (outputPath.empty() && !batch && !((shards || archive) && mode == 2)) {
+        steg::Log::error("no output file specified (use -o), exiting");
         return 1;
     }
 
-    // Open file
-    InputStream keyStream;
-    InputStream vecStream;
-
-    if (!keyStream.open(keyFilePath.c_str())) {
+    // Load key & initialization vector
+    std::unique_ptr<char[]> key = steg::read_key(keyFilePath.c_str());
+    if (!key) {
         // Handle error
         print_file_error(keyFilePath.c_str());
         return 1;
     }
 
-    // Open file
-    if (!vecStream.open(vecFilePath.c_str())) {
+    std::unique_ptr<char[]> vec = steg::read_key(vecFilePath.c_str());
+    if (!vec) {
         // Handle error
         print_file_error(vecFilePath.c_str());
         return 1;
     }
 
-    std::size_t keySize = keyStream.size();
-    std::size_t vecSize = vecStream.size();
+    // Many jobs, one process
+    if (batch) {
+        const steg::BatchOptions opts = {
+            .encode = mode == 1,
+            .b64 = static_cast<bool>(b64),
+            .key = key.get(),
+            .vec = vec.get(),
+            .carriers = carriersPath.empty() ? nullptr : carriersPath.c_str(),
+            .threads = threads,
+            .prefetch = prefetch,
+            .loaders = stages[0],
+            .coders = stages[1],
+            .savers = stages[2],
+        };
+
+        // Result lines go to stdout unless -o is given
+        steg::OutputStream report;
+        if (!outputPath.empty() && !report.open(outputPath.c_str())) {
+            print_file_error(outputPath.c_str());
+            return 1;
+        }
 
-    auto* key = new char[keySize];
-    auto* vec = new char[vecSize];
+        int ret = steg::batch_run(manifestPath.c_str(), opts, report);
+        return report.close() ? ret : 1;
+    }
 
-    // Just in case
-    if (!key || !vec) {
-        (steg::Error::get())
-            ->log("Error: memory allocation failed - insufficient "
-                  "memory available, exiting");
+    // Counter mode, for payloads decoded in part
+    if (!cipherMode.empty() && cipherMode != "cbc" && cipherMode != "ctr") {
+        steg::Log::error("unknown cipher mode (use cbc or ctr), exiting");
         return 1;
     }
 
-    keyStream.read(key, keySize);
-    vecStream.read(vec, vecSize);
+    // Several files, one payload
+    if (archive) {
+        if (mode == 1 && operands.empty()) {
+            steg::Log::error("no files to archive, exiting");
+            return 1;
+        }
+
+        const steg::ArchiveOptions opts = {
+            .encode = mode == 1,
+            .b64 = static_cast<bool>(b64),
+            .seekable = cipherMode == "ctr",
+            .key = key.get(),
+            .vec = vec.get(),
+            .image = imagePath.c_str(),
+            .output = outputPath.empty() ? nullptr : outputPath.c_str(),
+            .type = steg::Image::parse_type(outputType.c_str()),
+        };
+
+        return steg::archive_run(operands, opts);
+    }
+
+    if (cipherMode == "ctr" || range) {
+        if (range && mode != 2) {
+            steg::Log::error("--range is for decoding, exiting");
+            return 1;
+        }
+
+        const steg::SeekOptions opts = {
+            .encode = mode == 1,
+            .b64 = static_cast<bool>(b64),
+            .key = key.get(),
+            .vec = vec.get(),
+            .image = imagePath.c_str(),
+            .input = inputPath.empty() ? nullptr : inputPath.c_str(),
+            .output = outputPath.c_str(),
+            .type = steg::Image::parse_type(outputType.c_str()),
+            .first = rangeFirst,
+            .last = rangeLast,
+        };
+
+        return steg::seekable_run(opts);
+    }
+
+    // One payload, many images
+    if (shards) {
+        const steg::ShardOptions opts = {
+            .encode = mode == 1,
+            .b64 = static_cast<bool>(b64),
+            .key = key.get(),
+            .vec = vec.get(),
+            .threads = threads,
+            .input = inputPath.empty() ? nullptr : inputPath.c_str(),
+            .output = outputPath.empty() ? nullptr : outputPath.c_str(),
+            .type = steg::Image::parse_type(outputType.c_str()),
+        };
+
+        return steg::shard_run(operands, opts);
+    }
 
     // Go...
     switch (mode) {
@@ -539,14 +1117,14 @@ int main(int argc, char** argv)
             EncodeIO io;
 
             // Load encoded image source
-            if (!(io.output).open(imagePath.c_str())) {
+            if (!(io.output).map(imagePath.c_str())) {
                 // Handle error
                 print_file_error(imagePath.c_str());
                 return 1;
             }
 
-            (io.key).reset(key);
-            (io.vec).reset(vec);
+            io.key = std::move(key);
+            io.vec = std::move(vec);
 
             // Plain message input;
             // If file specified, try to open it; otherwise, we'll use stdin
@@ -559,45 +1137,23 @@ int main(int argc, char** argv)
             // Assign output file variables
             io.outputPath = outputPath;
 
-            io.outputType = [&outputType] {
-                using enum steg::Image::ImageType;
-
-                std::string type;
-                type.reserve(outputType.size());
-                for (const char ch: outputType) {
-                    type.push_back(static_cast<char>(std::tolower(ch)));
-                }
-
-                if (type == "png") {
-                    return kPng;
-                }
-
-                if (type == "bmp") {
-                    return kBmp;
-                }
-
-                if (type == "tga") {
-                    return kTga;
-                }
-
-                return kPng;
-            }();
+            io.outputType = steg::Image::parse_type(outputType.c_str());
 
-            return (
-                static_cast<bool>(b64)
-                    ? encode<steg::BlockEncoder<true, BasicAllocator>>
-                    : encode<steg::BlockEncoder<false, BasicAllocator>>)(io);
+            using Talloc = steg::CountingAllocator<steg::BasicAllocator>;
+            return (static_cast<bool>(b64)
+                        ? encode<steg::BlockEncoder<true, Talloc>>
+                        : encode<steg::BlockEncoder<false, Talloc>>)(io);
         }
 
         // Decrypt
         case 2:
         {
             DecodeIO io;
-            (io.key).reset(key);
-            (io.vec).reset(vec);
+            io.key = std::move(key);
+            io.vec = std::move(vec);
 
             // Load source image
-            if (!(io.input).open(imagePath.c_str())) {
+            if (!(io.input).map(imagePath.c_str())) {
                 // Handle error
                 print_file_error(imagePath.c_str());
                 return 1;
@@ -611,10 +1167,10 @@ int main(int argc, char** argv)
                 return 1;
             }
 
-            return (
-                static_cast<bool>(b64)
-                    ? decode<steg::BlockDecoder<true, BasicAllocator>>
-                    : decode<steg::BlockDecoder<false, BasicAllocator>>)(io);
+            using Talloc = steg::CountingAllocator<steg::BasicAllocator>;
+            return (static_cast<bool>(b64)
+                        ? decode<steg::BlockDecoder<true, Talloc>>
+                        : decode<steg::BlockDecoder<false, Talloc>>)(io);
         }
 
         default:
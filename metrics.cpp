@@ -0,0 +1,508 @@
+/* metrics.cpp -- v1.0 */
+
+#include "metrics.hpp"
+#include "log.hpp"
+#include "protocol.hpp"
+#include "stats.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+namespace {
+    constexpr auto kMetrics = static_cast<std::size_t>(steg::Metric::kCount);
+    constexpr auto kStages = static_cast<std::size_t>(steg::Stage::kCount);
+
+    // Counter names, in Metric order
+    constexpr const char* kMetricNames[kMetrics] = {"jobs_total",
+                                                    "bytes_in_total",
+                                                    "bytes_out_total",
+                                                    "cipher_pool_hits_total",
+                                                    "cipher_pool_misses_total",
+                                                    "connections_total"};
+
+    // Failed job statuses counted apart; any other counts as "other"
+    constexpr const char* kStatuses[] = {"read-failed",
+                                         "load-failed",
+                                         "cipher-failed",
+                                         "encode-failed",
+                                         "decode-failed",
+                                         "save-failed",
+                                         "write-failed",
+                                         "no-carrier",
+                                         "unknown-key",
+                                         "other"};
+    constexpr std::size_t kErrors = std::size(kStatuses);
+
+    // Upper bounds of the latency buckets, in nanoseconds, from 50us to 10s
+    constexpr std::uint64_t kBounds[] = {50'000,
+                                         100'000,
+                                         250'000,
+                                         500'000,
+                                         1'000'000,
+                                         2'500'000,
+                                         5'000'000,
+                                         10'000'000,
+                                         25'000'000,
+                                         50'000'000,
+                                         100'000'000,
+                                         250'000'000,
+                                         500'000'000,
+                                         1'000'000'000,
+                                         2'500'000'000,
+                                         5'000'000'000,
+                                         10'000'000'000};
+    constexpr std::size_t kBuckets = std::size(kBounds) + 1; // Plus +Inf
+
+    using Cell = std::atomic<std::uint64_t>;
+
+    // @bag
+    struct Histogram {
+        Cell buckets[kBuckets] = {};
+        Cell sumNs = 0;
+    };
+
+    // @bag
+    // Counts of one thread; only that thread writes, scrapes read with
+    // relaxed loads. Kept past the thread's exit, and a cache line apart
+    // from the other shards
+    struct alignas(64) Shard {
+        Cell metrics[kMetrics] = {};
+        Cell errors[kErrors] = {};
+        Histogram stages[kStages];
+    };
+
+    // @bag
+    struct Gauge {
+        std::uint64_t id = 0;
+        const char* name = nullptr;
+        const char* help = nullptr;
+        std::string label;
+        std::function<double()> read;
+    };
+
+    // @bag
+    // Shards of every thread that counted, and the gauges
+    struct Registry {
+        std::mutex mutex;
+        std::vector<std::unique_ptr<Shard>> shards;
+        std::vector<Gauge> gauges;
+        std::uint64_t nextGauge = 1;
+    };
+
+    Registry& registry()
+    {
+        static Registry instance;
+        return instance;
+    }
+
+    // Helper: shard of the calling thread, registered on first use
+    Shard& local()
+    {
+        thread_local Shard* shard = nullptr;
+        if (shard == nullptr) {
+            Registry& reg = registry();
+            std::lock_guard lock(reg.mutex);
+            reg.shards.push_back(std::make_unique<Shard>());
+            shard = reg.shards.back().get();
+        }
+
+        return *shard;
+    }
+
+    // Helper: adds to a cell of the calling thread's shard; the only
+    // writer, so no read-modify-write instruction is needed
+    void bump(Cell& cell, const std::uint64_t n)
+    {
+        cell.store(cell.load(std::memory_order_relaxed) + n,
+                   std::memory_order_relaxed);
+    }
+
+    // Helper: sums a cell over every shard; the registry must be locked
+    template <typename Tcell>
+    std::uint64_t total(const Registry& reg, Tcell cell)
+    {
+        std::uint64_t sum = 0;
+        for (const auto& shard: reg.shards) {
+            sum += cell(*shard).load(std::memory_order_relaxed);
+        }
+
+        return sum;
+    }
+
+    // Helper: appends a metric's HELP and TYPE lines
+    void describe(std::string& out,
+                  const char* name,
+                  const char* type,
+                  const char* help)
+    {
+        out.append("# HELP steg_").append(name).append(" ").append(help);
+        out.append("\n# TYPE steg_").append(name).append(" ").append(type);
+        out.append("\n");
+    }
+
+    // Helper: appends one sample line
+    void sample(std::string& out,
+                const char* name,
+                const std::string& labels,
+                const double value)
+    {
+        char number[32];
+        std::snprintf(number, sizeof(number), "%.10g", value);
+
+        out.append("steg_").append(name);
+        if (!labels.empty()) {
+            out.append("{").append(labels).append("}");
+        }
+
+        out.append(" ").append(number).append("\n");
+    }
+} // namespace
+
+/*! Flag checked by every update.
+ */
+std::atomic<bool> steg::Metrics::enabled_ = false;
+
+/*! Starts counting.
+ */
+void steg::Metrics::enable()
+{
+    enabled_.store(true, std::memory_order_relaxed);
+}
+
+/*! Adds to a counter.
+ */
+void steg::Metrics::add(const Metric metric, const std::uint64_t n)
+{
+    if (enabled()) {
+        bump(local().metrics[static_cast<std::size_t>(metric)], n);
+    }
+}
+
+/*! Counts a finished job.
+ */
+void steg::Metrics::job(const char* status)
+{
+    if (!enabled()) {
+        return;
+    }
+
+    Shard& shard = local();
+    bump(shard.metrics[static_cast<std::size_t>(Metric::kJobs)], 1);
+
+    if (std::strcmp(status, "ok") == 0) {
+        return;
+    }
+
+    std::size_t i = 0;
+    while (i != kErrors - 1 && std::strcmp(status, kStatuses[i]) != 0) {
+        ++i;
+    }
+
+    bump(shard.errors[i], 1);
+}
+
+/*! Adds one run of a stage to its histogram.
+ */
+void steg::Metrics::observe(const Stage stage, const std::uint64_t ns)
+{
+    if (!enabled()) {
+        return;
+    }
+
+    std::size_t i = 0;
+    while (i != std::size(kBounds) && ns > kBounds[i]) {
+        ++i;
+    }
+
+    Histogram& histogram = local().stages[static_cast<std::size_t>(stage)];
+    bump(histogram.buckets[i], 1);
+    bump(histogram.sumNs, ns);
+}
+
+/*! Registers a gauge.
+ */
+std::uint64_t steg::Metrics::add_gauge(const char* name,
+                                       const char* help,
+                                       std::string label,
+                                       std::function<double()> read)
+{
+    Registry& reg = registry();
+    std::lock_guard lock(reg.mutex);
+
+    Gauge& gauge = reg.gauges.emplace_back();
+    gauge.id = reg.nextGauge++;
+    gauge.name = name;
+    gauge.help = help;
+    gauge.label = std::move(label);
+    gauge.read = std::move(read);
+    return gauge.id;
+}
+
+/*! Unregisters a gauge.
+ */
+void steg::Metrics::remove_gauge(const std::uint64_t id)
+{
+    Registry& reg = registry();
+    std::lock_guard lock(reg.mutex);
+
+    std::erase_if(reg.gauges, [id](const Gauge& gauge) {
+        return gauge.id == id;
+    });
+}
+
+/*! Sums every shard, in the Prometheus text format.
+ */
+std::string steg::Metrics::render()
+{
+    static constexpr const char* kHelp[kMetrics]
+        = {"Finished batch jobs and server requests.",
+           "Carrier and payload bytes read.",
+           "Encoded image and decoded payload bytes produced.",
+           "Ciphers reused from a key's pool.",
+           "Ciphers set up because a key's pool was empty.",
+           "Server connections accepted."};
+
+    Registry& reg = registry();
+    std::lock_guard lock(reg.mutex);
+
+    std::string out;
+    for (std::size_t m = 0; m != kMetrics; ++m) {
+        describe(out, kMetricNames[m], "counter", kHelp[m]);
+        const auto value
+            = total(reg, [m](const Shard& shard) -> const Cell& {
+                  return shard.metrics[m];
+              });
+        sample(out, kMetricNames[m], "", static_cast<double>(value));
+    }
+
+    describe(out, "job_errors_total", "counter", "Failed jobs, by status.");
+    for (std::size_t e = 0; e != kErrors; ++e) {
+        const auto value = total(reg, [e](const Shard& shard) -> const Cell& {
+            return shard.errors[e];
+        });
+        sample(out,
+               "job_errors_total",
+               std::string("status=\"") + kStatuses[e] + "\"",
+               static_cast<double>(value));
+    }
+
+    describe(out,
+             "stage_seconds",
+             "histogram",
+             "Time taken by each run of a stage.");
+    for (std::size_t s = 0; s != kStages; ++s) {
+        const std::string stage
+            = std::string("stage=\"") + Stats::stage_name(static_cast<Stage>(s))
+              + "\"";
+
+        std::uint64_t cumulative = 0;
+        for (std::size_t b = 0; b != kBuckets; ++b) {
+            cumulative += total(reg, [s, b](const Shard& shard) -> const Cell& {
+                return shard.stages[s].buckets[b];
+            });
+
+            char bound[32] = "+Inf";
+            if (b != std::size(kBounds)) {
+                std::snprintf(bound,
+                              sizeof(bound),
+                              "%g",
+                              static_cast<double>(kBounds[b]) / 1e9);
+            }
+
+            sample(out,
+                   "stage_seconds_bucket",
+                   stage + ",le=\"" + bound + "\"",
+                   static_cast<double>(cumulative));
+        }
+
+        const auto sumNs = total(reg, [s](const Shard& shard) -> const Cell& {
+            return shard.stages[s].sumNs;
+        });
+        sample(out,
+               "stage_seconds_sum",
+               stage,
+               static_cast<double>(sumNs) / 1e9);
+        sample(out,
+               "stage_seconds_count",
+               stage,
+               static_cast<double>(cumulative));
+    }
+
+    // Gauges of one name go together, under one HELP/TYPE header
+    std::vector<const Gauge*> gauges;
+    for (const Gauge& gauge: reg.gauges) {
+        gauges.push_back(&gauge);
+    }
+
+    std::stable_sort(
+        gauges.begin(), gauges.end(), [](const Gauge* a, const Gauge* b) {
+            return std::strcmp(a->name, b->name) < 0;
+        });
+
+    for (std::size_t i = 0; i != gauges.size(); ++i) {
+        if (i == 0 || std::strcmp(gauges[i]->name, gauges[i - 1]->name) != 0) {
+            describe(out, gauges[i]->name, "gauge", gauges[i]->help);
+        }
+
+        sample(out, gauges[i]->name, gauges[i]->label, gauges[i]->read());
+    }
+
+    return out;
+}
+
+/*! Creates a new exporter and starts it.
+ */
+steg::MetricsExporter* steg::MetricsExporter::create(const char* target,
+                                                     const unsigned interval)
+{
+    std::unique_ptr<MetricsExporter> exporter(new MetricsExporter);
+
+    constexpr const char* kUnix = "unix:";
+    const bool socket = std::strncmp(target, kUnix, std::strlen(kUnix)) == 0;
+    exporter->path_ = socket ? target + std::strlen(kUnix) : target;
+
+    if (exporter->path_.empty()) {
+        Log::error("No metrics path given");
+        return nullptr;
+    }
+
+    Metrics::enable();
+
+    if (socket) {
+        exporter->listener_ = listen_on(exporter->path_.c_str());
+        if (exporter->listener_ < 0) {
+            return nullptr;
+        }
+
+        exporter->thread_
+            = std::thread(&MetricsExporter::serve, exporter.get());
+        return exporter.release();
+    }
+
+    // Fail now, not on the first dump, if the file cannot be written
+    if (!exporter->dump()) {
+        return nullptr;
+    }
+
+    exporter->thread_ = std::thread(&MetricsExporter::dump_every,
+                                    exporter.get(),
+                                    interval == 0 ? 1 : interval);
+    return exporter.release();
+}
+
+/*! Dtor.
+ */
+steg::MetricsExporter::~MetricsExporter()
+{
+    {
+        std::lock_guard lock(mutex_);
+        stop_ = true;
+    }
+
+    wake_.notify_all();
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+
+    if (listener_ >= 0) {
+        ::close(listener_);
+        ::unlink(path_.c_str());
+    } else {
+        dump();
+    }
+}
+
+/*! Writes the metrics to a temporary file, renamed over path_ so that
+    readers never see half of it.
+ */
+bool steg::MetricsExporter::dump() const
+{
+    const std::string text = Metrics::render();
+    const std::string temp = path_ + ".tmp";
+
+    std::FILE* file = std::fopen(temp.c_str(), "w");
+    if (file == nullptr) {
+        Log::error("Unable to open", temp.c_str(), std::strerror(errno));
+        return false;
+    }
+
+    const bool written = std::fwrite(text.data(), 1, text.size(), file)
+                         == text.size();
+    if (std::fclose(file) != 0 || !written
+        || std::rename(temp.c_str(), path_.c_str()) != 0) {
+        Log::error("Unable to write", path_.c_str(), std::strerror(errno));
+        std::remove(temp.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+/*! Answers every connection with one scrape, then hangs up.
+ */
+void steg::MetricsExporter::serve()
+{
+    // Checks for stop_ between waits
+    constexpr int kPollMs = 200;
+
+    for (;;) {
+        {
+            std::lock_guard lock(mutex_);
+            if (stop_) {
+                return;
+            }
+        }
+
+        pollfd pfd = {.fd = listener_, .events = POLLIN, .revents = 0};
+        if (::poll(&pfd, 1, kPollMs) <= 0) {
+            continue;
+        }
+
+        const int fd = ::accept4(listener_, nullptr, nullptr, SOCK_CLOEXEC);
+        if (fd < 0) {
+            continue;
+        }
+
+        const std::string text = Metrics::render();
+        for (std::size_t sent = 0; sent != text.size();) {
+            const ssize_t n = ::send(
+                fd, text.data() + sent, text.size() - sent, MSG_NOSIGNAL);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+
+            if (n <= 0) {
+                break;
+            }
+
+            sent += static_cast<std::size_t>(n);
+        }
+
+        ::close(fd);
+    }
+}
+
+/*! Dumps the metrics every interval seconds until stopped.
+ */
+void steg::MetricsExporter::dump_every(const unsigned interval)
+{
+    std::unique_lock lock(mutex_);
+    auto stopped = [this] {
+        return stop_;
+    };
+
+    while (!wake_.wait_for(lock, std::chrono::seconds(interval), stopped)) {
+        lock.unlock();
+        dump();
+        lock.lock();
+    }
+}
@@ -0,0 +1,144 @@
+/* metrics.hpp -- v1.0
+   Counters and per-stage latency histograms for --metrics, exported in the
+   Prometheus text format. Each thread updates its own shard of plain
+   relaxed atomics, never contended; a scrape adds the shards up. Gauges,
+   such as queue depths, are read by callback at scrape time. A disabled
+   update costs one flag check */
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+
+namespace steg {
+    // Fwd. decl.
+    enum class Stage : std::uint8_t;
+
+    //! Counted events
+    enum class Metric : std::uint8_t {
+        kJobs, // Finished batch jobs and server requests
+        kBytesIn, // Carrier and payload bytes taken in
+        kBytesOut, // Image and payload bytes handed back
+        kPoolHits, // Ciphers reused from a context's pool
+        kPoolMisses, // Ciphers set up because the pool was empty
+        kConnections, // Server connections accepted
+        kCount
+    };
+
+    //! @class Metrics
+    //! Shards of every thread, and the registered gauges
+    class Metrics {
+    public:
+        //! @return true once enable() has been called
+        static bool enabled()
+        {
+            return enabled_.load(std::memory_order_relaxed);
+        }
+
+        //! Starts counting
+        static void enable();
+
+        //! Adds to a counter
+        static void add(Metric metric, std::uint64_t n = 1);
+
+        //! Counts a finished job, and its error if it failed
+        //! @param status "ok" or the failed stage, such as "load-failed"
+        static void job(const char* status);
+
+        //! Adds one run of a stage to its latency histogram
+        //! @param ns time taken, in nanoseconds
+        static void observe(Stage stage, std::uint64_t ns);
+
+        //! Registers a gauge, read on every scrape until removed
+        //! @param name metric name, without the steg_ prefix
+        //! @param help description, a literal
+        //! @param label label pair, such as queue="load", or empty
+        //! @param read returns the current value
+        //! @return id for remove_gauge()
+        static std::uint64_t add_gauge(const char* name,
+                                       const char* help,
+                                       std::string label,
+                                       std::function<double()> read);
+
+        //! Unregisters a gauge
+        static void remove_gauge(std::uint64_t id);
+
+        //! @return every metric, in the Prometheus text format
+        static std::string render();
+    private:
+        static std::atomic<bool> enabled_;
+    };
+
+    //! @class MetricsGauge
+    //! Registers a gauge for a scope
+    class MetricsGauge {
+    public:
+        //! Ctor. See Metrics::add_gauge()
+        MetricsGauge(const char* name,
+                     const char* help,
+                     std::string label,
+                     std::function<double()> read)
+            : id_(Metrics::enabled()
+                      ? Metrics::add_gauge(
+                            name, help, std::move(label), std::move(read))
+                      : 0)
+        {}
+
+        //! Dtor. Unregisters the gauge
+        ~MetricsGauge()
+        {
+            if (id_ != 0) {
+                Metrics::remove_gauge(id_);
+            }
+        }
+
+        // Non-copyable object
+        MetricsGauge(const MetricsGauge&) = delete;
+        MetricsGauge& operator=(const MetricsGauge&) = delete;
+    private:
+        std::uint64_t id_;
+    };
+
+    //! @class MetricsExporter
+    //! Publishes Metrics::render() from a background thread, either served
+    //! to every client of a UNIX socket or dumped to a file periodically
+    class MetricsExporter {
+    public:
+        //! Creates a new exporter and starts it; enables the metrics
+        //! @param target "unix:<path>" for a socket, a file path otherwise
+        //! @param interval seconds between file dumps
+        //! @return new instance, nullptr on error
+        static MetricsExporter* create(const char* target, unsigned interval);
+
+        //! Dtor. Stops; a file gets one last dump
+        ~MetricsExporter();
+
+        // Non-copyable object
+        MetricsExporter(const MetricsExporter&) = delete;
+        MetricsExporter& operator=(const MetricsExporter&) = delete;
+    private:
+        MetricsExporter() = default;
+
+        // Writes the metrics to path_, through a file renamed into place
+        bool dump() const;
+
+        // Thread bodies of the two kinds of target
+        void serve();
+        void dump_every(unsigned interval);
+
+        std::string path_;
+        int listener_ = -1;
+
+        std::mutex mutex_;
+        std::condition_variable wake_;
+        bool stop_ = false;
+
+        std::thread thread_;
+    };
+} // namespace steg
@@ -0,0 +1,23 @@
+/* multiversion.hpp -- v1.0
+   Function multiversioning of kernels that measure faster for it, so far
+   pixel embedding only (embed_pixels() in image.cpp): with
+   STEG_MULTIVERSION (see CMakeLists.txt) on x86-64, a function marked
+   STEG_TARGET_CLONES is compiled once per instruction set below, and the
+   loader picks the best one the CPU supports through an ifunc. Elsewhere
+   the mark is empty */
+
+#pragma once
+
+#if defined(STEG_MULTIVERSION) && defined(__x86_64__)                          \
+    && defined(__has_attribute)
+#if __has_attribute(target_clones)
+// AVX-512 (x86-64-v4), AVX2 (x86-64-v3), and baseline x86-64
+#define STEG_TARGET_CLONES                                                     \
+    __attribute__((target_clones(                                              \
+        "arch=x86-64-v4", "arch=x86-64-v3", "default")))
+#endif
+#endif
+
+#ifndef STEG_TARGET_CLONES
+#define STEG_TARGET_CLONES
+#endif
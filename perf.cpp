@@ -0,0 +1,128 @@
+/* perf.cpp -- v1.0 */
+
+#include "perf.hpp"
+#include <cstring>
+#include <iterator>
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace {
+    constexpr std::size_t kEvents
+        = static_cast<std::size_t>(steg::PerfEvent::kCount);
+
+    // perf_event_attr config of each event, in PerfEvent order
+    constexpr std::uint64_t kConfigs[kEvents] = {PERF_COUNT_HW_CPU_CYCLES,
+                                                 PERF_COUNT_HW_INSTRUCTIONS,
+                                                 PERF_COUNT_HW_CACHE_MISSES,
+                                                 PERF_COUNT_HW_BRANCH_MISSES};
+
+    // Helper: opens one counter of the calling thread, user space only
+    int open_event(const std::uint64_t config, const int group)
+    {
+        perf_event_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = config;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_GROUP;
+
+        return static_cast<int>(
+            ::syscall(SYS_perf_event_open, &attr, 0, -1, group, 0));
+    }
+
+    //! @class Group
+    //! Counters of one thread, read together through the cycles counter
+    class Group {
+    public:
+        ~Group()
+        {
+            for (const int fd: fds_) {
+                if (fd != -1) {
+                    ::close(fd);
+                }
+            }
+        }
+
+        //! Opens the counters, once
+        bool open()
+        {
+            if (tried_) {
+                return fds_[0] != -1;
+            }
+
+            tried_ = true;
+            for (std::size_t i = 0; i != kEvents; ++i) {
+                fds_[i] = open_event(kConfigs[i], i == 0 ? -1 : fds_[0]);
+                if (fds_[i] != -1) {
+                    members_[count_++] = i;
+                } else if (i == 0) {
+                    return false; // No cycles, no group
+                }
+            }
+
+            return true;
+        }
+
+        //! Reads every counter in one call
+        bool read(steg::PerfSample& sample)
+        {
+            if (!open()) {
+                return false;
+            }
+
+            // nr, then one value per member, in the order they were opened
+            std::uint64_t buff[1 + kEvents];
+            const ssize_t n = ::read(fds_[0], buff, sizeof(buff));
+            const std::size_t want = sizeof(std::uint64_t) * (1 + count_);
+            if (n < static_cast<ssize_t>(want)) {
+                return false;
+            }
+
+            for (std::size_t i = 0; i != count_; ++i) {
+                sample.values[members_[i]] = buff[1 + i];
+            }
+
+            return true;
+        }
+    private:
+        int fds_[kEvents] = {-1, -1, -1, -1};
+        std::size_t members_[kEvents] = {};
+        std::size_t count_ = 0;
+        bool tried_ = false;
+    };
+
+    // Helper: counters of the calling thread
+    Group& local()
+    {
+        thread_local Group group;
+        return group;
+    }
+} // namespace
+
+/*! Opens the counters of the calling thread.
+ */
+bool steg::perf_open()
+{
+    return local().open();
+}
+
+/*! Reads the counters of the calling thread.
+ */
+bool steg::perf_read(PerfSample& sample)
+{
+    return local().read(sample);
+}
+
+/*! Name of an event.
+ */
+const char* steg::perf_event_name(const PerfEvent event)
+{
+    static constexpr const char* kNames[]
+        = {"cycles", "instructions", "cache_misses", "branch_misses"};
+
+    static_assert(std::size(kNames) == kEvents);
+    return kNames[static_cast<std::size_t>(event)];
+}
@@ -0,0 +1,38 @@
+/* perf.hpp -- v1.0
+   Hardware performance counters of the calling thread, read with
+   perf_event_open(2) around the --stats stages */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace steg {
+    //! Counted hardware events
+    enum class PerfEvent : std::uint8_t {
+        kCycles,
+        kInstructions,
+        kCacheMisses,
+        kBranchMisses,
+        kCount
+    };
+
+    //! @bag PerfSample
+    //! Counter values; events the machine does not count stay 0
+    struct PerfSample {
+        std::uint64_t values[static_cast<std::size_t>(PerfEvent::kCount)] = {};
+    };
+
+    //! Opens the counters of the calling thread, if not open yet
+    //! @return false if the kernel refuses them (no PMU, seccomp, or
+    //! perf_event_paranoid too strict)
+    bool perf_open();
+
+    //! Reads the counters of the calling thread, opening them on first use
+    //! @param sample[out] counts since the counters were opened
+    //! @return false if they are unavailable
+    bool perf_read(PerfSample& sample);
+
+    //! @return name of an event
+    const char* perf_event_name(PerfEvent event);
+} // namespace steg
@@ -0,0 +1,339 @@
+/* protocol.cpp -- v1.0 */
+
+#include "protocol.hpp"
+#include "log.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <memory>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <utility>
+
+namespace {
+    // Initial frame buffer, doubled as more of the frame arrives
+    constexpr std::size_t kFrameChunk = std::size_t{1} << 16;
+
+    // Helper: stores a big-endian integer
+    template <typename T>
+    void put(unsigned char* ptr, T value)
+    {
+        for (std::size_t i = sizeof(T); i != 0; --i) {
+            ptr[i - 1] = static_cast<unsigned char>(value & 0xff);
+            value = static_cast<T>(value >> 8);
+        }
+    }
+
+    // Helper: consumes a big-endian integer from a frame
+    template <typename T>
+    bool get(const steg::IoBuffer& frame, std::size_t& pos, T& value)
+    {
+        if (frame.size - pos < sizeof(T)) {
+            return false;
+        }
+
+        value = 0;
+        for (std::size_t i = 0; i != sizeof(T); ++i) {
+            value = static_cast<T>((value << 8) | frame.data[pos++]);
+        }
+
+        return true;
+    }
+
+    // Helper: consumes a length-prefixed field from a frame
+    template <typename T>
+    bool get_field(const steg::IoBuffer& frame,
+                   std::size_t& pos,
+                   std::string_view& field)
+    {
+        T size = 0;
+        if (!get(frame, pos, size) || frame.size - pos < size) {
+            return false;
+        }
+
+        field = {reinterpret_cast<const char*>(frame.data.get() + pos), size};
+        pos += size;
+        return true;
+    }
+
+    // Helper: reads exactly size bytes
+    bool read_all(const int fd, unsigned char* buff, std::size_t size)
+    {
+        while (size != 0) {
+            ssize_t n = ::read(fd, buff, size);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+
+            if (n <= 0) {
+                return false;
+            }
+
+            buff += n;
+            size -= static_cast<std::size_t>(n);
+        }
+
+        return true;
+    }
+
+    // Helper: reads one frame
+    bool read_frame(const int fd, steg::IoBuffer& frame)
+    {
+        unsigned char prefix[4];
+        if (!read_all(fd, prefix, sizeof(prefix))) {
+            return false;
+        }
+
+        std::uint32_t size = 0;
+        for (const unsigned char byte: prefix) {
+            size = (size << 8) | byte;
+        }
+
+        // Refuse to allocate for garbage
+        if (size > steg::kMaxFrameSize) {
+            return false;
+        }
+
+        // The buffer grows with the bytes that actually arrive, so a bare
+        // length prefix cannot make the server allocate the whole frame
+        std::size_t capacity = std::min<std::size_t>(size, kFrameChunk);
+        frame.data.reset(new unsigned char[capacity]);
+        frame.size = 0;
+
+        while (frame.size != size) {
+            if (frame.size == capacity) {
+                capacity = std::min<std::size_t>(size, capacity * 2);
+                std::unique_ptr<unsigned char[]> grown(
+                    new unsigned char[capacity]);
+                std::memcpy(grown.get(), frame.data.get(), frame.size);
+                frame.data = std::move(grown);
+            }
+
+            const std::size_t n = capacity - frame.size;
+            if (!read_all(fd, frame.data.get() + frame.size, n)) {
+                return false;
+            }
+
+            frame.size += n;
+        }
+
+        return true;
+    }
+
+    // Helper: sends a frame gathered from iov, resuming after short writes;
+    // the first entry must be the 4-byte length prefix
+    bool write_frame(const int fd, iovec* iov, int iovcnt)
+    {
+        std::size_t size = 0;
+        for (int i = 1; i != iovcnt; ++i) {
+            size += iov[i].iov_len;
+        }
+
+        if (size > steg::kMaxFrameSize) {
+            return false;
+        }
+
+        put(static_cast<unsigned char*>(iov[0].iov_base),
+            static_cast<std::uint32_t>(size));
+
+        while (iovcnt != 0) {
+            if (iov->iov_len == 0) {
+                ++iov;
+                --iovcnt;
+                continue;
+            }
+
+            msghdr msg = {};
+            msg.msg_iov = iov;
+            msg.msg_iovlen = static_cast<std::size_t>(iovcnt);
+
+            // Peer hanging up is an error, not a signal
+            ssize_t n = ::sendmsg(fd, &msg, MSG_NOSIGNAL);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+
+            if (n < 0) {
+                return false;
+            }
+
+            for (auto left = static_cast<std::size_t>(n); left != 0;) {
+                std::size_t m = left < iov->iov_len ? left : iov->iov_len;
+                iov->iov_base = static_cast<char*>(iov->iov_base) + m;
+                iov->iov_len -= m;
+                left -= m;
+
+                if (iov->iov_len == 0) {
+                    ++iov;
+                    --iovcnt;
+                }
+            }
+        }
+
+        return true;
+    }
+} // namespace
+
+/*! Connects to a server.
+ */
+int steg::connect_to(const char* path)
+{
+    sockaddr_un addr = {};
+    addr.sun_family = AF_UNIX;
+
+    if (std::strlen(path) >= sizeof(addr.sun_path)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+
+    std::strcpy(addr.sun_path, path);
+
+    int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd >= 0
+        && ::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr))
+               != 0) {
+        const int error = errno;
+        ::close(fd);
+
+        errno = error;
+        fd = -1;
+    }
+
+    return fd;
+}
+
+/*! Binds and listens on a socket.
+ */
+int steg::listen_on(const char* path)
+{
+    sockaddr_un addr = {};
+    addr.sun_family = AF_UNIX;
+
+    if (std::strlen(path) >= sizeof(addr.sun_path)) {
+        Log::error("Socket path too long", path);
+        return -1;
+    }
+
+    std::strcpy(addr.sun_path, path);
+
+    // Only ever remove a socket, never a regular file
+    struct stat st = {};
+    if (::lstat(path, &st) == 0 && S_ISSOCK(st.st_mode)) {
+        ::unlink(path);
+    }
+
+    int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0
+        || ::bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0
+        || ::listen(fd, SOMAXCONN) != 0) {
+        Log::error("Unable to listen on", path, std::strerror(errno));
+        if (fd >= 0) {
+            ::close(fd);
+        }
+
+        return -1;
+    }
+
+    return fd;
+}
+
+/*! Reads and decodes a request.
+ */
+bool steg::read_request(const int fd, Request& req)
+{
+    if (!read_frame(fd, req.frame)) {
+        return false;
+    }
+
+    std::size_t pos = 0;
+    std::uint8_t type = 0;
+    std::uint8_t reserved = 0;
+
+    if (!get(req.frame, pos, req.op) || !get(req.frame, pos, req.flags)
+        || !get(req.frame, pos, type) || !get(req.frame, pos, reserved)
+        || !get_field<std::uint16_t>(req.frame, pos, req.keyId)
+        || !get_field<std::uint32_t>(req.frame, pos, req.carrier)
+        || !get_field<std::uint32_t>(req.frame, pos, req.payload)) {
+        return false;
+    }
+
+    if (type > static_cast<std::uint8_t>(Image::ImageType::kTga)) {
+        return false;
+    }
+
+    req.type = static_cast<Image::ImageType>(type);
+    return req.op == Request::kEncode || req.op == Request::kDecode;
+}
+
+/*! Encodes and sends a request.
+ */
+bool steg::write_request(const int fd, const Request& req)
+{
+    unsigned char prefix[4];
+    unsigned char head[6];
+    unsigned char carrierSize[4];
+    unsigned char payloadSize[4];
+
+    head[0] = req.op;
+    head[1] = req.flags;
+    head[2] = static_cast<unsigned char>(req.type);
+    head[3] = 0;
+    put(head + 4, static_cast<std::uint16_t>(req.keyId.size()));
+    put(carrierSize, static_cast<std::uint32_t>(req.carrier.size()));
+    put(payloadSize, static_cast<std::uint32_t>(req.payload.size()));
+
+    iovec iov[] = {
+        {.iov_base = prefix, .iov_len = sizeof(prefix)},
+        {.iov_base = head, .iov_len = sizeof(head)},
+        {.iov_base = const_cast<char*>(req.keyId.data()),
+         .iov_len = req.keyId.size()},
+        {.iov_base = carrierSize, .iov_len = sizeof(carrierSize)},
+        {.iov_base = const_cast<char*>(req.carrier.data()),
+         .iov_len = req.carrier.size()},
+        {.iov_base = payloadSize, .iov_len = sizeof(payloadSize)},
+        {.iov_base = const_cast<char*>(req.payload.data()),
+         .iov_len = req.payload.size()},
+    };
+
+    return write_frame(fd, iov, static_cast<int>(std::size(iov)));
+}
+
+/*! Reads and decodes a response.
+ */
+bool steg::read_response(const int fd, Response& res)
+{
+    if (!read_frame(fd, res.frame)) {
+        return false;
+    }
+
+    std::size_t pos = 0;
+    std::uint8_t reserved[3] = {};
+
+    return get(res.frame, pos, res.status) && get(res.frame, pos, reserved[0])
+           && get(res.frame, pos, reserved[1])
+           && get(res.frame, pos, reserved[2])
+           && get_field<std::uint32_t>(res.frame, pos, res.data);
+}
+
+/*! Encodes and sends a response.
+ */
+bool steg::write_response(const int fd,
+                          const std::uint8_t status,
+                          const void* data,
+                          const std::size_t size)
+{
+    unsigned char prefix[4];
+    unsigned char head[8] = {status, 0, 0, 0};
+    put(head + 4, static_cast<std::uint32_t>(size));
+
+    iovec iov[] = {
+        {.iov_base = prefix, .iov_len = sizeof(prefix)},
+        {.iov_base = head, .iov_len = sizeof(head)},
+        {.iov_base = const_cast<void*>(data), .iov_len = size},
+    };
+
+    return write_frame(fd, iov, static_cast<int>(std::size(iov)));
+}
@@ -0,0 +1,110 @@
+/* protocol.hpp -- v1.0
+   Length-prefixed request/response framing spoken over the server socket
+
+   Every message is a frame: a 32-bit big-endian body length, then the body.
+
+   Request body:
+     u8  op            1 = encode, 2 = decode
+     u8  flags         bit 0 = base64 payload, bit 1 = carrier is a path
+     u8  type          output image type (Image::ImageType), encode only
+     u8  reserved
+     u16 key id length, key id
+     u32 carrier length, carrier image file content (or path on the server);
+         empty on encode to have the server pick one from its carrier index
+     u32 payload length, payload (encode only)
+
+   Response body:
+     u8  status        0 = ok, 1 = error
+     u8  reserved[3]
+     u32 data length, data: encoded image or decoded payload, or the error
+         message */
+
+#pragma once
+
+#include "async_io.hpp"
+#include "image.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+namespace steg {
+    //! @class Request
+    //! A decoded request; the views point into frame
+    struct Request {
+        // Operations
+        static constexpr std::uint8_t kEncode = 1;
+        static constexpr std::uint8_t kDecode = 2;
+
+        // Flags
+        static constexpr std::uint8_t kBase64 = 1 << 0;
+        static constexpr std::uint8_t kCarrierPath = 1 << 1;
+
+        std::uint8_t op = 0;
+        std::uint8_t flags = 0;
+        Image::ImageType type = Image::ImageType::kPng;
+
+        std::string_view keyId;
+        std::string_view carrier;
+        std::string_view payload;
+
+        // Backing storage
+        IoBuffer frame;
+    };
+
+    //! @class Response
+    //! A decoded response; data points into frame
+    struct Response {
+        // Statuses
+        static constexpr std::uint8_t kOk = 0;
+        static constexpr std::uint8_t kError = 1;
+
+        std::uint8_t status = kError;
+        std::string_view data;
+
+        // Backing storage
+        IoBuffer frame;
+    };
+
+    //! Largest frame accepted
+    constexpr std::size_t kMaxFrameSize = std::size_t{1} << 30;
+
+    //! Connects to a server
+    //! @param path path/to/socket
+    //! @return connected socket, -1 on error
+    int connect_to(const char* path);
+
+    //! Binds and listens on a socket, replacing a stale one left by a
+    //! previous run
+    //! @param path path/to/socket
+    //! @return listening socket, -1 on error
+    int listen_on(const char* path);
+
+    //! Reads and decodes a request
+    //! @param fd connected socket
+    //! @param req[out] request
+    //! @return false on EOF, I/O error or malformed request
+    bool read_request(int fd, Request& req);
+
+    //! Encodes and sends a request
+    //! @param fd connected socket
+    //! @param req request; frame is ignored
+    //! @return false on I/O error
+    bool write_request(int fd, const Request& req);
+
+    //! Reads and decodes a response
+    //! @param fd connected socket
+    //! @param res[out] response
+    //! @return false on EOF, I/O error or malformed response
+    bool read_response(int fd, Response& res);
+
+    //! Encodes and sends a response
+    //! @param fd connected socket
+    //! @param status Response::kOk or Response::kError
+    //! @param data response data
+    //! @param size size of data
+    //! @return false on I/O error
+    bool write_response(int fd,
+                        std::uint8_t status,
+                        const void* data,
+                        std::size_t size);
+} // namespace steg
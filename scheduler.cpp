@@ -0,0 +1,370 @@
+/* scheduler.cpp -- v1.0 */
+
+#include "scheduler.hpp"
+#include "stats.hpp"
+#include "trace.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sched.h>
+#include <string>
+#include <utility>
+
+namespace {
+    // Calling worker, if any
+    thread_local steg::Scheduler* tlsScheduler = nullptr;
+    thread_local std::size_t tlsIndex = 0;
+
+    // Look for work this many times before going to sleep
+    constexpr int kSpins = 64;
+
+    // Helper: reads a cgroup v2 "quota period" (or "max period") file
+    bool read_cpu_max(const std::string& path, double& cpus)
+    {
+        std::FILE* file = std::fopen(path.c_str(), "r");
+        if (file == nullptr) {
+            return false;
+        }
+
+        char quota[32] = {};
+        unsigned long period = 0;
+        const bool ok = std::fscanf(file, "%31s %lu", quota, &period) == 2;
+        std::fclose(file);
+
+        if (!ok || period == 0 || std::strcmp(quota, "max") == 0) {
+            return false;
+        }
+
+        cpus = std::strtod(quota, nullptr) / static_cast<double>(period);
+        return cpus > 0;
+    }
+
+    // Helper: reads a cgroup v1 quota and period pair
+    bool read_cfs_quota(const std::string& dir, double& cpus)
+    {
+        long quota = -1;
+        long period = 0;
+
+        std::FILE* file = std::fopen((dir + "/cpu.cfs_quota_us").c_str(), "r");
+        if (file == nullptr) {
+            return false;
+        }
+
+        const bool hasQuota = std::fscanf(file, "%ld", &quota) == 1;
+        std::fclose(file);
+
+        file = std::fopen((dir + "/cpu.cfs_period_us").c_str(), "r");
+        if (file == nullptr) {
+            return false;
+        }
+
+        const bool hasPeriod = std::fscanf(file, "%ld", &period) == 1;
+        std::fclose(file);
+
+        if (!hasQuota || !hasPeriod || quota <= 0 || period <= 0) {
+            return false;
+        }
+
+        cpus = static_cast<double>(quota) / static_cast<double>(period);
+        return true;
+    }
+
+    // Helper: this process's cgroup v2 directory, from /proc/self/cgroup
+    std::string cgroup_dir()
+    {
+        std::FILE* file = std::fopen("/proc/self/cgroup", "r");
+        if (file == nullptr) {
+            return {};
+        }
+
+        std::string dir;
+        char line[512];
+        while (std::fgets(line, sizeof(line), file) != nullptr) {
+            if (std::strncmp(line, "0::", 3) == 0) {
+                dir.assign(line + 3);
+                dir.erase(dir.find_last_not_of("\n") + 1);
+                break;
+            }
+        }
+
+        std::fclose(file);
+        return dir;
+    }
+} // namespace
+
+/*! CPUs this process may run on.
+ */
+unsigned steg::available_cpus()
+{
+    unsigned cpus = std::max(std::thread::hardware_concurrency(), 1U);
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (::sched_getaffinity(0, sizeof(set), &set) == 0) {
+        cpus = static_cast<unsigned>(std::max(CPU_COUNT(&set), 1));
+    }
+
+    // A CPU quota caps the useful number of threads, rounded up
+    double quota = 0;
+    const std::string dir = cgroup_dir();
+    const std::string cpuMax = "/sys/fs/cgroup" + dir + "/cpu.max";
+    if ((!dir.empty() && read_cpu_max(cpuMax, quota))
+        || read_cpu_max("/sys/fs/cgroup/cpu.max", quota)
+        || read_cfs_quota("/sys/fs/cgroup/cpu", quota)
+        || read_cfs_quota("/sys/fs/cgroup/cpu,cpuacct", quota)) {
+        const auto limit = static_cast<unsigned>(quota + 0.999);
+        cpus = std::clamp(limit, 1U, cpus);
+    }
+
+    return cpus;
+}
+
+steg::Scheduler::Scheduler(unsigned threads)
+{
+    if (threads == 0) {
+        threads = available_cpus();
+    }
+
+    for (unsigned i = 0; i != threads; ++i) {
+        workers_.push_back(std::make_unique<Worker>());
+    }
+
+    // Every deque exists before any worker may steal from it
+    for (std::size_t i = 0; i != workers_.size(); ++i) {
+        workers_[i]->thread = std::thread([this, i] {
+            work(i);
+        });
+    }
+}
+
+steg::Scheduler::~Scheduler()
+{
+    {
+        std::lock_guard lock(mutex_);
+        stop_ = true;
+    }
+
+    wake_.notify_all();
+    for (const std::unique_ptr<Worker>& worker: workers_) {
+        worker->thread.join();
+    }
+}
+
+/*! Queues a task.
+ */
+void steg::Scheduler::spawn(Task task)
+{
+    push(new Job{.task = std::move(task), .group = nullptr});
+}
+
+/*! Runs a task on the workers and waits for it.
+ */
+void steg::Scheduler::run(Task task)
+{
+    Group group;
+    group.pending = 1;
+
+    push(new Job{.task = std::move(task), .group = &group});
+    wait(group);
+}
+
+/*! Splits [0, n) into pieces and runs them in parallel.
+ */
+void steg::Scheduler::parallel_for(
+    const std::size_t n,
+    std::size_t grain,
+    const std::function<void(std::size_t, std::size_t)>& fn)
+{
+    grain = std::max(grain, std::size_t{1});
+    if (n <= grain || workers_.size() == 1) {
+        fn(0, n);
+        return;
+    }
+
+    // Pieces belong to the caller's stage and job, on whichever worker
+    // runs them, and count their own hardware events there
+    const Stage stage = Stats::current();
+    const std::uint64_t tag = Trace::job();
+
+    auto piece = [&fn, stage, tag](const std::size_t begin,
+                                   const std::size_t end) {
+        const Stage previous = Stats::exchange(stage);
+        const TraceJob job(tag);
+        const TraceScope scope(Stats::piece_name(stage));
+        {
+            const StagePerf perf(stage);
+            fn(begin, end);
+        }
+
+        Stats::exchange(previous);
+    };
+
+    // Later pieces are stolen while this thread runs the first one
+    const std::size_t pieces = (n + grain - 1) / grain;
+
+    Group group;
+    group.pending = pieces - 1;
+
+    for (std::size_t i = 1; i != pieces; ++i) {
+        const std::size_t begin = i * grain;
+        const std::size_t end = std::min(begin + grain, n);
+
+        push(new Job{.task = [&piece, begin, end] { piece(begin, end); },
+                     .group = &group});
+    }
+
+    // Held out of the caller's stage, which would otherwise count its own
+    // piece twice and the stolen jobs of other stages as its own
+    const PerfHold hold;
+    piece(0, grain);
+    wait(group);
+}
+
+/*! Scheduler of the calling worker.
+ */
+steg::Scheduler* steg::Scheduler::current()
+{
+    return tlsScheduler;
+}
+
+/*! Worker main loop.
+ */
+void steg::Scheduler::work(const std::size_t index)
+{
+    tlsScheduler = this;
+    tlsIndex = index;
+
+    for (;;) {
+        Job* job = nullptr;
+        for (int spin = 0; job == nullptr && spin != kSpins; ++spin) {
+            job = find(index, true);
+            if (job == nullptr) {
+                std::this_thread::yield();
+            }
+        }
+
+        if (job != nullptr) {
+            execute(job);
+            continue;
+        }
+
+        std::unique_lock lock(mutex_);
+        if (stop_ && queued_ == 0) {
+            return;
+        }
+
+        ++sleepers_;
+        wake_.wait(lock, [this] {
+            return stop_ || queued_ != 0;
+        });
+        --sleepers_;
+    }
+}
+
+/*! Queues a job on the calling worker, or on the shared queue.
+ */
+void steg::Scheduler::push(Job* job)
+{
+    ++queued_;
+
+    if (tlsScheduler == this) {
+        workers_[tlsIndex]->deque.push(job);
+    } else {
+        std::lock_guard lock(mutex_);
+        inbox_.push_back(job);
+    }
+
+    // Taking the lock orders this against a worker about to sleep
+    if (sleepers_ != 0) {
+        std::lock_guard lock(mutex_);
+        wake_.notify_one();
+    }
+}
+
+/*! Finds a job.
+ */
+steg::Scheduler::Job* steg::Scheduler::find(const std::size_t index,
+                                            const bool inbox)
+{
+    if (queued_ == 0) {
+        return nullptr;
+    }
+
+    const std::size_t n = workers_.size();
+
+    Job* job = workers_[index]->deque.pop();
+    for (std::size_t i = 1; job == nullptr && i != n; ++i) {
+        job = workers_[(index + i) % n]->deque.steal();
+    }
+
+    if (job == nullptr && inbox) {
+        std::lock_guard lock(mutex_);
+        if (!inbox_.empty()) {
+            job = inbox_.front();
+            inbox_.pop_front();
+        }
+    }
+
+    if (job != nullptr) {
+        --queued_;
+    }
+
+    return job;
+}
+
+/*! Runs a job and signals its group.
+ */
+void steg::Scheduler::execute(Job* job)
+{
+    Group* group = job->group;
+    job->task();
+    delete job;
+
+    // Under the lock, so the waiter cannot free the group under us
+    if (group != nullptr) {
+        std::lock_guard lock(group->mutex);
+        if (--group->pending == 0) {
+            group->done.notify_all();
+        }
+    }
+}
+
+/*! Waits for a group, running other jobs meanwhile on a worker.
+ */
+void steg::Scheduler::wait(Group& group)
+{
+    if (tlsScheduler == this) {
+        while (group.pending != 0) {
+            if (Job* job = find(tlsIndex, false); job != nullptr) {
+                execute(job);
+            } else {
+                std::this_thread::yield();
+            }
+        }
+
+        // The last finisher may still hold the lock
+        std::lock_guard lock(group.mutex);
+        return;
+    }
+
+    std::unique_lock lock(group.mutex);
+    group.done.wait(lock, [&group] {
+        return group.pending == 0;
+    });
+}
+
+/*! parallel_for() on the calling worker's scheduler.
+ */
+void steg::parallel_for(
+    const std::size_t n,
+    const std::size_t grain,
+    const std::function<void(std::size_t, std::size_t)>& fn)
+{
+    if (Scheduler* scheduler = Scheduler::current(); scheduler != nullptr) {
+        scheduler->parallel_for(n, grain, fn);
+        return;
+    }
+
+    fn(0, n);
+}
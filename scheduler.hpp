@@ -0,0 +1,120 @@
+/* scheduler.hpp -- v1.0
+   Work-stealing task scheduler under the batch and server modes */
+
+#pragma once
+
+#include "work_deque.hpp"
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace steg {
+    //! @return CPUs this process may run on, from its affinity mask and
+    //! cgroup CPU quota (v1 or v2); at least 1
+    unsigned available_cpus();
+
+    //! @class Scheduler
+    //! Fixed set of workers, each with its own lock-free deque. Tasks
+    //! spawned by a worker go on its deque and are run newest first; idle
+    //! workers steal the oldest tasks of others, then take tasks submitted
+    //! from outside. Large jobs split themselves with parallel_for(), so the
+    //! pieces of one big job spread over every idle worker
+    class Scheduler {
+    public:
+        using Task = std::function<void()>;
+
+        //! Ctor.
+        //! @param threads number of workers, 0 for available_cpus()
+        explicit Scheduler(unsigned threads = 0);
+
+        //! Dtor. Runs the remaining tasks, then joins the workers
+        ~Scheduler();
+
+        // Non-copyable object
+        Scheduler(const Scheduler&) = delete;
+        Scheduler& operator=(const Scheduler&) = delete;
+
+        //! Queues a task
+        void spawn(Task task);
+
+        //! Runs a task on the workers and waits for it; workers calling this
+        //! run other tasks while they wait
+        void run(Task task);
+
+        //! Calls fn(begin, end) over [0, n) split into pieces of about grain
+        //! items, in parallel, and waits for all of them
+        void parallel_for(
+            std::size_t n,
+            std::size_t grain,
+            const std::function<void(std::size_t, std::size_t)>& fn);
+
+        //! @return number of workers
+        unsigned size() const
+        {
+            return static_cast<unsigned>(workers_.size());
+        }
+
+        //! @return scheduler whose worker is the calling thread, or nullptr
+        static Scheduler* current();
+    private:
+        // Tasks that finish together
+        struct Group {
+            std::atomic<std::size_t> pending = 0;
+            std::mutex mutex;
+            std::condition_variable done;
+        };
+
+        // @bag
+        struct Job {
+            Task task;
+            Group* group = nullptr;
+        };
+
+        // @bag
+        struct Worker {
+            WorkDeque<Job> deque;
+            std::thread thread;
+        };
+
+        // Worker main loop
+        void work(std::size_t index);
+
+        // Queues a job on the calling worker, or on the shared queue
+        void push(Job* job);
+
+        // Finds a job: own deque, then stealing, then the shared queue
+        // unless inbox is false (waiting for pieces of a job should not
+        // start another job)
+        Job* find(std::size_t index, bool inbox);
+
+        // Runs a job and signals its group
+        void execute(Job* job);
+
+        // Runs other jobs, or sleeps, until the group is done
+        void wait(Group& group);
+
+        std::vector<std::unique_ptr<Worker>> workers_;
+
+        // Tasks submitted from outside the workers
+        std::mutex mutex_;
+        std::deque<Job*> inbox_;
+
+        // Jobs queued anywhere, and workers asleep waiting for one
+        alignas(64) std::atomic<std::size_t> queued_ = 0;
+        std::atomic<unsigned> sleepers_ = 0;
+        std::condition_variable wake_;
+        bool stop_ = false;
+    };
+
+    //! Scheduler::parallel_for() on the calling worker's scheduler; runs
+    //! fn(0, n) inline on any other thread
+    void parallel_for(std::size_t n,
+                      std::size_t grain,
+                      const std::function<void(std::size_t, std::size_t)>& fn);
+} // namespace steg
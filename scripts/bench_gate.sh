@@ -0,0 +1,51 @@
+#!/bin/bash
+# This script benchmarks two builds and fails if the second one is slower
+
+# Edit these -------------------------------------------------------------------
+# Specify the build directories of the baseline and of the candidate
+BASELINE="../build-baseline"
+CANDIDATE="../build"
+
+# Specify the runs of each suite; more runs give narrower intervals
+RUNS=5
+# Specify the minimum time per microbenchmark, in seconds
+MIN_SECONDS=0.25
+# Specify the end-to-end round trips per run and the thread counts
+JOBS=16
+THREADS="1,4"
+# Specify the confidence level and the slowdown ignored, as a fraction
+CONFIDENCE=0.95
+THRESHOLD=0.05
+
+# ------------------------------------------------------------------------------
+set -e
+
+# Results go to baseline.*.jsonl and candidate.*.jsonl
+for SIDE in baseline candidate ;
+do
+    BUILD=${BASELINE}
+    if [ ${SIDE} == "candidate" ] ;
+    then
+        BUILD=${CANDIDATE}
+    fi
+
+    ${BUILD}/steg_bench -r ${RUNS} -t ${MIN_SECONDS} -o ${SIDE}.bench.jsonl
+    ${BUILD}/steg_e2e -r ${RUNS} -n ${JOBS} -T ${THREADS} -o ${SIDE}.e2e.jsonl
+done
+
+set +e
+STATUS=0
+
+# Run... keeping the worst status, 2 (bad input) over 1 (regression)
+for SUITE in bench e2e ;
+do
+    ${CANDIDATE}/steg_compare -c ${CONFIDENCE} -t ${THRESHOLD}\
+        baseline.${SUITE}.jsonl candidate.${SUITE}.jsonl
+    RESULT=$?
+    if [ ${RESULT} -gt ${STATUS} ] ;
+    then
+        STATUS=${RESULT}
+    fi
+done
+
+exit ${STATUS}
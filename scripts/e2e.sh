@@ -0,0 +1,48 @@
+#!/bin/bash
+# This script runs encode/decode round trips of the binary on synthetic
+# carriers and payloads, and prints their throughput
+
+# Edit these -------------------------------------------------------------------
+# Specify the path of the harness and of the binary executable
+HARNESS="../build/steg_e2e"
+APP="../build/steg"
+
+# Specify the round trips per thread count
+JOBS=16
+# Specify the comma separated thread counts
+THREADS="1,2,4"
+# Specify the carrier width, height, channels and filetype
+WIDTH=512
+HEIGHT=512
+CHANNELS=3
+FILE_TYPE="png"
+# Specify the payload size, in bytes, and its entropy, in bits per byte
+PAYLOAD_SIZE=8192
+ENTROPY=8
+# Specify the cipher mode, cbc / ctr
+MODE="cbc"
+# (Optional) Encode encrypted payload to base64, yes / no
+USEBASE64=
+# Specify the results filename
+OUTPUT_FILE="e2e.jsonl"
+
+# ------------------------------------------------------------------------------
+BASE64=""
+if [ ${USEBASE64} ] ;
+then
+    BASE64="-b"
+fi
+
+# Run...
+${HARNESS} -x ${APP}\
+           -n ${JOBS}\
+           -T ${THREADS}\
+           -W ${WIDTH}\
+           -H ${HEIGHT}\
+           -c ${CHANNELS}\
+           -t ${FILE_TYPE}\
+           -s ${PAYLOAD_SIZE}\
+           -e ${ENTROPY}\
+           -m ${MODE}\
+           -o ${OUTPUT_FILE}\
+           ${BASE64}
@@ -0,0 +1,34 @@
+#!/bin/bash
+# This script builds a profile-guided optimized release: an instrumented
+# build, a training run of the benchmarks, and a rebuild with the profiles
+
+# Edit these -------------------------------------------------------------------
+# Specify the source directory and the build directory; the profiles only
+# apply to the build directory they were recorded in
+SOURCE=".."
+BUILD="../build-pgo"
+
+# Specify the minimum time per microbenchmark, in seconds
+MIN_SECONDS=0.1
+# Specify the end-to-end round trips per run and the thread counts
+JOBS=16
+THREADS="1,4"
+
+# ------------------------------------------------------------------------------
+set -e
+
+# Instrumented build, with no stale profiles
+cmake -S ${SOURCE} -B ${BUILD} -DCMAKE_BUILD_TYPE=Release -DSTEG_PGO=generate
+cmake --build ${BUILD} -j
+rm -rf ${BUILD}/pgo
+
+# Training run, over the kernels and the whole binary, with and without base64
+${BUILD}/steg_bench -t ${MIN_SECONDS} -o /dev/null
+${BUILD}/steg_e2e -n ${JOBS} -T ${THREADS} -o /dev/null
+${BUILD}/steg_e2e -n ${JOBS} -T ${THREADS} -b -o /dev/null
+
+# Rebuild with the profiles
+cmake -S ${SOURCE} -B ${BUILD} -DSTEG_PGO=use
+cmake --build ${BUILD} -j
+
+echo "Done; compare ${BUILD} with a plain release build using bench_gate.sh"
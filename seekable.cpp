@@ -0,0 +1,306 @@
+/* seekable.cpp -- v1.0 */
+
+#include "seekable.hpp"
+#include "base64.hpp"
+#include "cipher.hpp"
+#include "cipher_ctl.hpp"
+#include "log.hpp"
+#include "stream.hpp"
+#include <algorithm>
+#include <cstring>
+#include <gcrypt.h>
+#include <span>
+#include <string>
+
+namespace {
+    constexpr char kMagic[4] = {'S', 'T', 'G', 'C'};
+    constexpr std::uint8_t kVersion = 2;
+
+    // Helper: base64 characters a stream of this many bytes encodes to
+    std::uint64_t base64_size(const std::uint64_t size)
+    {
+        return ((size + 2) / 3) * 4;
+    }
+
+    // Helper: true if every character is base64, so that decoding stays
+    // inside the lookup table
+    bool is_base64(const char* data, const std::size_t size)
+    {
+        return std::all_of(data, data + size, [](char c) {
+            return (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z')
+                   || (c >= '0' && c <= '9') || c == '+' || c == '/'
+                   || c == '=';
+        });
+    }
+
+    // Helper: reads bytes [begin, end) of the stored stream, undoing base64
+    // @param data[out] bytes [from, end)
+    // @param from[out] begin without base64; with it, the start of the
+    // base64 group holding begin
+    bool read_stored(const steg::Image& image,
+                     const std::uint64_t begin,
+                     const std::uint64_t end,
+                     const bool b64,
+                     std::unique_ptr<char[]>& data,
+                     std::uint64_t& from)
+    {
+        if (!b64) {
+            const auto size = static_cast<std::size_t>(end - begin);
+            data.reset(new char[size]);
+            from = begin;
+            return image.read(data.get(), begin, size) == size;
+        }
+
+        from = (begin / 3) * 3;
+
+        const auto first = static_cast<std::size_t>((from / 3) * 4);
+        const auto size = static_cast<std::size_t>(base64_size(end) - first);
+        data.reset(new char[size]);
+        if (image.read(data.get(), first, size) != size
+            || !is_base64(data.get(), size)) {
+            return false;
+        }
+
+        steg::base64_decode(data.get(), size);
+        return true;
+    }
+} // namespace
+
+/*! Factory method.
+ */
+steg::Seekable* steg::Seekable::create(const char* const key,
+                                       const char* const initvec)
+{
+    Cipher* cph = cipher_init(key, initvec, CipherMode::kCtr);
+    if (cph == nullptr) {
+        return nullptr;
+    }
+
+    return new Seekable(cph, initvec);
+}
+
+steg::Seekable::Seekable(Cipher* cph, const char* const initvec)
+    : Encoder(cph)
+    , vec_(new char[cph->length])
+{
+    std::memcpy(vec_.get(), initvec, cph->length);
+}
+
+/*! Encrypts a payload into a loaded carrier.
+ */
+const char* steg::Seekable::embed(Image& image,
+                                  const char* const payload,
+                                  const std::size_t size,
+                                  const bool b64)
+{
+    // Nonce, then head and payload, encrypted in place; counter mode
+    // needs no padding
+    const std::size_t streamSize = kSeekNonceSize + kSeekHeaderSize + size;
+    std::unique_ptr<char[]> stream(new char[streamSize]());
+
+    // A fresh counter per message: reusing one would give away the
+    // keystream, and so the other messages, through the known head
+    char* const nonce = stream.get();
+    ::gcry_create_nonce(nonce, kSeekNonceSize);
+
+    char ctr[kSeekNonceSize];
+    for (std::size_t i = 0; i != kSeekNonceSize; ++i) {
+        ctr[i] = static_cast<char>(vec_[i] ^ nonce[i]);
+    }
+
+    char* const head = stream.get() + kSeekNonceSize;
+    std::memcpy(head, kMagic, sizeof(kMagic));
+    head[4] = static_cast<char>(kVersion);
+    for (std::size_t i = 0; i != 8; ++i) {
+        head[kSeekHeaderSize - 1 - i] = static_cast<char>(size >> (8 * i));
+    }
+
+    if (size != 0) {
+        std::memcpy(head + kSeekHeaderSize, payload, size);
+    }
+
+    if (!cipher_seek(*get(), ctr, 0)
+        || !Encoder::encode(head, streamSize - kSeekNonceSize)) {
+        return "encode-failed";
+    }
+
+    if (!b64) {
+        return image.write(stream.get(), streamSize) != 0 ? "ok"
+                                                          : "encode-failed";
+    }
+
+    const auto charsSize = static_cast<std::size_t>(base64_size(streamSize));
+    std::unique_ptr<char[]> chars(new char[charsSize]);
+    base64_encode(std::span{stream.get(), streamSize}, chars.get());
+
+    return image.write(chars.get(), charsSize) != 0 ? "ok" : "encode-failed";
+}
+
+/*! Reads and decrypts part of the encrypted stream.
+ */
+bool steg::Seekable::fetch(const Image& image,
+                           const char* const ctr,
+                           const std::uint64_t begin,
+                           const std::uint64_t end,
+                           const bool b64,
+                           char* const out)
+{
+    // Decryption starts on the block holding begin
+    const std::size_t blockSize = get()->length;
+    const std::uint64_t aligned = begin - (begin % blockSize);
+
+    // The encrypted stream starts past the nonce
+    const std::uint64_t stored = kSeekNonceSize + aligned;
+    std::unique_ptr<char[]> data;
+    std::uint64_t from = 0;
+    if (!read_stored(image, stored, kSeekNonceSize + end, b64, data, from)) {
+        return false;
+    }
+
+    char* const blocks = data.get() + (stored - from);
+    const auto blocksSize = static_cast<std::size_t>(end - aligned);
+
+    if (!cipher_seek(*get(), ctr, aligned / blockSize)
+        || !Encoder::encode(blocks, blocksSize)) {
+        return false;
+    }
+
+    std::memcpy(out, blocks + (begin - aligned), end - begin);
+    return true;
+}
+
+/*! Reads the payload length from the header.
+ */
+const char* steg::Seekable::length(const Image& image,
+                                   const bool b64,
+                                   std::uint64_t& size)
+{
+    char ctr[kSeekNonceSize];
+    return header(image, b64, ctr, size);
+}
+
+/*! Reads the nonce and the header.
+ */
+const char* steg::Seekable::header(const Image& image,
+                                   const bool b64,
+                                   char* const ctr,
+                                   std::uint64_t& size)
+{
+    std::unique_ptr<char[]> nonce;
+    std::uint64_t from = 0;
+    const bool found = read_stored(image, 0, kSeekNonceSize, b64, nonce, from);
+    for (std::size_t i = 0; found && i != kSeekNonceSize; ++i) {
+        ctr[i] = static_cast<char>(vec_[i] ^ nonce[i]);
+    }
+
+    char head[kSeekHeaderSize];
+    if (!found || !fetch(image, ctr, 0, kSeekHeaderSize, b64, head)
+        || std::memcmp(head, kMagic, sizeof(kMagic)) != 0
+        || static_cast<std::uint8_t>(head[4]) != kVersion) {
+        constexpr const char* kMessage
+            = "Image holds no seekable payload, or the key is wrong";
+        return Log::error(kMessage), "decode-failed";
+    }
+
+    size = 0;
+    for (std::size_t i = 8; i != kSeekHeaderSize; ++i) {
+        size = (size << 8) | static_cast<unsigned char>(head[i]);
+    }
+
+    // The whole stream must fit the image, or the header is garbage
+    const std::uint64_t streamSize = kSeekNonceSize + kSeekHeaderSize + size;
+    const std::uint64_t stored = b64 ? base64_size(streamSize) : streamSize;
+    if (size > UINT64_MAX / 2 || stored > image.pixels() / 8) {
+        constexpr const char* kMessage
+            = "Payload length does not fit the image, exiting";
+        return Log::error(kMessage), "decode-failed";
+    }
+
+    return "ok";
+}
+
+/*! Extracts and decrypts a byte range of the payload.
+ */
+const char* steg::Seekable::extract(const Image& image,
+                                    const std::uint64_t offset,
+                                    const std::uint64_t size,
+                                    const bool b64,
+                                    IoBuffer& out)
+{
+    char ctr[kSeekNonceSize];
+    std::uint64_t total = 0;
+    if (const char* status = header(image, b64, ctr, total);
+        std::strcmp(status, "ok") != 0) {
+        return status;
+    }
+
+    const std::uint64_t first = std::min(offset, total);
+    const std::uint64_t count = std::min(size, total - first);
+
+    out.data.reset(new unsigned char[std::max<std::uint64_t>(count, 1)]);
+    out.size = static_cast<std::size_t>(count);
+
+    if (count != 0
+        && !fetch(image,
+                  ctr,
+                  kSeekHeaderSize + first,
+                  kSeekHeaderSize + first + count,
+                  b64,
+                  reinterpret_cast<char*>(out.data.get()))) {
+        return "decode-failed";
+    }
+
+    return "ok";
+}
+
+/*! Encodes a payload into, or decodes a byte range of it from, an image
+ *  file.
+ */
+int steg::seekable_run(const SeekOptions& opts)
+{
+    std::unique_ptr<Seekable> seekable(Seekable::create(opts.key, opts.vec));
+    if (seekable == nullptr) {
+        return 1;
+    }
+
+    Image image;
+    if (image.map(opts.image) == 0) {
+        return 1;
+    }
+
+    if (opts.encode) {
+        std::string payload;
+        if (!read_all(opts.input, payload)) {
+            Log::error("Unable to read", opts.input);
+            return 1;
+        }
+
+        const char* status
+            = seekable->embed(image, payload.data(), payload.size(), opts.b64);
+        if (std::strcmp(status, "ok") != 0) {
+            return 1;
+        }
+
+        return image.save(opts.output, opts.type) ? 0 : 1;
+    }
+
+    const std::uint64_t size
+        = opts.last > opts.first ? opts.last - opts.first : 0;
+
+    IoBuffer payload;
+    if (std::strcmp(
+            seekable->extract(image, opts.first, size, opts.b64, payload), "ok")
+        != 0) {
+        return 1;
+    }
+
+    OutputStream out;
+    if (opts.output != nullptr && !out.open(opts.output)) {
+        Log::error("Unable to create", opts.output);
+        return 1;
+    }
+
+    const bool ok = out.write(
+        reinterpret_cast<const char*>(payload.data.get()), payload.size);
+    return out.close() && ok ? 0 : 1;
+}
@@ -0,0 +1,138 @@
+/* seekable.hpp -- v1.0
+   Payloads that can be read back in part: encrypted in counter mode behind
+   a length header, so that any byte range maps to a known run of pixels and
+   cipher blocks
+
+   The stored stream is a random nonce in clear, one block, then the
+   encrypted header block and the payload with no padding; with base64 the
+   whole stream is encoded. The counter starts at the IV XOR the nonce, so
+   that no two messages under one key and IV share a keystream. Header
+   (big-endian), encrypted as counter block 0:
+     u8  magic[4]      "STGC"
+     u8  version       2
+     u8  reserved[3]
+     u64 length        size of the payload that follows */
+
+#pragma once
+
+#include "async_io.hpp"
+#include "encoder.hpp"
+#include "image.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace steg {
+    //! Size of the nonce in front of the header, one cipher block
+    constexpr std::size_t kSeekNonceSize = 16;
+
+    //! Size of the header in front of the payload, one cipher block
+    constexpr std::size_t kSeekHeaderSize = 16;
+
+    //! @class Seekable
+    //! Counter mode cipher that embeds whole payloads and extracts byte
+    //! ranges of them, decrypting only the blocks that hold the range
+    class Seekable : private Encoder {
+    public:
+        //! Factory method, returns a Seekable
+        //! @param key AES key string
+        //! @param initvec Initialization vector string, XORed with each
+        //! message's nonce for its initial counter
+        //! @return nullptr if the cipher cannot be set up
+        static Seekable* create(const char* key, const char* initvec);
+
+        //! Dtor.
+        ~Seekable() override = default;
+
+        //! Encrypts a payload into a loaded carrier
+        //! @param image loaded carrier, modified in place
+        //! @param payload plain message
+        //! @param size size of payload
+        //! @param b64 base64 encode the encrypted payload
+        //! @return "ok", or the name of the stage that failed
+        const char* embed(Image& image,
+                          const char* payload,
+                          std::size_t size,
+                          bool b64);
+
+        //! Reads the payload length from the header
+        //! @param image loaded carrier
+        //! @param b64 the encrypted payload is base64 encoded
+        //! @param size[out] payload length
+        //! @return "ok", or the name of the stage that failed
+        const char* length(const Image& image, bool b64, std::uint64_t& size);
+
+        //! Extracts and decrypts payload bytes [offset, offset + size),
+        //! clamped to the payload
+        //! @param image loaded carrier
+        //! @param offset first payload byte
+        //! @param size number of bytes, UINT64_MAX for the rest
+        //! @param b64 the encrypted payload is base64 encoded
+        //! @param out[out] decoded bytes
+        //! @return "ok", or the name of the stage that failed
+        const char* extract(const Image& image,
+                            std::uint64_t offset,
+                            std::uint64_t size,
+                            bool b64,
+                            IoBuffer& out);
+    private:
+        /* Ctor. Private, use factory method create() instead
+         */
+        Seekable(Cipher* cph, const char* initvec);
+
+        /* Helper
+         * Reads the nonce and the header
+         * @param ctr[out] initial counter of the message, kSeekNonceSize
+         * bytes
+         */
+        const char* header(const Image& image,
+                           bool b64,
+                           char* ctr,
+                           std::uint64_t& size);
+
+        /* Helper
+         * Reads and decrypts bytes [begin, end) of the encrypted stream,
+         * past the nonce, from the initial counter ctr
+         */
+        bool fetch(const Image& image,
+                   const char* ctr,
+                   std::uint64_t begin,
+                   std::uint64_t end,
+                   bool b64,
+                   char* out);
+
+        // XORed with the nonce for the initial counter
+        std::unique_ptr<char[]> vec_;
+    };
+
+    //! @bag SeekOptions
+    struct SeekOptions {
+        // Encode if true, decode otherwise
+        bool encode = true;
+        // Encrypted payload is base64 encoded
+        bool b64 = false;
+
+        // Cryptographic vars
+        const char* key = nullptr;
+        const char* vec = nullptr;
+
+        // Carrier (encode) or encoded image (decode)
+        const char* image = nullptr;
+        // Payload file, nullptr for stdin (encode only)
+        const char* input = nullptr;
+        // Encode: output image. Decode: payload file, nullptr for stdout
+        const char* output = nullptr;
+        // Output image file type
+        Image::ImageType type = Image::ImageType::kPng;
+
+        // Payload bytes to decode, [first, last)
+        std::uint64_t first = 0;
+        std::uint64_t last = UINT64_MAX;
+    };
+
+    //! Encodes a payload into, or decodes a byte range of it from, an image
+    //! file in counter mode
+    //! @param opts settings
+    //! @return 0 on success, 1 otherwise
+    int seekable_run(const SeekOptions& opts);
+} // namespace steg
@@ -0,0 +1,421 @@
+/* server.cpp -- v1.0 */
+
+#include "server.hpp"
+#include "carrier_index.hpp"
+#include "channel.hpp"
+#include "context.hpp"
+#include "image.hpp"
+#include "log.hpp"
+#include "metrics.hpp"
+#include "protocol.hpp"
+#include "scheduler.hpp"
+#include "stream.hpp"
+#include <atomic>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <exception>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <poll.h>
+#include <pthread.h>
+#include <sstream>
+#include <string>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+namespace {
+    // Connections served at once, per scheduler worker
+    constexpr unsigned kConnectionsPerWorker = 4;
+
+    // Set from the signal handler
+    volatile std::sig_atomic_t gStop = 0;
+
+    void on_signal(int)
+    {
+        gStop = 1;
+    }
+
+    // @bag
+    struct Server {
+        std::unordered_map<std::string, std::unique_ptr<steg::Context>> keys;
+
+        // Carriers for encode requests that bring none
+        std::unique_ptr<steg::CarrierIndex> carriers;
+
+        // Runs the requests, which split up further on its workers
+        steg::Scheduler* scheduler = nullptr;
+
+        // Connections being served, shut down on exit
+        std::mutex mutex;
+        std::unordered_set<int> active;
+        bool stopping = false;
+
+        std::atomic<std::size_t> connections = 0;
+        std::atomic<std::size_t> requests = 0;
+        std::atomic<std::size_t> errors = 0;
+    };
+} // namespace
+
+namespace {
+    // Helper: loads a key and its initialization vector
+    bool add_key(Server& server,
+                 const std::string& id,
+                 const char* keyPath,
+                 const char* vecPath)
+    {
+        std::unique_ptr<char[]> key = steg::read_key(keyPath);
+        std::unique_ptr<char[]> vec = steg::read_key(vecPath);
+
+        if (!key || !vec) {
+            steg::Log::error("Unable to load key", id.c_str());
+            return false;
+        }
+
+        std::unique_ptr<steg::Context> ctx(
+            steg::Context::create(key.get(), vec.get()));
+        if (ctx == nullptr) {
+            steg::Log::error("Unable to set up cipher for key", id.c_str());
+            return false;
+        }
+
+        server.keys[id] = std::move(ctx);
+        return true;
+    }
+
+    // Helper: reads "id key-file init-vec-file" lines
+    bool load_keyring(Server& server, const char* path)
+    {
+        // A read error must not leave a truncated keyring behind
+        std::string text;
+        if (!steg::read_all(path, text)) {
+            steg::Log::error("Unable to read keyring", path);
+            return false;
+        }
+
+        std::istringstream lines(text);
+        std::string line;
+        while (std::getline(lines, line)) {
+            std::istringstream fields(line);
+            std::string id;
+            std::string keyPath;
+            std::string vecPath;
+
+            if (!(fields >> id) || id[0] == '#') {
+                continue;
+            }
+
+            if (!(fields >> keyPath >> vecPath)) {
+                steg::Log::error("Malformed keyring entry", id.c_str());
+                return false;
+            }
+
+            if (!add_key(server, id, keyPath.c_str(), vecPath.c_str())) {
+                return false;
+            }
+        }
+
+        return true;
+    }
+} // namespace
+
+namespace {
+    // Helper: serves one request
+    const char* run_request(Server& server,
+                            const steg::Request& req,
+                            steg::IoBuffer& out)
+    {
+        const std::string id
+            = req.keyId.empty() ? "default" : std::string(req.keyId);
+
+        auto it = server.keys.find(id);
+        if (it == server.keys.end()) {
+            return "unknown-key";
+        }
+
+        const bool b64 = (req.flags & steg::Request::kBase64) != 0;
+
+        steg::Image image;
+        if ((req.flags & steg::Request::kCarrierPath) != 0) {
+            if (image.map(std::string(req.carrier).c_str()) == 0) {
+                return "load-failed";
+            }
+        } else if (req.carrier.empty() && req.op == steg::Request::kEncode) {
+            // Cheapest indexed carrier the payload fits in
+            const steg::CarrierIndex::Record* record
+                = server.carriers != nullptr
+                      ? server.carriers->find(req.payload.size(), b64)
+                      : nullptr;
+            if (record == nullptr) {
+                return "no-carrier";
+            }
+
+            if (image.map(server.carriers->path(*record)) == 0) {
+                return "load-failed";
+            }
+        } else if (image.open(
+                     reinterpret_cast<const unsigned char*>(req.carrier.data()),
+                     req.carrier.size())
+                 == 0) {
+            return "load-failed";
+        }
+
+        steg::Context& ctx = *it->second;
+
+        steg::JobTimes times;
+        if (req.op == steg::Request::kEncode) {
+            return ctx.encode(image,
+                              req.payload.data(),
+                              req.payload.size(),
+                              req.type,
+                              b64,
+                              out,
+                              times);
+        }
+
+        return ctx.decode(image, b64, out, times);
+    }
+
+    // Helper: serves one request; nothing it throws may take down the other
+    // clients' requests
+    const char* process(Server& server,
+                        const steg::Request& req,
+                        steg::IoBuffer& out)
+    {
+        try {
+            return run_request(server, req, out);
+        } catch (const std::exception& e) {
+            steg::Log::error("Request failed", e.what());
+            return "internal-error";
+        }
+    }
+
+    // Helper: answers requests until the client hangs up
+    void converse(Server& server, const int fd)
+    {
+        steg::Request req;
+        while (steg::read_request(fd, req)) {
+            steg::IoBuffer out;
+            const char* status = nullptr;
+            server.scheduler->run([&server, &req, &out, &status] {
+                status = process(server, req, out);
+            });
+
+            ++server.requests;
+            steg::Metrics::job(status);
+
+            // Carriers sent by path are read by the server itself
+            const bool byPath = (req.flags & steg::Request::kCarrierPath) != 0;
+            const std::size_t carrier = byPath ? 0 : req.carrier.size();
+            steg::Metrics::add(steg::Metric::kBytesIn,
+                               req.payload.size() + carrier);
+
+            bool sent = false;
+            if (std::strcmp(status, "ok") == 0) {
+                steg::Metrics::add(steg::Metric::kBytesOut, out.size);
+                sent = steg::write_response(
+                    fd, steg::Response::kOk, out.data.get(), out.size);
+            } else {
+                ++server.errors;
+                sent = steg::write_response(
+                    fd, steg::Response::kError, status, std::strlen(status));
+            }
+
+            if (!sent) {
+                break;
+            }
+        }
+    }
+
+    // Helper: serves requests on a connection until the client hangs up
+    void handle(Server& server, const int fd)
+    {
+        {
+            std::lock_guard lock(server.mutex);
+            if (server.stopping) {
+                ::close(fd);
+                return;
+            }
+
+            server.active.insert(fd);
+        }
+
+        ++server.connections;
+        steg::Metrics::add(steg::Metric::kConnections);
+
+        // Anything thrown, say by a frame too large to allocate, drops the
+        // connection only
+        try {
+            converse(server, fd);
+        } catch (const std::exception& e) {
+            steg::Log::error("Connection failed", e.what());
+            constexpr const char* kStatus = "internal-error";
+            steg::write_response(
+                fd, steg::Response::kError, kStatus, std::strlen(kStatus));
+        }
+
+        {
+            std::lock_guard lock(server.mutex);
+            server.active.erase(fd);
+        }
+
+        ::close(fd);
+    }
+} // namespace
+
+/*! Serves requests until SIGINT or SIGTERM.
+ */
+int steg::serve(const char* socketPath, const ServeOptions& opts)
+{
+    Server server;
+    if (opts.keyPath != nullptr && opts.vecPath != nullptr
+        && !add_key(server, "default", opts.keyPath, opts.vecPath)) {
+        return 1;
+    }
+
+    if (opts.keyring != nullptr && !load_keyring(server, opts.keyring)) {
+        return 1;
+    }
+
+    if (server.keys.empty()) {
+        Log::error("No keys to serve");
+        return 1;
+    }
+
+    if (opts.carriers != nullptr) {
+        server.carriers.reset(CarrierIndex::open(opts.carriers));
+        if (server.carriers == nullptr) {
+            return 1;
+        }
+    }
+
+    const int listener = listen_on(socketPath);
+    if (listener < 0) {
+        return 1;
+    }
+
+    // Signals stay blocked everywhere but in ppoll() below, so they are
+    // neither lost nor delivered to a worker
+    sigset_t blocked;
+    sigset_t previous;
+    sigemptyset(&blocked);
+    sigaddset(&blocked, SIGINT);
+    sigaddset(&blocked, SIGTERM);
+    ::pthread_sigmask(SIG_BLOCK, &blocked, &previous);
+
+    struct sigaction action = {};
+    action.sa_handler = on_signal;
+    sigemptyset(&action.sa_mask);
+
+    struct sigaction oldInt = {};
+    struct sigaction oldTerm = {};
+    ::sigaction(SIGINT, &action, &oldInt);
+    ::sigaction(SIGTERM, &action, &oldTerm);
+
+    gStop = 0;
+
+    // Connection threads mostly wait on their clients, so there are more of
+    // them than workers doing the actual work
+    Scheduler scheduler(opts.threads);
+    server.scheduler = &scheduler;
+
+    Channel<int> pending(std::numeric_limits<std::size_t>::max());
+
+    // Connections waiting for a thread, and being served, for --metrics
+    const MetricsGauge pendingDepth("queue_depth",
+                                    "Items waiting in a queue.",
+                                    "queue=\"connections\"",
+                                    [&pending] {
+                                        const std::size_t n = pending.size();
+                                        return static_cast<double>(n);
+                                    });
+    const MetricsGauge activeConnections("connections_active",
+                                         "Connections being served.",
+                                         "",
+                                         [&server] {
+                                             std::lock_guard lock(server.mutex);
+                                             return static_cast<double>(
+                                                 server.active.size());
+                                         });
+
+    std::vector<std::thread> workers;
+    for (unsigned i = 0; i != scheduler.size() * kConnectionsPerWorker; ++i) {
+        workers.emplace_back([&server, &pending] {
+            int fd = -1;
+            while (pending.pop(fd)) {
+                handle(server, fd);
+            }
+        });
+    }
+
+    sigset_t waiting = previous;
+    sigdelset(&waiting, SIGINT);
+    sigdelset(&waiting, SIGTERM);
+
+    int ret = 0;
+    while (gStop == 0) {
+        pollfd pfd = {.fd = listener, .events = POLLIN, .revents = 0};
+        if (::ppoll(&pfd, 1, nullptr, &waiting) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            Log::error("poll failed,", std::strerror(errno));
+            ret = 1;
+            break;
+        }
+
+        int fd = ::accept4(listener, nullptr, nullptr, SOCK_CLOEXEC);
+        if (fd >= 0) {
+            pending.push(std::move(fd));
+        } else if (errno != EINTR && errno != ECONNABORTED && errno != EAGAIN) {
+            Log::error("accept failed,", std::strerror(errno));
+            ret = 1;
+            break;
+        }
+    }
+
+    // Stop taking connections, and hang up on idle clients; requests in
+    // flight still get their response
+    ::close(listener);
+    ::unlink(socketPath);
+
+    {
+        std::lock_guard lock(server.mutex);
+        server.stopping = true;
+        for (const int fd: server.active) {
+            ::shutdown(fd, SHUT_RD);
+        }
+    }
+
+    pending.close();
+    for (std::thread& worker: workers) {
+        worker.join();
+    }
+
+    ::sigaction(SIGINT, &oldInt, nullptr);
+    ::sigaction(SIGTERM, &oldTerm, nullptr);
+    ::pthread_sigmask(SIG_SETMASK, &previous, nullptr);
+
+    std::size_t hits = 0;
+    std::size_t misses = 0;
+    for (const auto& [id, ctx]: server.keys) {
+        hits += ctx->hits();
+        misses += ctx->misses();
+    }
+
+    Log::info("Served",
+              log_field("requests", server.requests.load()),
+              log_field("failed", server.errors.load()),
+              log_field("connections", server.connections.load()),
+              log_field("pool_hits", hits),
+              log_field("pool_misses", misses));
+
+    return ret;
+}
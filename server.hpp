@@ -0,0 +1,31 @@
+/* server.hpp -- v1.0
+   Long-running encode/decode service listening on a UNIX domain socket */
+
+#pragma once
+
+namespace steg {
+    //! @bag ServeOptions
+    struct ServeOptions {
+        // Key and initialization vector files of the "default" key id
+        const char* keyPath = nullptr;
+        const char* vecPath = nullptr;
+
+        // Optional keyring, one "id key-file init-vec-file" line per key
+        const char* keyring = nullptr;
+
+        // Optional carrier index, for encode requests without a carrier
+        const char* carriers = nullptr;
+
+        // Worker threads, 0 for one per available CPU; four connections per
+        // worker are served at once
+        unsigned threads = 0;
+    };
+
+    //! Serves requests (see protocol.hpp) until SIGINT or SIGTERM
+    //! Keys are loaded once at startup; ciphers are pooled per key and mode
+    //! and reused across requests
+    //! @param socketPath path/to/socket, replaced if it exists
+    //! @param opts server settings
+    //! @return 0 on clean shutdown, 1 if the server could not start
+    int serve(const char* socketPath, const ServeOptions& opts);
+} // namespace steg
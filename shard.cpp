@@ -0,0 +1,372 @@
+/* shard.cpp -- v1.0 */
+
+#include "shard.hpp"
+#include "context.hpp"
+#include "log.hpp"
+#include "scheduler.hpp"
+#include "stream.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <gcrypt.h>
+#include <memory>
+#include <string>
+
+namespace {
+    constexpr char kMagic[4] = {'S', 'T', 'G', 'S'};
+    constexpr std::uint8_t kVersion = 1;
+    constexpr std::uint8_t kBase64 = 1 << 0;
+
+    // @bag
+    struct ShardHeader {
+        std::uint8_t flags = 0;
+        std::uint8_t id[8] = {};
+        std::uint32_t sequence = 0;
+        std::uint32_t total = 0;
+        std::uint64_t length = 0;
+    };
+
+    // @bag
+    // A shard read back from an image
+    struct Shard {
+        ShardHeader header;
+
+        // Header and piece, as extracted
+        std::unique_ptr<char[]> data;
+        bool ok = false;
+    };
+
+    // Helper: stores a big-endian integer
+    template <typename T>
+    void put(char* ptr, T value)
+    {
+        for (std::size_t i = sizeof(T); i != 0; --i) {
+            ptr[i - 1] = static_cast<char>(value & 0xff);
+            value = static_cast<T>(value >> 8);
+        }
+    }
+
+    // Helper: loads a big-endian integer
+    template <typename T>
+    T get(const char* ptr)
+    {
+        T value = 0;
+        for (std::size_t i = 0; i != sizeof(T); ++i) {
+            const auto byte = static_cast<unsigned char>(ptr[i]);
+            value = static_cast<T>((value << 8) | byte);
+        }
+
+        return value;
+    }
+
+    // Helper: writes a shard header
+    void write_header(const ShardHeader& header, char* ptr)
+    {
+        std::memcpy(ptr, kMagic, sizeof(kMagic));
+        ptr[4] = static_cast<char>(kVersion);
+        ptr[5] = static_cast<char>(header.flags);
+        ptr[6] = 0;
+        ptr[7] = 0;
+        std::memcpy(ptr + 8, header.id, sizeof(header.id));
+        put(ptr + 16, header.sequence);
+        put(ptr + 20, header.total);
+        put(ptr + 24, header.length);
+    }
+
+    // Helper: parses a shard header from the extracted bytes
+    bool read_header(const char* ptr,
+                     const std::size_t size,
+                     ShardHeader& header)
+    {
+        if (size < steg::kShardHeaderSize
+            || std::memcmp(ptr, kMagic, sizeof(kMagic)) != 0
+            || static_cast<std::uint8_t>(ptr[4]) != kVersion) {
+            return false;
+        }
+
+        header.flags = static_cast<std::uint8_t>(ptr[5]);
+        std::memcpy(header.id, ptr + 8, sizeof(header.id));
+        header.sequence = get<std::uint32_t>(ptr + 16);
+        header.total = get<std::uint32_t>(ptr + 20);
+        header.length = get<std::uint64_t>(ptr + 24);
+
+        return header.length <= size - steg::kShardHeaderSize;
+    }
+
+    // Helper: a carrier's room for a piece, past the header
+    std::size_t room(const steg::Image& image)
+    {
+        const std::size_t bytes = image.pixels() / 8;
+        return bytes > steg::kShardHeaderSize ? bytes - steg::kShardHeaderSize
+                                              : 0;
+    }
+} // namespace
+
+/*! Embeds a payload in pieces across carriers.
+ */
+const char* steg::shard_embed(Context& ctx,
+                              std::vector<Image>& carriers,
+                              const char* payload,
+                              const std::size_t size,
+                              const bool b64)
+{
+    if (carriers.empty() || carriers.size() > UINT32_MAX) {
+        return "encode-failed";
+    }
+
+    IoBuffer digest;
+    if (const char* status = ctx.encrypt(payload, size, b64, digest);
+        std::strcmp(status, "ok") != 0) {
+        return status;
+    }
+
+    std::size_t total = 0;
+    for (const Image& carrier: carriers) {
+        total += room(carrier);
+    }
+
+    if (total < digest.size) {
+        constexpr const char* kMessage
+            = "Carriers are too small to encode entire message, exiting";
+        return Log::error(kMessage), "encode-failed";
+    }
+
+    // Pieces in proportion to each carrier's room, so they fill up evenly;
+    // rounding leftovers go to whoever still has room
+    const double fill
+        = static_cast<double>(digest.size) / static_cast<double>(total);
+
+    std::vector<std::size_t> pieces(carriers.size());
+    std::size_t left = digest.size;
+    for (std::size_t i = 0; i != carriers.size(); ++i) {
+        const std::size_t share = room(carriers[i]);
+        const auto want
+            = static_cast<std::size_t>(fill * static_cast<double>(share));
+
+        pieces[i] = std::min({want, share, left});
+        left -= pieces[i];
+    }
+
+    for (std::size_t i = 0; left != 0 && i != carriers.size(); ++i) {
+        const std::size_t more = std::min(room(carriers[i]) - pieces[i], left);
+        pieces[i] += more;
+        left -= more;
+    }
+
+    std::vector<std::size_t> offsets(carriers.size() + 1, 0);
+    for (std::size_t i = 0; i != carriers.size(); ++i) {
+        offsets[i + 1] = offsets[i] + pieces[i];
+    }
+
+    ShardHeader header;
+    header.flags = b64 ? kBase64 : 0;
+    header.total = static_cast<std::uint32_t>(carriers.size());
+    ::gcry_create_nonce(header.id, sizeof(header.id));
+
+    std::atomic<bool> ok = true;
+    const char* data = reinterpret_cast<const char*>(digest.data.get());
+
+    parallel_for(carriers.size(), 1, [&](std::size_t begin, std::size_t end) {
+        for (std::size_t i = begin; i != end; ++i) {
+            ShardHeader shard = header;
+            shard.sequence = static_cast<std::uint32_t>(i);
+            shard.length = offsets[i + 1] - offsets[i];
+
+            const std::size_t shardSize = kShardHeaderSize + shard.length;
+            std::unique_ptr<char[]> buff(new char[shardSize]);
+            write_header(shard, buff.get());
+            std::memcpy(buff.get() + kShardHeaderSize,
+                        data + offsets[i],
+                        shard.length);
+
+            if (carriers[i].write(buff.get(), shardSize) == 0) {
+                ok = false;
+            }
+        }
+    });
+
+    return ok ? "ok" : "encode-failed";
+}
+
+/*! Extracts, joins and decrypts the shards of one payload.
+ */
+const char* steg::shard_extract(Context& ctx,
+                                const std::vector<Image>& images,
+                                IoBuffer& out)
+{
+    std::vector<Shard> shards(images.size());
+
+    parallel_for(images.size(), 1, [&](std::size_t begin, std::size_t end) {
+        for (std::size_t i = begin; i != end; ++i) {
+            const std::size_t buffSize = (images[i].pixels() + 7) / 8;
+            shards[i].data.reset(new char[buffSize]);
+
+            const std::size_t size
+                = images[i].read(shards[i].data.get(), buffSize);
+            shards[i].ok
+                = read_header(shards[i].data.get(), size, shards[i].header);
+        }
+    });
+
+    // One shard per sequence number, all of the same payload
+    std::vector<const Shard*> order(images.size(), nullptr);
+    const char* problem = nullptr;
+
+    for (const Shard& shard: shards) {
+        const ShardHeader& header = shard.header;
+        const ShardHeader& first = shards.front().header;
+
+        if (!shard.ok) {
+            problem = "Image holds no shard";
+        } else if (std::memcmp(header.id, first.id, sizeof(header.id)) != 0
+                 || header.flags != first.flags) {
+            problem = "Images hold shards of different payloads";
+        } else if (header.total != images.size()
+                 || header.sequence >= header.total) {
+            problem = "Shards are missing, or too many were given";
+        } else if (order[header.sequence] != nullptr) {
+            problem = "Shard given twice";
+        } else {
+            order[header.sequence] = &shard;
+            continue;
+        }
+
+        break;
+    }
+
+    if (problem == nullptr && images.empty()) {
+        problem = "No shards given";
+    }
+
+    if (problem != nullptr) {
+        return Log::error(problem), "decode-failed";
+    }
+
+    std::size_t size = 0;
+    for (const Shard* shard: order) {
+        size += shard->header.length;
+    }
+
+    std::unique_ptr<char[]> joined(new char[size]);
+    std::size_t pos = 0;
+    for (const Shard* shard: order) {
+        std::memcpy(joined.get() + pos,
+                    shard->data.get() + kShardHeaderSize,
+                    shard->header.length);
+        pos += shard->header.length;
+    }
+
+    const bool b64 = (shards.front().header.flags & kBase64) != 0;
+    return ctx.decrypt(joined.get(), size, b64, out);
+}
+
+namespace {
+    // Helper: loads image files in parallel
+    bool load_all(const std::vector<std::string>& paths,
+                  std::vector<steg::Image>& images)
+    {
+        images.resize(paths.size());
+
+        std::atomic<bool> ok = true;
+        auto load = [&](std::size_t begin, std::size_t end) {
+            for (std::size_t i = begin; i != end; ++i) {
+                if (images[i].map(paths[i].c_str()) == 0) {
+                    ok = false;
+                }
+            }
+        };
+
+        steg::parallel_for(paths.size(), 1, load);
+        return ok;
+    }
+
+    // Helper: encodes a payload into carrier files
+    bool encode_files(steg::Context& ctx,
+                      const std::vector<std::string>& paths,
+                      const steg::ShardOptions& opts)
+    {
+        std::string payload;
+        if (!steg::read_all(opts.input, payload)) {
+            steg::Log::error("Unable to read", opts.input);
+            return false;
+        }
+
+        std::vector<steg::Image> carriers;
+        if (!load_all(paths, carriers)) {
+            return false;
+        }
+
+        const char* status = steg::shard_embed(
+            ctx, carriers, payload.data(), payload.size(), opts.b64);
+        if (std::strcmp(status, "ok") != 0) {
+            return false;
+        }
+
+        // <output>.<sequence>.<type>
+        const char* ext = steg::Image::type_name(opts.type);
+        std::atomic<bool> ok = true;
+
+        auto save = [&](std::size_t begin, std::size_t end) {
+            for (std::size_t i = begin; i != end; ++i) {
+                const std::string path = std::string(opts.output) + "."
+                                         + std::to_string(i) + "." + ext;
+                if (!carriers[i].save(path.c_str(), opts.type)) {
+                    ok = false;
+                }
+            }
+        };
+
+        steg::parallel_for(carriers.size(), 1, save);
+        return ok;
+    }
+
+    // Helper: decodes a payload from shard files
+    bool decode_files(steg::Context& ctx,
+                      const std::vector<std::string>& paths,
+                      const steg::ShardOptions& opts)
+    {
+        std::vector<steg::Image> images;
+        if (!load_all(paths, images)) {
+            return false;
+        }
+
+        steg::IoBuffer payload;
+        if (std::strcmp(steg::shard_extract(ctx, images, payload), "ok") != 0) {
+            return false;
+        }
+
+        steg::OutputStream out;
+        if (opts.output != nullptr && !out.open(opts.output)) {
+            steg::Log::error("Unable to create", opts.output);
+            return false;
+        }
+
+        const bool ok = out.write(
+            reinterpret_cast<const char*>(payload.data.get()), payload.size);
+        return out.close() && ok;
+    }
+} // namespace
+
+/*! Encodes a payload into, or decodes it from, a set of image files.
+ */
+int steg::shard_run(const std::vector<std::string>& paths,
+                    const ShardOptions& opts)
+{
+    std::unique_ptr<Context> ctx(Context::create(opts.key, opts.vec));
+    if (ctx == nullptr) {
+        return 1;
+    }
+
+    // Everything runs on the workers, so files load, embed and save in
+    // parallel, and large images split up further
+    Scheduler scheduler(opts.threads);
+
+    bool ok = false;
+    scheduler.run([&] {
+        ok = opts.encode ? encode_files(*ctx, paths, opts)
+                         : decode_files(*ctx, paths, opts);
+    });
+
+    return ok ? 0 : 1;
+}
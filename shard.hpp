@@ -0,0 +1,84 @@
+/* shard.hpp -- v1.0
+   Spreads one encrypted payload over several carriers, and joins it back
+   from the images in any order
+
+   Every carrier holds a shard: a header, then its piece of the encrypted
+   payload. Header (big-endian):
+     u8  magic[4]      "STGS"
+     u8  version       1
+     u8  flags         bit 0 = base64 encoded payload
+     u8  reserved[2]
+     u8  id[8]         random, shared by the shards of one payload
+     u32 sequence      0 .. total - 1
+     u32 total         number of shards
+     u64 length        size of the piece that follows */
+
+#pragma once
+
+#include "async_io.hpp"
+#include "image.hpp"
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace steg {
+    // Fwd. decl.
+    class Context;
+
+    //! Size of the header in front of each piece
+    constexpr std::size_t kShardHeaderSize = 32;
+
+    //! @bag ShardOptions
+    struct ShardOptions {
+        // Encode if true, decode otherwise
+        bool encode = true;
+        // Encrypted payload is base64 encoded (encode only; shards record it)
+        bool b64 = false;
+
+        // Cryptographic vars
+        const char* key = nullptr;
+        const char* vec = nullptr;
+
+        // Worker threads, 0 for one per available CPU
+        unsigned threads = 0;
+
+        // Payload file, nullptr for stdin (encode only)
+        const char* input = nullptr;
+        // Encode: prefix of the images, written to <output>.<sequence>.<type>
+        // Decode: payload file, nullptr for stdout
+        const char* output = nullptr;
+        // Output image file type
+        Image::ImageType type = Image::ImageType::kPng;
+    };
+
+    //! Encrypts a payload once and embeds it in pieces across carriers, in
+    //! parallel; each carrier gets a share in proportion to its capacity
+    //! @param ctx cipher context
+    //! @param carriers loaded carriers, in sequence order, modified in place
+    //! @param payload plain message
+    //! @param size size of payload
+    //! @param b64 base64 encode the encrypted payload
+    //! @return "ok", or the name of the stage that failed
+    const char* shard_embed(Context& ctx,
+                            std::vector<Image>& carriers,
+                            const char* payload,
+                            std::size_t size,
+                            bool b64);
+
+    //! Extracts the shards of one payload in parallel, joins them and
+    //! decrypts the result
+    //! @param ctx cipher context
+    //! @param images loaded images holding every shard, in any order
+    //! @param out[out] decoded payload
+    //! @return "ok", or the name of the stage that failed
+    const char* shard_extract(Context& ctx,
+                              const std::vector<Image>& images,
+                              IoBuffer& out);
+
+    //! Encodes a payload into, or decodes it from, a set of image files
+    //! @param paths carrier images (encode) or shard images (decode)
+    //! @param opts settings
+    //! @return 0 on success, 1 otherwise
+    int shard_run(const std::vector<std::string>& paths,
+                  const ShardOptions& opts);
+} // namespace steg
@@ -0,0 +1,448 @@
+/* stats.cpp -- v1.0 */
+
+#include "stats.hpp"
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <iterator>
+#include <sys/resource.h>
+
+namespace {
+    // Helper: peak resident set size of the process, in kilobytes
+    long peak_rss_kb()
+    {
+        rusage usage = {};
+        ::getrusage(RUSAGE_SELF, &usage);
+        return usage.ru_maxrss;
+    }
+
+    // Helper: appends printf-style formatted text
+    template <typename... T>
+    void append(std::string& out, const char* format, T... args)
+    {
+        char line[160];
+        const int n = std::snprintf(line, sizeof(line), format, args...);
+        out.append(line, static_cast<std::size_t>(n));
+    }
+
+    // Helper: raises an atomic maximum
+    void raise(std::atomic<std::uint64_t>& max, const std::uint64_t value)
+    {
+        std::uint64_t seen = max.load(std::memory_order_relaxed);
+        while (seen < value
+               && !max.compare_exchange_weak(
+                   seen, value, std::memory_order_relaxed)) {
+        }
+    }
+
+    // Helper: header in front of a block handed out by stats_malloc()
+    steg::AllocHeader* header_of(void* ptr)
+    {
+        return static_cast<steg::AllocHeader*>(ptr) - 1;
+    }
+} // namespace
+
+/*! Flag checked by every timer.
+ */
+std::atomic<bool> steg::Stats::enabled_ = false;
+
+/*! Flag checked by every timer, for the hardware counters.
+ */
+std::atomic<bool> steg::Stats::perfEnabled_ = false;
+
+/*! Stage timed on this thread.
+ */
+thread_local steg::Stage steg::Stats::current_ = steg::Stage::kCount;
+thread_local steg::PerfSample steg::Stats::perfHeld_;
+
+/*! Gets the running singleton instance.
+ */
+steg::Stats* steg::Stats::get()
+{
+    static Stats instance;
+    return &instance;
+}
+
+/*! Starts collecting.
+ */
+void steg::Stats::enable()
+{
+    start_ = std::chrono::steady_clock::now();
+    enabled_.store(true, std::memory_order_relaxed);
+}
+
+/*! Also collects hardware counters.
+ */
+bool steg::Stats::enable_perf()
+{
+    // Counters are opened per thread on first use; trying them here tells
+    // whether the kernel allows them at all
+    if (!perf_open()) {
+        return false;
+    }
+
+    perfEnabled_.store(true, std::memory_order_relaxed);
+    return true;
+}
+
+/*! Adds one timed run of a stage.
+ */
+void steg::Stats::add(const Stage stage,
+                      const std::uint64_t ns,
+                      const std::uint64_t bytes)
+{
+    Counter& counter = counters_[static_cast<std::size_t>(stage)];
+    counter.calls.fetch_add(1, std::memory_order_relaxed);
+    counter.ns.fetch_add(ns, std::memory_order_relaxed);
+    counter.bytes.fetch_add(bytes, std::memory_order_relaxed);
+}
+
+/*! Adds the hardware counts of one run of a stage.
+ */
+void steg::Stats::add_perf(const Stage stage,
+                           const PerfSample& begin,
+                           const PerfSample& end)
+{
+    Counter& counter = counters_[static_cast<std::size_t>(stage)];
+    for (std::size_t i = 0; i != std::size(end.values); ++i) {
+        counter.perf[i].fetch_add(end.values[i] - begin.values[i],
+                                  std::memory_order_relaxed);
+    }
+}
+
+/*! Holds a span of this thread out of the stages timed on it.
+ */
+void steg::Stats::hold_perf(const PerfSample& begin,
+                            const PerfSample& held,
+                            const PerfSample& end)
+{
+    // Spans held within this one are part of it, not on top of it
+    for (std::size_t i = 0; i != std::size(end.values); ++i) {
+        perfHeld_.values[i] = held.values[i] + end.values[i] - begin.values[i];
+    }
+}
+
+/*! Records an allocation.
+ */
+void steg::Stats::track(AllocHeader& header, const std::uint64_t bytes)
+{
+    header.size = bytes;
+    header.stage = current_;
+    header.counted = enabled();
+    if (!header.counted) {
+        return;
+    }
+
+    Stats* stats = get();
+    for (AllocCounter* counter:
+         {&stats->allocs_[static_cast<std::size_t>(header.stage)],
+          &stats->allocTotal_}) {
+        counter->count.fetch_add(1, std::memory_order_relaxed);
+        counter->bytes.fetch_add(bytes, std::memory_order_relaxed);
+        raise(counter->largest, bytes);
+        raise(counter->peak,
+              counter->live.fetch_add(bytes, std::memory_order_relaxed)
+                  + bytes);
+    }
+}
+
+/*! Records the release of a block.
+ */
+void steg::Stats::release(const AllocHeader& header)
+{
+    if (!header.counted) {
+        return; // Allocated before stats were enabled
+    }
+
+    Stats* stats = get();
+    stats->allocs_[static_cast<std::size_t>(header.stage)].live.fetch_sub(
+        header.size, std::memory_order_relaxed);
+    stats->allocTotal_.live.fetch_sub(header.size, std::memory_order_relaxed);
+}
+
+/*! Counted malloc().
+ */
+void* steg::stats_malloc(const std::size_t size)
+{
+    auto* header
+        = static_cast<AllocHeader*>(std::malloc(sizeof(AllocHeader) + size));
+    if (header == nullptr) {
+        return nullptr;
+    }
+
+    Stats::track(*header, size);
+    return header + 1;
+}
+
+/*! Counted free().
+ */
+void steg::stats_free(void* ptr)
+{
+    if (ptr == nullptr) {
+        return;
+    }
+
+    AllocHeader* header = header_of(ptr);
+    Stats::release(*header);
+    std::free(header);
+}
+
+/*! Counted realloc().
+ */
+void* steg::stats_realloc(void* ptr, const std::size_t size)
+{
+    if (ptr == nullptr) {
+        return stats_malloc(size);
+    }
+
+    // The old block may move, so its record is taken out first
+    AllocHeader* header = header_of(ptr);
+    const AllocHeader previous = *header;
+
+    auto* grown = static_cast<AllocHeader*>(
+        std::realloc(header, sizeof(AllocHeader) + size));
+    if (grown == nullptr) {
+        return nullptr; // Old block still valid and counted
+    }
+
+    Stats::release(previous);
+    Stats::track(*grown, size);
+    return grown + 1;
+}
+
+/*! Name of a stage.
+ */
+const char* steg::Stats::stage_name(const Stage stage)
+{
+    static constexpr const char* kNames[] = {"read",
+                                             "load",
+                                             "cipher_init",
+                                             "encrypt",
+                                             "decrypt",
+                                             "base64_encode",
+                                             "base64_decode",
+                                             "embed",
+                                             "extract",
+                                             "save",
+                                             "write",
+                                             "other"};
+
+    static_assert(std::size(kNames)
+                  == static_cast<std::size_t>(Stage::kCount) + 1);
+    return kNames[static_cast<std::size_t>(stage)];
+}
+
+/*! Trace event name of a parallel_for() piece of a stage.
+ */
+const char* steg::Stats::piece_name(const Stage stage)
+{
+    static constexpr const char* kNames[] = {"read chunk",
+                                             "load rows",
+                                             "cipher_init chunk",
+                                             "encrypt chunk",
+                                             "decrypt chunk",
+                                             "base64_encode chunk",
+                                             "base64_decode chunk",
+                                             "embed tile",
+                                             "extract tile",
+                                             "save rows",
+                                             "write chunk",
+                                             "chunk"};
+
+    static_assert(std::size(kNames)
+                  == static_cast<std::size_t>(Stage::kCount) + 1);
+    return kNames[static_cast<std::size_t>(stage)];
+}
+
+/*! Formats the totals.
+ */
+std::string steg::Stats::report(const bool json) const
+{
+    using Ms = std::chrono::duration<double, std::milli>;
+    const double wallMs = Ms(std::chrono::steady_clock::now() - start_).count();
+
+    std::string out;
+    if (json) {
+        append(out, "{\"wall_ms\":%.3f,\"peak_rss_kb\":%ld,\"stages\":{",
+               wallMs,
+               peak_rss_kb());
+    } else {
+        append(out,
+               "%-14s %8s %12s %14s %10s\n",
+               "stage",
+               "calls",
+               "time-ms",
+               "bytes",
+               "MB/s");
+    }
+
+    const char* separator = "";
+    for (std::size_t i = 0; i != std::size(counters_); ++i) {
+        const Counter& counter = counters_[i];
+        const std::uint64_t calls = counter.calls.load();
+        if (calls == 0) {
+            continue; // Stage never ran
+        }
+
+        const double ms = static_cast<double>(counter.ns.load()) / 1e6;
+        const std::uint64_t bytes = counter.bytes.load();
+        const double mbps
+            = ms > 0 ? (static_cast<double>(bytes) / 1e6) / (ms / 1e3) : 0;
+        const char* name = stage_name(static_cast<Stage>(i));
+
+        if (json) {
+            append(out,
+                   "%s\"%s\":{\"calls\":%" PRIu64
+                   ",\"ms\":%.3f,\"bytes\":%" PRIu64 ",\"mb_per_s\":%.1f}",
+                   separator,
+                   name,
+                   calls,
+                   ms,
+                   bytes,
+                   mbps);
+            separator = ",";
+        } else {
+            append(out,
+                   "%-14s %8" PRIu64 " %12.3f %14" PRIu64 " %10.1f\n",
+                   name,
+                   calls,
+                   ms,
+                   bytes,
+                   mbps);
+        }
+    }
+
+    if (json) {
+        out += "},\"allocs\":{";
+    } else {
+        append(out, "%-14s %8s %12.3f\n", "wall", "", wallMs);
+        append(out, "%-14s %8s %12ld KB\n", "peak-rss", "", peak_rss_kb());
+        append(out,
+               "\n%-14s %8s %14s %14s %14s\n",
+               "allocs",
+               "count",
+               "bytes",
+               "peak-live",
+               "largest");
+    }
+
+    separator = "";
+    for (std::size_t i = 0; i <= std::size(allocs_); ++i) {
+        const bool total = i == std::size(allocs_);
+        const AllocCounter& counter = total ? allocTotal_ : allocs_[i];
+        const std::uint64_t count = counter.count.load();
+        if (count == 0) {
+            continue; // Nothing allocated
+        }
+
+        const char* name = total ? "total" : stage_name(static_cast<Stage>(i));
+        if (json) {
+            append(out,
+                   "%s\"%s\":{\"count\":%" PRIu64 ",\"bytes\":%" PRIu64,
+                   separator,
+                   name,
+                   count,
+                   counter.bytes.load());
+            append(out,
+                   ",\"peak_live\":%" PRIu64 ",\"largest\":%" PRIu64 "}",
+                   counter.peak.load(),
+                   counter.largest.load());
+            separator = ",";
+        } else {
+            append(out,
+                   "%-14s %8" PRIu64 " %14" PRIu64 " %14" PRIu64 " %14" PRIu64
+                   "\n",
+                   name,
+                   count,
+                   counter.bytes.load(),
+                   counter.peak.load(),
+                   counter.largest.load());
+        }
+    }
+
+    if (json) {
+        out += "}";
+    }
+
+    if (perf_enabled()) {
+        report_perf(out, json);
+    }
+
+    if (json) {
+        out += "}\n";
+    }
+
+    return out;
+}
+
+/*! Formats the hardware counts of each stage.
+ */
+void steg::Stats::report_perf(std::string& out, const bool json) const
+{
+    constexpr auto kCycles = static_cast<std::size_t>(PerfEvent::kCycles);
+    constexpr auto kInstructions
+        = static_cast<std::size_t>(PerfEvent::kInstructions);
+    constexpr auto kCacheMisses
+        = static_cast<std::size_t>(PerfEvent::kCacheMisses);
+    constexpr auto kBranchMisses
+        = static_cast<std::size_t>(PerfEvent::kBranchMisses);
+
+    if (json) {
+        out += ",\"perf\":{";
+    } else {
+        append(out,
+               "\n%-14s %14s %14s %6s %14s %14s\n",
+               "perf",
+               "cycles",
+               "instructions",
+               "IPC",
+               "cache-misses",
+               "branch-misses");
+    }
+
+    const char* separator = "";
+    for (std::size_t i = 0; i != std::size(counters_); ++i) {
+        const Counter& counter = counters_[i];
+        if (counter.calls.load() == 0) {
+            continue; // Stage never ran
+        }
+
+        const std::uint64_t cycles = counter.perf[kCycles].load();
+        const std::uint64_t instructions = counter.perf[kInstructions].load();
+        const double ipc = cycles != 0 ? static_cast<double>(instructions)
+                                             / static_cast<double>(cycles)
+                                       : 0;
+        const char* name = stage_name(static_cast<Stage>(i));
+
+        if (json) {
+            append(out,
+                   "%s\"%s\":{\"cycles\":%" PRIu64 ",\"instructions\":%" PRIu64
+                   ",\"ipc\":%.3f",
+                   separator,
+                   name,
+                   cycles,
+                   instructions,
+                   ipc);
+            append(out,
+                   ",\"cache_misses\":%" PRIu64 ",\"branch_misses\":%" PRIu64
+                   "}",
+                   counter.perf[kCacheMisses].load(),
+                   counter.perf[kBranchMisses].load());
+            separator = ",";
+        } else {
+            append(out,
+                   "%-14s %14" PRIu64 " %14" PRIu64 " %6.2f %14" PRIu64
+                   " %14" PRIu64 "\n",
+                   name,
+                   cycles,
+                   instructions,
+                   ipc,
+                   counter.perf[kCacheMisses].load(),
+                   counter.perf[kBranchMisses].load());
+        }
+    }
+
+    if (json) {
+        out += "}";
+    }
+}
@@ -0,0 +1,327 @@
+/* stats.hpp -- v1.0
+   Per-stage timers and byte counters on the hot path, reported by --stats;
+   a disabled timer costs one flag check. Allocations made through the
+   counting allocator policy and the stb hooks are charged to the stage
+   timed on the allocating thread. With --perf-counters each stage also
+   reads the hardware counters of its thread (see perf.hpp), with --trace
+   each run is also a trace event (see trace.hpp), and with --metrics it
+   lands in the stage's latency histogram (see metrics.hpp) */
+
+#pragma once
+
+#include "metrics.hpp"
+#include "perf.hpp"
+#include "trace.hpp"
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <string>
+
+namespace steg {
+    //! Timed stages of an encode or decode
+    enum class Stage : std::uint8_t {
+        kRead, // InputStream::read()
+        kLoad, // stbi_load, image file to pixels
+        kCipherInit, // cipher_init()
+        kEncrypt, // Encoder::encode()
+        kDecrypt, // Decoder::decode()
+        kBase64Encode, // base64_encode()
+        kBase64Decode, // base64_decode()
+        kEmbed, // Image::write()
+        kExtract, // Image::read()
+        kSave, // stbi_write_*, pixels to image file
+        kWrite, // OutputStream::write()
+        kCount // No stage running; allocations only
+    };
+
+    //! @bag AllocHeader
+    //! Prefix of every counted block, so that a free is charged to the stage
+    //! that made the allocation
+    struct alignas(std::max_align_t) AllocHeader {
+        std::uint64_t size = 0;
+        Stage stage = Stage::kCount;
+        bool counted = false;
+    };
+
+    //! @class Stats
+    //! Totals of every stage, shared by all threads; implements singleton
+    //! pattern
+    class Stats {
+    public:
+        //! Gets the running singleton instance
+        static Stats* get();
+
+        //! @return true once enable() has been called
+        static bool enabled()
+        {
+            return enabled_.load(std::memory_order_relaxed);
+        }
+
+        //! Starts collecting, and the wall clock
+        void enable();
+
+        //! @return true once enable_perf() has succeeded
+        static bool perf_enabled()
+        {
+            return perfEnabled_.load(std::memory_order_relaxed);
+        }
+
+        //! Also collects hardware counters per stage
+        //! @return false, leaving them off, if the kernel refuses them
+        bool enable_perf();
+
+        //! Adds one timed run of a stage
+        //! @param stage stage that ran
+        //! @param ns time taken, in nanoseconds
+        //! @param bytes bytes processed
+        void add(Stage stage, std::uint64_t ns, std::uint64_t bytes);
+
+        //! Adds the hardware counts of one run of a stage
+        //! @param begin counters read when the stage started
+        //! @param end counters read when it finished
+        void add_perf(Stage stage,
+                      const PerfSample& begin,
+                      const PerfSample& end);
+
+        //! Holds a span of this thread out of the hardware counts of the
+        //! stages timed on it, for work that counts itself elsewhere
+        //! @param begin counters read when the span started
+        //! @param held held_perf() when the span started
+        //! @param end counters read when it finished
+        static void hold_perf(const PerfSample& begin,
+                              const PerfSample& held,
+                              const PerfSample& end);
+
+        //! @return total counts held out on this thread so far
+        static const PerfSample& held_perf()
+        {
+            return perfHeld_;
+        }
+
+        //! Records an allocation, charged to the stage running on this
+        //! thread; does nothing but fill the header unless enabled
+        //! @param header[out] prefix of the new block
+        //! @param bytes size of the block, less the header
+        static void track(AllocHeader& header, std::uint64_t bytes);
+
+        //! Records the release of a block recorded by track()
+        static void release(const AllocHeader& header);
+
+        //! @return stage timed on this thread, Stage::kCount if none
+        static Stage current()
+        {
+            return current_;
+        }
+
+        //! Sets the stage timed on this thread
+        //! @return stage it replaces
+        static Stage exchange(Stage stage)
+        {
+            const Stage previous = current_;
+            current_ = stage;
+            return previous;
+        }
+
+        //! @return name of a stage, "other" for Stage::kCount
+        static const char* stage_name(Stage stage);
+
+        //! @return trace event name of a parallel_for() piece of a stage
+        static const char* piece_name(Stage stage);
+
+        //! Formats the totals, with MB/s per stage, wall time and peak RSS,
+        //! then the allocations and hardware counts of each stage
+        //! @param json one JSON object if true, a text table otherwise
+        std::string report(bool json) const;
+    private:
+        // Appends the hardware counts of each stage to report()
+        void report_perf(std::string& out, bool json) const;
+
+        // @bag
+        struct Counter {
+            std::atomic<std::uint64_t> calls = 0;
+            std::atomic<std::uint64_t> ns = 0;
+            std::atomic<std::uint64_t> bytes = 0;
+            std::atomic<std::uint64_t>
+                perf[static_cast<std::size_t>(PerfEvent::kCount)] = {};
+        };
+
+        // @bag
+        struct AllocCounter {
+            std::atomic<std::uint64_t> count = 0;
+            std::atomic<std::uint64_t> bytes = 0;
+            std::atomic<std::uint64_t> live = 0;
+            std::atomic<std::uint64_t> peak = 0;
+            std::atomic<std::uint64_t> largest = 0;
+        };
+
+        Counter counters_[static_cast<std::size_t>(Stage::kCount)];
+        std::chrono::steady_clock::time_point start_;
+
+        // One per stage, plus one for allocations outside any stage, and the
+        // total of all of them
+        AllocCounter allocs_[static_cast<std::size_t>(Stage::kCount) + 1];
+        AllocCounter allocTotal_;
+
+        static std::atomic<bool> enabled_;
+        static std::atomic<bool> perfEnabled_;
+        static thread_local Stage current_;
+        static thread_local PerfSample perfHeld_;
+    };
+
+    //! malloc(), free() and realloc() counted as allocations of the running
+    //! stage; stb allocates through these (see stb.hpp)
+    void* stats_malloc(std::size_t size);
+    void stats_free(void* ptr);
+    void* stats_realloc(void* ptr, std::size_t size);
+
+    //! @class StagePerf
+    //! Counts the hardware events of a scope as part of a stage, when
+    //! stats and counters are enabled, less the spans held out within it
+    class StagePerf {
+    public:
+        //! Ctor.
+        //! @param stage stage the events are charged to
+        explicit StagePerf(Stage stage)
+            : stage_(stage)
+        {
+            running_ = stage != Stage::kCount && Stats::enabled()
+                       && Stats::perf_enabled() && perf_read(start_);
+            held_ = Stats::held_perf();
+        }
+
+        //! Dtor. Adds the counts to the stage
+        ~StagePerf()
+        {
+            PerfSample end;
+            if (!running_ || !perf_read(end)) {
+                return;
+            }
+
+            // What was held out meanwhile moves the start forward
+            PerfSample begin = start_;
+            const PerfSample& held = Stats::held_perf();
+            for (std::size_t i = 0; i != std::size(begin.values); ++i) {
+                begin.values[i] += held.values[i] - held_.values[i];
+            }
+
+            (Stats::get())->add_perf(stage_, begin, end);
+        }
+
+        // Non-copyable object
+        StagePerf(const StagePerf&) = delete;
+        StagePerf& operator=(const StagePerf&) = delete;
+    private:
+        Stage stage_;
+        PerfSample start_;
+        PerfSample held_;
+        bool running_ = false;
+    };
+
+    //! @class PerfHold
+    //! Holds a scope out of the hardware counts of the stages timed on
+    //! this thread, see Stats::hold_perf()
+    class PerfHold {
+    public:
+        //! Ctor.
+        PerfHold()
+        {
+            running_ = Stats::enabled() && Stats::perf_enabled()
+                       && perf_read(start_);
+            held_ = Stats::held_perf();
+        }
+
+        //! Dtor. Adds the scope to the held counts
+        ~PerfHold()
+        {
+            PerfSample end;
+            if (running_ && perf_read(end)) {
+                Stats::hold_perf(start_, held_, end);
+            }
+        }
+
+        // Non-copyable object
+        PerfHold(const PerfHold&) = delete;
+        PerfHold& operator=(const PerfHold&) = delete;
+    private:
+        PerfSample start_;
+        PerfSample held_;
+        bool running_ = false;
+    };
+
+    //! @class StageTimer
+    //! Times a scope as one run of a stage, when stats are enabled,
+    //! records it as a trace event when tracing is, and in the stage's
+    //! histogram when metrics are
+    class StageTimer {
+    public:
+        //! Ctor.
+        //! @param stage stage being timed
+        //! @param bytes bytes processed, if known up front
+        explicit StageTimer(Stage stage, std::uint64_t bytes = 0)
+            : stage_(stage)
+            , bytes_(bytes)
+            , perf_(stage)
+        {
+            const bool stats = Stats::enabled();
+            if (stats || Trace::enabled() || Metrics::enabled()) {
+                previous_ = Stats::exchange(stage);
+                start_ = std::chrono::steady_clock::now();
+                running_ = true;
+            }
+        }
+
+        //! Dtor. Adds the run to the totals
+        ~StageTimer()
+        {
+            if (!running_) {
+                return;
+            }
+
+            Stats::exchange(previous_);
+            const auto end = std::chrono::steady_clock::now();
+            using std::chrono::nanoseconds;
+            const auto ns = static_cast<std::uint64_t>(
+                std::chrono::duration_cast<nanoseconds>(end - start_).count());
+
+            if (Stats::enabled()) {
+                (Stats::get())->add(stage_, ns, bytes_);
+            }
+
+            if (Trace::enabled()) {
+                auto ticks = [](const std::chrono::steady_clock::time_point t) {
+                    return static_cast<std::uint64_t>(
+                        std::chrono::duration_cast<nanoseconds>(
+                            t.time_since_epoch())
+                            .count());
+                };
+
+                Trace::record(
+                    Stats::stage_name(stage_), ticks(start_), ticks(end));
+            }
+
+            Metrics::observe(stage_, ns);
+        }
+
+        // Non-copyable object
+        StageTimer(const StageTimer&) = delete;
+        StageTimer& operator=(const StageTimer&) = delete;
+
+        //! Sets the bytes processed, once known
+        void bytes(std::uint64_t bytes)
+        {
+            bytes_ = bytes;
+        }
+    private:
+        Stage stage_;
+        std::uint64_t bytes_ = 0;
+
+        std::chrono::steady_clock::time_point start_;
+        Stage previous_ = Stage::kCount;
+        bool running_ = false;
+
+        // Hardware counts, added as it goes out of scope
+        StagePerf perf_;
+    };
+} // namespace steg
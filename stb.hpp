@@ -3,6 +3,16 @@
 
 #pragma once
 
+#include "stats.hpp"
+
+// Pixel buffers and encoder scratch are counted in the --stats totals
+#define STBI_MALLOC(size) steg::stats_malloc(size)
+#define STBI_REALLOC(ptr, size) steg::stats_realloc(ptr, size)
+#define STBI_FREE(ptr) steg::stats_free(ptr)
+#define STBIW_MALLOC(size) steg::stats_malloc(size)
+#define STBIW_REALLOC(ptr, size) steg::stats_realloc(ptr, size)
+#define STBIW_FREE(ptr) steg::stats_free(ptr)
+
 // Suppress stb warnings
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wmissing-field-initializers"
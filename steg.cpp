@@ -0,0 +1,350 @@
+/* steg.cpp -- v1.0 */
+
+#include "steg.h"
+#include "capacity.hpp"
+#include "context.hpp"
+#include "image.hpp"
+#include "job.hpp"
+#include "stream.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <new>
+
+struct steg_ctx {
+    std::unique_ptr<steg::Context> ctx;
+};
+
+namespace {
+    // Helper: maps a job status to a status code
+    int to_status(const char* status)
+    {
+        static constexpr struct {
+            const char* name;
+            int code;
+        } kCodes[] = {
+            {"ok", STEG_OK},
+            {"cipher-failed", STEG_ECIPHER},
+            {"encode-failed", STEG_EENCODE},
+            {"decode-failed", STEG_EDECODE},
+            {"save-failed", STEG_ESAVE},
+        };
+
+        for (const auto& entry: kCodes) {
+            if (std::strcmp(status, entry.name) == 0) {
+                return entry.code;
+            }
+        }
+
+        return STEG_EINVAL;
+    }
+
+    // Helper: zero-pads a key to the size the cipher reads
+    std::unique_ptr<char[]> pad_key(const void* key, const std::size_t size)
+    {
+        std::unique_ptr<char[]> buff(new char[steg::kMinKeySize]());
+        std::memcpy(buff.get(), key, std::min(size, steg::kMinKeySize));
+        return buff;
+    }
+
+    // Helper: copies carrier details out to the caller
+    void hand_over(const steg::CarrierInfo& info, steg_info* out)
+    {
+        const steg::Image::Header& header = info.header;
+        const bool writable = header.type != steg::Image::ImageType::kNil;
+
+        out->width = header.w;
+        out->height = header.h;
+        out->channels = header.nchanns;
+        out->type = writable ? static_cast<int>(header.type) : 0;
+        out->file_size = static_cast<size_t>(header.fileSize);
+        out->capacity = info.capacity;
+        out->capacity_base64 = info.capacity64;
+    }
+
+    // Helper: hands a result over to the caller
+    void hand_over(steg::IoBuffer& result, steg_buffer* out)
+    {
+        out->size = result.size;
+        out->data = result.data.release();
+    }
+} // namespace
+
+/*! Library version string.
+ */
+const char* steg_version(void)
+{
+    return "1.0";
+}
+
+/*! Status code description.
+ */
+const char* steg_strerror(const int status)
+{
+    switch (status) {
+        case STEG_OK:
+            return "Success";
+        case STEG_EINVAL:
+            return "Invalid argument";
+        case STEG_ECIPHER:
+            return "Cipher could not be set up";
+        case STEG_ELOAD:
+            return "Carrier is not a readable image";
+        case STEG_EENCODE:
+            return "Payload does not fit the carrier, or encryption failed";
+        case STEG_EDECODE:
+            return "No payload found, or decryption failed";
+        case STEG_ESAVE:
+            return "Output image could not be encoded";
+        case STEG_ENOMEM:
+            return "Out of memory";
+        case STEG_EINTERNAL:
+            return "Internal error";
+        default:
+            return "Unknown status";
+    }
+}
+
+/*! Creates a context.
+ */
+steg_ctx* steg_ctx_new(const void* const key,
+                       const size_t key_size,
+                       const void* const iv,
+                       const size_t iv_size)
+{
+    if (key == nullptr || iv == nullptr || key_size == 0 || iv_size == 0) {
+        return nullptr;
+    }
+
+    // Nothing may unwind into C callers
+    try {
+        std::unique_ptr<char[]> paddedKey = pad_key(key, key_size);
+        std::unique_ptr<char[]> paddedVec = pad_key(iv, iv_size);
+
+        auto ctx = std::make_unique<steg_ctx>();
+        ctx->ctx.reset(steg::Context::create(paddedKey.get(), paddedVec.get()));
+        return ctx->ctx != nullptr ? ctx.release() : nullptr;
+    } catch (const std::bad_alloc&) {
+        return nullptr;
+    } catch (...) {
+        return nullptr;
+    }
+}
+
+/*! Destroys a context.
+ */
+void steg_ctx_free(steg_ctx* const ctx)
+{
+    delete ctx;
+}
+
+/*! Encrypts payload into the carrier image.
+ */
+int steg_encode(steg_ctx* const ctx,
+                const void* const carrier,
+                const size_t carrier_size,
+                const void* const payload,
+                const size_t payload_size,
+                const int type,
+                const unsigned flags,
+                steg_buffer* const out)
+{
+    if (ctx == nullptr || carrier == nullptr || out == nullptr
+        || (payload == nullptr && payload_size != 0) || type < STEG_PNG
+        || type > STEG_TGA) {
+        return STEG_EINVAL;
+    }
+
+    *out = {};
+
+    try {
+        steg::Image image;
+        if (image.open(static_cast<const unsigned char*>(carrier), carrier_size)
+            == 0) {
+            return STEG_ELOAD;
+        }
+
+        const auto* message = static_cast<const char*>(payload);
+        const auto imageType = static_cast<steg::Image::ImageType>(type);
+        const bool b64 = (flags & STEG_BASE64) != 0;
+
+        steg::IoBuffer result;
+        steg::JobTimes times;
+        const char* status
+            = (flags & STEG_SEEKABLE) != 0
+                  ? ctx->ctx->encode_seekable(image,
+                                              message,
+                                              payload_size,
+                                              imageType,
+                                              b64,
+                                              result,
+                                              times)
+                  : ctx->ctx->encode(image,
+                                     message,
+                                     payload_size,
+                                     imageType,
+                                     b64,
+                                     result,
+                                     times);
+
+        if (std::strcmp(status, "ok") == 0) {
+            hand_over(result, out);
+        }
+
+        return to_status(status);
+    } catch (const std::bad_alloc&) {
+        return STEG_ENOMEM;
+    } catch (...) {
+        return STEG_EINTERNAL;
+    }
+}
+
+/*! Extracts and decrypts the payload of an encoded image.
+ */
+int steg_decode(steg_ctx* const ctx,
+                const void* const carrier,
+                const size_t carrier_size,
+                const unsigned flags,
+                steg_buffer* const out)
+{
+    if ((flags & STEG_SEEKABLE) != 0) {
+        return steg_decode_range(
+            ctx, carrier, carrier_size, flags, 0, SIZE_MAX, out);
+    }
+
+    if (ctx == nullptr || carrier == nullptr || out == nullptr) {
+        return STEG_EINVAL;
+    }
+
+    *out = {};
+
+    try {
+        steg::Image image;
+        if (image.open(static_cast<const unsigned char*>(carrier), carrier_size)
+            == 0) {
+            return STEG_ELOAD;
+        }
+
+        steg::IoBuffer result;
+        steg::JobTimes times;
+        const bool b64 = (flags & STEG_BASE64) != 0;
+        const char* status = ctx->ctx->decode(image, b64, result, times);
+
+        if (std::strcmp(status, "ok") == 0) {
+            hand_over(result, out);
+        }
+
+        return to_status(status);
+    } catch (const std::bad_alloc&) {
+        return STEG_ENOMEM;
+    } catch (...) {
+        return STEG_EINTERNAL;
+    }
+}
+
+/*! Extracts and decrypts a byte range of a seekable payload.
+ */
+int steg_decode_range(steg_ctx* const ctx,
+                      const void* const carrier,
+                      const size_t carrier_size,
+                      const unsigned flags,
+                      const size_t offset,
+                      const size_t length,
+                      steg_buffer* const out)
+{
+    if (ctx == nullptr || carrier == nullptr || out == nullptr) {
+        return STEG_EINVAL;
+    }
+
+    *out = {};
+
+    try {
+        steg::Image image;
+        if (image.open(static_cast<const unsigned char*>(carrier), carrier_size)
+            == 0) {
+            return STEG_ELOAD;
+        }
+
+        steg::IoBuffer result;
+        steg::JobTimes times;
+        const char* status = ctx->ctx->decode_range(
+            image, offset, length, (flags & STEG_BASE64) != 0, result, times);
+
+        if (std::strcmp(status, "ok") == 0) {
+            hand_over(result, out);
+        }
+
+        return to_status(status);
+    } catch (const std::bad_alloc&) {
+        return STEG_ENOMEM;
+    } catch (...) {
+        return STEG_EINTERNAL;
+    }
+}
+
+/*! Reads a carrier's header and works out its capacity.
+ */
+int steg_probe(const void* const carrier,
+               const size_t carrier_size,
+               steg_info* const out)
+{
+    if (carrier == nullptr || out == nullptr) {
+        return STEG_EINVAL;
+    }
+
+    *out = {};
+
+    try {
+        steg::CarrierInfo info;
+        if (!steg::probe_carrier(static_cast<const unsigned char*>(carrier),
+                                 carrier_size,
+                                 info)) {
+            return STEG_ELOAD;
+        }
+
+        hand_over(info, out);
+        return STEG_OK;
+    } catch (const std::bad_alloc&) {
+        return STEG_ENOMEM;
+    } catch (...) {
+        return STEG_EINTERNAL;
+    }
+}
+
+/*! Reads a carrier file's header and works out its capacity.
+ */
+int steg_probe_file(const char* const path, steg_info* const out)
+{
+    if (path == nullptr || out == nullptr) {
+        return STEG_EINVAL;
+    }
+
+    *out = {};
+
+    try {
+        steg::CarrierInfo info;
+        if (!steg::probe_carrier(path, info)) {
+            return STEG_ELOAD;
+        }
+
+        hand_over(info, out);
+        return STEG_OK;
+    } catch (const std::bad_alloc&) {
+        return STEG_ENOMEM;
+    } catch (...) {
+        return STEG_EINTERNAL;
+    }
+}
+
+/*! Releases a result buffer.
+ */
+void steg_buffer_free(steg_buffer* const buf)
+{
+    if (buf == nullptr) {
+        return;
+    }
+
+    delete[] buf->data;
+    *buf = {};
+}
@@ -0,0 +1,136 @@
+/* steg.h -- v1.0
+   C API of the steg_core library: hides an encrypted payload in an image, or
+   recovers it, entirely in memory
+
+   A context holds a key and initialization vector with their ciphers; it is
+   set up once and may then be used from any number of threads at once.
+   Carriers are image file contents (png, bmp, tga, ...), results are handed
+   back in buffers owned by the caller. */
+
+#ifndef STEG_H
+#define STEG_H
+
+#include <stddef.h>
+
+#if defined(__GNUC__)
+#define STEG_API __attribute__((visibility("default")))
+#else
+#define STEG_API
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Bumped on incompatible changes */
+#define STEG_API_VERSION 1
+
+/* Flags */
+#define STEG_BASE64 0x1u /* Payload is base64 encoded after encryption */
+#define STEG_SEEKABLE 0x2u /* Counter mode with a length header, so that
+                              byte ranges can be decoded, see
+                              steg_decode_range() */
+
+/* Status codes */
+enum steg_status {
+    STEG_OK = 0,
+    STEG_EINVAL = -1,   /* Bad argument */
+    STEG_ECIPHER = -2,  /* Cipher could not be set up */
+    STEG_ELOAD = -3,    /* Carrier is not a readable image */
+    STEG_EENCODE = -4,  /* Payload does not fit, or encryption failed */
+    STEG_EDECODE = -5,  /* No payload found, or decryption failed */
+    STEG_ESAVE = -6,    /* Output image could not be encoded */
+    STEG_ENOMEM = -7,   /* Out of memory */
+    STEG_EINTERNAL = -8 /* Unexpected internal failure */
+};
+
+/* Output image file types */
+enum steg_image_type { STEG_PNG = 1, STEG_BMP = 2, STEG_TGA = 3 };
+
+/* Opaque key and cipher context */
+typedef struct steg_ctx steg_ctx;
+
+/* Result buffer, release with steg_buffer_free() */
+typedef struct steg_buffer {
+    unsigned char* data;
+    size_t size;
+} steg_buffer;
+
+/* Carrier image header and capacity, see steg_probe() */
+typedef struct steg_info {
+    unsigned width;
+    unsigned height;
+    unsigned channels;
+    int type;               /* STEG_PNG, STEG_BMP, STEG_TGA, 0 for others */
+    size_t file_size;       /* Image file size in bytes */
+    size_t capacity;        /* Largest payload, in bytes */
+    size_t capacity_base64; /* Largest payload with STEG_BASE64 */
+} steg_info;
+
+/* Returns the library version string */
+STEG_API const char* steg_version(void);
+
+/* Returns a description of a status code */
+STEG_API const char* steg_strerror(int status);
+
+/* Creates a context; key and iv are zero-padded or truncated to the cipher's
+   needs. Returns NULL on error */
+STEG_API steg_ctx* steg_ctx_new(const void* key,
+                                size_t key_size,
+                                const void* iv,
+                                size_t iv_size);
+
+/* Destroys a context; NULL is ignored */
+STEG_API void steg_ctx_free(steg_ctx* ctx);
+
+/* Encrypts payload into the carrier image and encodes the result as an image
+   file of the given type into out. Returns STEG_OK or an error status */
+STEG_API int steg_encode(steg_ctx* ctx,
+                         const void* carrier,
+                         size_t carrier_size,
+                         const void* payload,
+                         size_t payload_size,
+                         int type,
+                         unsigned flags,
+                         steg_buffer* out);
+
+/* Extracts and decrypts the payload of an encoded image into out; the
+   payload keeps the cipher's block padding, unless it was encoded with
+   STEG_SEEKABLE. Returns STEG_OK or an error status */
+STEG_API int steg_decode(steg_ctx* ctx,
+                         const void* carrier,
+                         size_t carrier_size,
+                         unsigned flags,
+                         steg_buffer* out);
+
+/* Extracts and decrypts payload bytes [offset, offset + length), clamped to
+   the payload, of an image encoded with STEG_SEEKABLE; only the cipher
+   blocks holding the range are read and decrypted. STEG_SEEKABLE is implied.
+   Returns STEG_OK or an error status */
+STEG_API int steg_decode_range(steg_ctx* ctx,
+                               const void* carrier,
+                               size_t carrier_size,
+                               unsigned flags,
+                               size_t offset,
+                               size_t length,
+                               steg_buffer* out);
+
+/* Reads the header of a carrier image, without decoding its pixels, and
+   works out the largest payload it holds. Returns STEG_OK or an error
+   status */
+STEG_API int steg_probe(const void* carrier,
+                        size_t carrier_size,
+                        steg_info* out);
+
+/* Same as steg_probe(), reading only the header of an image file. Returns
+   STEG_OK or an error status */
+STEG_API int steg_probe_file(const char* path, steg_info* out);
+
+/* Releases a result buffer and clears it; NULL is ignored */
+STEG_API void steg_buffer_free(steg_buffer* buf);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* STEG_H */
@@ -0,0 +1,445 @@
+/* stream.cpp -- v1.0 */
+
+#include "stream.hpp"
+#include "log.hpp"
+#include "stats.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <utility>
+
+steg::InputStream::~InputStream()
+{
+    // Cleanup
+    if (map_ != nullptr) {
+        ::munmap(map_, mapSize_);
+    }
+
+    if (fd_ > STDIN_FILENO) {
+        ::close(fd_);
+    }
+}
+
+steg::InputStream::InputStream(InputStream&& other) noexcept
+    : fd_(other.fd_)
+    , map_(other.map_)
+    , mapSize_(other.mapSize_)
+    , failed_(other.failed_)
+{
+    other.fd_ = -1;
+    other.map_ = nullptr;
+    other.mapSize_ = 0;
+}
+
+steg::InputStream& steg::InputStream::operator()(InputStream&& other)
+{
+    fd_ = other.fd_;
+    map_ = other.map_;
+    mapSize_ = other.mapSize_;
+    failed_ = other.failed_;
+
+    other.fd_ = -1;
+    other.map_ = nullptr;
+    other.mapSize_ = 0;
+    return *this;
+}
+
+/*! File size, 0 if unknown.
+ */
+std::size_t steg::InputStream::size() const
+{
+    struct stat st = {};
+    if (fd_ < 0 || ::fstat(fd_, &st) != 0 || !S_ISREG(st.st_mode)) {
+        return 0;
+    }
+
+    return static_cast<std::size_t>(st.st_size);
+}
+
+/*! Opens file.
+ */
+bool steg::InputStream::open(const char* const filePath)
+{
+    if (fd_ != STDIN_FILENO) {
+        return false;
+    }
+
+    // Open and initialize file
+    fd_ = ::open(filePath, O_RDONLY | O_CLOEXEC);
+    return fd_ >= 0;
+}
+
+/*! Maps file into memory.
+ */
+const char* steg::InputStream::data()
+{
+    if (map_ != nullptr) {
+        return static_cast<const char*>(map_);
+    }
+
+    const std::size_t size = this->size();
+    if (size < kMapThreshold) {
+        return nullptr;
+    }
+
+    void* map = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd_, 0);
+    if (map == MAP_FAILED) {
+        return nullptr; // Fall back to read()
+    }
+
+    ::madvise(map, size, MADV_SEQUENTIAL);
+
+    map_ = map;
+    mapSize_ = size;
+    return static_cast<const char*>(map_);
+}
+
+/*! Reads from file.
+ */
+std::size_t steg::InputStream::read(char* buff, const std::size_t size)
+{
+    // Sanity check
+    if (fd_ < 0) {
+        return 0;
+    }
+
+    StageTimer timer(Stage::kRead);
+
+    // Read raw data
+    std::size_t total = 0;
+    while (total != size) {
+        ssize_t n = ::read(fd_, buff + total, size - total);
+        if (n > 0) {
+            total += static_cast<std::size_t>(n);
+            continue;
+        }
+
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+
+        if (n < 0) {
+            Log::error("Unable to read input,", std::strerror(errno));
+            failed_ = true;
+        }
+
+        break; // EOF or error
+    }
+
+    timer.bytes(total);
+    return total;
+}
+
+steg::OutputStream::~OutputStream()
+{
+    close();
+}
+
+steg::OutputStream::OutputStream(OutputStream&& other) noexcept
+    : fd_(other.fd_)
+    , buff_(other.buff_)
+    , used_(other.used_)
+    , offset_(other.offset_)
+    , direct_(other.direct_)
+    , failed_(other.failed_)
+{
+    other.fd_ = -1;
+    other.buff_ = nullptr;
+    other.used_ = 0;
+}
+
+/*! Creates or truncates file.
+ */
+bool steg::OutputStream::open(const char* const filePath)
+{
+    if (fd_ != STDOUT_FILENO) {
+        return false;
+    }
+
+    fd_ = ::open(filePath, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    return fd_ >= 0;
+}
+
+/*! Writes buff, through the staging buffer if it fits.
+ */
+bool steg::OutputStream::write(const char* const buff, const std::size_t size)
+{
+    if (failed_ || fd_ < 0) {
+        return false;
+    }
+
+    StageTimer timer(Stage::kWrite, size);
+
+    if (buff_ == nullptr) {
+        buff_ = static_cast<char*>(std::aligned_alloc(kAlignment, kBufferSize));
+        if (buff_ == nullptr) {
+            return fail(ENOMEM);
+        }
+
+        prepare(size);
+    }
+
+    // Gather small writes
+    if (size <= kBufferSize - used_) {
+        std::memcpy(buff_ + used_, buff, size);
+        used_ += size;
+        return used_ != kBufferSize || flush();
+    }
+
+    // Direct I/O needs aligned memory, stream through the buffer
+    if (direct_) {
+        std::size_t done = 0;
+        while (done != size) {
+            std::size_t n = std::min(size - done, kBufferSize - used_);
+            std::memcpy(buff_ + used_, buff + done, n);
+
+            used_ += n;
+            done += n;
+            if (used_ == kBufferSize && !flush()) {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    // Large writes go out in one call, behind whatever is buffered
+    iovec iov[2] = {
+        {.iov_base = buff_, .iov_len = used_},
+        {.iov_base = const_cast<char*>(buff), .iov_len = size},
+    };
+
+    used_ = 0;
+    return write_all(iov, 2);
+}
+
+/*! Writes out buffered data.
+ */
+bool steg::OutputStream::flush()
+{
+    if (failed_ || fd_ < 0) {
+        return !failed_;
+    }
+
+    // O_DIRECT only takes whole blocks, the tail goes through the page cache
+    if (direct_ && (used_ % kAlignment) != 0) {
+        set_direct(false);
+    }
+
+    iovec iov = {.iov_base = buff_, .iov_len = used_};
+    used_ = 0;
+    return write_all(&iov, 1);
+}
+
+/*! Flushes and closes the file.
+ */
+bool steg::OutputStream::close()
+{
+    bool ret = flush();
+    if (fd_ > STDOUT_FILENO && ::close(fd_) != 0 && !failed_) {
+        ret = fail(errno);
+    }
+
+    fd_ = -1;
+    std::free(buff_);
+    buff_ = nullptr;
+    return ret;
+}
+
+/*! Tunes the descriptor for the expected output size.
+ */
+void steg::OutputStream::prepare(const std::size_t size)
+{
+    struct stat st = {};
+    if (::fstat(fd_, &st) != 0) {
+        return;
+    }
+
+    // Fewer, larger pipe transfers
+    if (S_ISFIFO(st.st_mode)) {
+        ::fcntl(fd_, F_SETPIPE_SZ, static_cast<int>(kBufferSize));
+    }
+
+    // Large files skip the page cache (not all file systems allow it, in
+    // which case this is a no-op)
+    if (S_ISREG(st.st_mode) && size >= kDirectThreshold) {
+        set_direct(true);
+    }
+}
+
+/*! Toggles O_DIRECT.
+ */
+void steg::OutputStream::set_direct(const bool on)
+{
+    int flags = ::fcntl(fd_, F_GETFL);
+    if (flags < 0) {
+        return;
+    }
+
+    flags = on ? (flags | O_DIRECT) : (flags & ~O_DIRECT);
+    if (::fcntl(fd_, F_SETFL, flags) == 0) {
+        direct_ = on;
+    }
+}
+
+/*! Writes all of iov, resuming after short writes.
+ */
+bool steg::OutputStream::write_all(iovec* iov, int iovcnt)
+{
+    while (iovcnt != 0) {
+        // Skip drained entries
+        if (iov->iov_len == 0) {
+            ++iov;
+            --iovcnt;
+            continue;
+        }
+
+        ssize_t n = ::writev(fd_, iov, iovcnt);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+
+        // Non-blocking output (e.g. a shared pipe), wait for room
+        if (n < 0 && errno == EAGAIN) {
+            pollfd pfd = {.fd = fd_, .events = POLLOUT, .revents = 0};
+            ::poll(&pfd, 1, -1);
+            continue;
+        }
+
+        // File system refused direct I/O after all
+        if (n < 0 && errno == EINVAL && direct_) {
+            set_direct(false);
+            direct_ = false;
+            continue;
+        }
+
+        if (n < 0) {
+            return fail(errno);
+        }
+
+        offset_ += static_cast<std::size_t>(n);
+        for (auto left = static_cast<std::size_t>(n); left != 0;) {
+            std::size_t m = std::min(left, iov->iov_len);
+            iov->iov_base = static_cast<char*>(iov->iov_base) + m;
+            iov->iov_len -= m;
+            left -= m;
+
+            if (iov->iov_len == 0) {
+                ++iov;
+                --iovcnt;
+            }
+        }
+    }
+
+    return true;
+}
+
+/*! Reports a write error once and drops further output.
+ */
+bool steg::OutputStream::fail(const int error)
+{
+    if (!failed_) {
+        Log::error("Unable to write output,", std::strerror(error));
+    }
+
+    failed_ = true;
+    return false;
+}
+
+/*! Copies the next bytes of input.
+ */
+std::size_t steg::BufferInputStream::read(char* buff, const std::size_t size)
+{
+    const std::size_t n = std::min(size, size_ - pos_);
+    std::memcpy(buff, data_ + pos_, n);
+
+    pos_ += n;
+    return n;
+}
+
+/*! Appends to the buffer, doubling it as needed.
+ */
+bool steg::BufferOutputStream::write(const char* buff, const std::size_t size)
+{
+    if (buff_.size + size > capacity_) {
+        std::size_t capacity = std::max(capacity_ * 2, buff_.size + size);
+
+        std::unique_ptr<unsigned char[]> grown(new unsigned char[capacity]);
+        if (buff_.size != 0) {
+            std::memcpy(grown.get(), buff_.data.get(), buff_.size);
+        }
+
+        buff_.data = std::move(grown);
+        capacity_ = capacity;
+    }
+
+    std::memcpy(buff_.data.get() + buff_.size, buff, size);
+    buff_.size += size;
+    return true;
+}
+
+/*! Image::WriteFunc sink.
+ */
+void steg::BufferOutputStream::sink(void* context, void* data, int size)
+{
+    static_cast<BufferOutputStream*>(context)->write(
+        static_cast<const char*>(data), static_cast<std::size_t>(size));
+}
+
+/*! Hands over the written data.
+ */
+steg::IoBuffer steg::BufferOutputStream::release()
+{
+    IoBuffer buff = std::move(buff_);
+    buff_.size = 0;
+    capacity_ = 0;
+    return buff;
+}
+
+/*! Reads a key or initialization vector file.
+ */
+std::unique_ptr<char[]> steg::read_key(const char* path)
+{
+    InputStream inp;
+    if (!inp.open(path)) {
+        return nullptr;
+    }
+
+    // An empty or unsized file would leave an all-zero key
+    const std::size_t size = inp.size();
+    if (size == 0) {
+        Log::error("Empty or not a regular file", path);
+        return nullptr;
+    }
+
+    std::unique_ptr<char[]> buff(new char[std::max(size, kMinKeySize)]());
+    if (inp.read(buff.get(), size) != size) {
+        return nullptr;
+    }
+
+    return buff;
+}
+
+/*! Reads a whole file, or stdin.
+ */
+bool steg::read_all(const char* path, std::string& out)
+{
+    InputStream inp;
+    if (path != nullptr && !inp.open(path)) {
+        return false;
+    }
+
+    char chunk[1 << 16];
+    for (std::size_t n = 0; (n = inp.read(chunk, sizeof(chunk))) != 0;) {
+        out.append(chunk, n);
+    }
+
+    return !inp.failed();
+}
@@ -0,0 +1,218 @@
+/* stream.hpp -- v1.0
+   File and memory streams read and written by the block encoder and decoder */
+
+#pragma once
+
+#include "async_io.hpp"
+#include <cstddef>
+#include <memory>
+#include <string>
+
+// Fwd. decl.
+struct iovec;
+
+namespace steg {
+    //! @class InputStream
+    //! Reads from a file, or from stdin when no file is opened
+    class InputStream {
+    public:
+        //! Dtor.
+        ~InputStream();
+
+        //! Ctor.
+        InputStream() = default;
+
+        //! Move ctor.
+        InputStream(InputStream&& other) noexcept;
+
+        //! Move assignment
+        InputStream& operator()(InputStream&& other);
+
+        // Non-copyable object
+        InputStream(const InputStream&) = delete;
+
+        //! @return size of a regular file; 0 if the size is unknown (pipes,
+        //! terminals), in which case the input is read until EOF
+        std::size_t size() const;
+
+        //! Opens file
+        //! @param filePath path/to/file
+        //! @return true on success
+        bool open(const char* filePath);
+
+        //! Maps the file into memory for sequential reading
+        //! @return pointer to size() bytes of file content, or nullptr if the
+        //! input is not a large regular file, in which case use read()
+        const char* data();
+
+        //! Reads from file
+        //! Fills buff unless EOF is reached first or reading fails, so a
+        //! short count means the input is exhausted unless failed() is set
+        //! @param buff[out] output buffer
+        //! @param size size of buff
+        //! @return number of bytes read
+        std::size_t read(char* buff, std::size_t size);
+
+        //! @return true if a read failed; the input read so far is partial
+        bool failed() const
+        {
+            return failed_;
+        }
+    private:
+        // Files at least this large are mapped rather than read
+        static constexpr std::size_t kMapThreshold = 1 << 16;
+
+        // Encapsulated file descriptor, stdin by default
+        int fd_ = 0;
+
+        // Read-only mapping of the file, see data()
+        void* map_ = nullptr;
+        std::size_t mapSize_ = 0;
+
+        // A read failed, see failed()
+        bool failed_ = false;
+    };
+
+    //! @class OutputStream
+    //! Writes to a file, or to stdout when no file is opened
+    class OutputStream {
+    public:
+        //! Dtor.
+        ~OutputStream();
+
+        //! Ctor.
+        OutputStream() = default;
+
+        //! Move ctor.
+        OutputStream(OutputStream&& other) noexcept;
+
+        // Non-copyable object
+        OutputStream(const OutputStream&) = delete;
+
+        //! Creates or truncates file
+        //! @param filePath path/to/file
+        //! @return true on success
+        bool open(const char* filePath);
+
+        //! Writes buff, through the staging buffer if it fits
+        //! @return false if the data could not be written in full
+        bool write(const char* buff, std::size_t size);
+
+        //! Writes out buffered data
+        //! @return false if any write failed
+        bool flush();
+
+        //! Flushes and closes the file
+        //! @return false if any write since open() failed
+        bool close();
+    private:
+        // Helper: tunes the descriptor for the expected output size
+        void prepare(std::size_t size);
+
+        // Helper: toggles O_DIRECT
+        void set_direct(bool on);
+
+        // Helper: writes all of iov, resuming after short writes
+        bool write_all(iovec* iov, int iovcnt);
+
+        // Helper: reports a write error once and drops further output
+        bool fail(int error);
+
+        // Small writes are gathered in an aligned buffer of this size
+        static constexpr std::size_t kBufferSize = 1 << 20;
+        static constexpr std::size_t kAlignment = 4096;
+
+        // Outputs at least this large bypass the page cache
+        static constexpr std::size_t kDirectThreshold = 8 << 20;
+
+        // Output file, stdout by default
+        int fd_ = 1;
+
+        // Staging buffer and bytes held in it
+        char* buff_ = nullptr;
+        std::size_t used_ = 0;
+
+        // Bytes handed to the kernel so far
+        std::size_t offset_ = 0;
+
+        // O_DIRECT is set on fd_
+        bool direct_ = false;
+        // A write failed, everything after it is dropped
+        bool failed_ = false;
+    };
+
+    //! @class BufferInputStream
+    //! Reads from a block of memory, e.g. a file loaded by AsyncIo
+    class BufferInputStream {
+    public:
+        //! Ctor.
+        //! @param data input, must outlive the stream
+        //! @param size size of data
+        BufferInputStream(const char* data, std::size_t size)
+            : data_(data)
+            , size_(size)
+        {}
+
+        //! @return input size
+        std::size_t size() const
+        {
+            return size_;
+        }
+
+        //! @return the whole input, read in place by the encoder
+        const char* data() const
+        {
+            return data_;
+        }
+
+        //! Copies the next bytes of input to buff
+        //! @return number of bytes read
+        std::size_t read(char* buff, std::size_t size);
+    private:
+        const char* data_ = nullptr;
+        std::size_t size_ = 0;
+        std::size_t pos_ = 0;
+    };
+
+    //! @class BufferOutputStream
+    //! Writes to a growing block of memory that can be handed to AsyncIo
+    class BufferOutputStream {
+    public:
+        //! Appends buff
+        //! @return true
+        bool write(const char* buff, std::size_t size);
+
+        //! Image::WriteFunc sink appending to the BufferOutputStream passed
+        //! as context
+        static void sink(void* context, void* data, int size);
+
+        //! @return bytes written so far
+        std::size_t size() const
+        {
+            return buff_.size;
+        }
+
+        //! Hands over the written data and resets the stream
+        IoBuffer release();
+    private:
+        IoBuffer buff_;
+        std::size_t capacity_ = 0;
+    };
+
+    //! Smallest buffer returned by read_key()
+    constexpr std::size_t kMinKeySize = 32;
+
+    //! Reads a key or initialization vector file
+    //! The buffer is zero-padded to at least kMinKeySize bytes, since the
+    //! cipher reads a full key and block regardless of the file size
+    //! @param path path/to/file
+    //! @return file content, nullptr if the file can't be read, is empty
+    //! or is not a regular file
+    std::unique_ptr<char[]> read_key(const char* path);
+
+    //! Reads a whole file, or stdin
+    //! @param path path/to/file, nullptr for stdin
+    //! @param out[out] appended file content
+    //! @return false if the file can't be opened or a read fails
+    bool read_all(const char* path, std::string& out);
+} // namespace steg
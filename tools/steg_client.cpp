@@ -0,0 +1,193 @@
+/* steg_client.cpp -- v1.0
+   Sends one encode or decode request to a running "steg --serve" */
+
+#include "image.hpp"
+#include "log.hpp"
+#include "protocol.hpp"
+#include "stream.hpp"
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <getopt.h>
+#include <string>
+#include <unistd.h>
+
+namespace {
+    /*! Helper: Outputs usage statement to stdout
+     */
+    inline void print_usage(const char* app)
+    {
+        printf("Usage: %s {--encode|--decode}\n"
+               "   -s<socket>\n"
+               "  [-f<carrier-image>]\n"
+               "  [-o<output-file>]\n"
+               "  [-t<output-file-type>]\n"
+               "  [-i<message-file>]\n"
+               "  [-K<key-id>]\n"
+               "  [-P]\n"
+               "  [-b]\n\n",
+               app);
+
+        printf("\t%s\n\t%s\n\t%s\n\t%s\n\t%s\n\t%s\n\t%s\n\t%s\n",
+               "-s<socket>                 Server socket",
+               "-f<carrier-image>          Carrier image, sent to the server; "
+               "if left\n\t"
+               "                           unspecified, the server picks one "
+               "from its\n\t"
+               "                           carrier index (encode only)",
+               "-o<output-file>            Outputs to this file; defaults to "
+               "stdout",
+               "-t<output-file-type>       Accepted types: png, bmp, or tga",
+               "-i<message-file>           Message to encode; defaults to "
+               "stdin",
+               "-K<key-id>                 Server key id; defaults to "
+               "\"default\"",
+               "-P                         Send the carrier path instead, for "
+               "the server\n\t"
+               "                           to read itself",
+               "-b                         Base64 encoded payload");
+    }
+
+    // Helper: reads a whole file, or stdin
+    bool slurp(const std::string& path, std::string& out)
+    {
+        steg::InputStream inp;
+        if (!path.empty() && !inp.open(path.c_str())) {
+            return false;
+        }
+
+        char chunk[1 << 16];
+        for (std::size_t n = 0; (n = inp.read(chunk, sizeof(chunk))) != 0;) {
+            out.append(chunk, n);
+        }
+
+        return true;
+    }
+} // namespace
+
+int main(int argc, char** argv)
+{
+    std::string socketPath;
+    std::string imagePath;
+    std::string outputPath;
+    std::string outputType;
+    std::string inputPath;
+    std::string keyId;
+
+    steg::Request req;
+
+    const option longOptions[] = {
+        {.name = "help", .has_arg = no_argument, .flag = nullptr, .val = 'h'},
+        {.name = "encode",
+         .has_arg = no_argument,
+         .flag = nullptr,
+         .val = 'E'},
+        {.name = "decode",
+         .has_arg = no_argument,
+         .flag = nullptr,
+         .val = 'D'},
+        {.name = nullptr, .has_arg = 0, .flag = nullptr, .val = 0},
+    };
+
+    int opt = 0;
+    while ((opt = getopt_long(
+                argc, argv, "s:f:o:t:i:K:Pbh", longOptions, nullptr))
+           != -1) {
+        switch (opt) {
+            case 's':
+                socketPath = optarg;
+                break;
+            case 'f':
+                imagePath = optarg;
+                break;
+            case 'o':
+                outputPath = optarg;
+                break;
+            case 't':
+                outputType = optarg;
+                break;
+            case 'i':
+                inputPath = optarg;
+                break;
+            case 'K':
+                keyId = optarg;
+                break;
+            case 'P':
+                req.flags |= steg::Request::kCarrierPath;
+                break;
+            case 'b':
+                req.flags |= steg::Request::kBase64;
+                break;
+            case 'E':
+                req.op = steg::Request::kEncode;
+                break;
+            case 'D':
+                req.op = steg::Request::kDecode;
+                break;
+            default:
+                print_usage(argv[0]);
+                return opt == 'h' ? 0 : 1;
+        }
+    }
+
+    // Encode requests may leave the carrier to the server
+    if (req.op == 0 || socketPath.empty()
+        || (imagePath.empty() && req.op != steg::Request::kEncode)) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    // Carrier content, or its path
+    std::string carrier;
+    if (imagePath.empty()) {
+        req.flags &= static_cast<std::uint8_t>(~steg::Request::kCarrierPath);
+    } else if ((req.flags & steg::Request::kCarrierPath) != 0) {
+        carrier = imagePath;
+    } else if (!slurp(imagePath, carrier)) {
+        steg::Log::error("Unable to read", imagePath.c_str());
+        return 1;
+    }
+
+    std::string payload;
+    if (req.op == steg::Request::kEncode && !slurp(inputPath, payload)) {
+        steg::Log::error("Unable to read", inputPath.c_str());
+        return 1;
+    }
+
+    req.type = steg::Image::parse_type(outputType.c_str());
+    req.keyId = keyId;
+    req.carrier = carrier;
+    req.payload = payload;
+
+    const int fd = steg::connect_to(socketPath.c_str());
+    if (fd < 0) {
+        steg::Log::error(
+            "Unable to connect to", socketPath.c_str(), std::strerror(errno));
+        return 1;
+    }
+
+    steg::Response res;
+    const bool ok
+        = steg::write_request(fd, req) && steg::read_response(fd, res);
+    ::close(fd);
+
+    if (!ok) {
+        steg::Log::error("Connection to server lost");
+        return 1;
+    }
+
+    if (res.status != steg::Response::kOk) {
+        const std::string reason(res.data);
+        steg::Log::error("Server replied", reason.c_str());
+        return 1;
+    }
+
+    steg::OutputStream output;
+    if (!outputPath.empty() && !output.open(outputPath.c_str())) {
+        steg::Log::error("Unable to open", outputPath.c_str());
+        return 1;
+    }
+
+    const bool written = output.write(res.data.data(), res.data.size());
+    return output.close() && written ? 0 : 1;
+}
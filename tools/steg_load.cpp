@@ -0,0 +1,254 @@
+/* steg_load.cpp -- v1.0
+   Load generator for "steg --serve": replays one request over several
+   concurrent connections and reports throughput and latency percentiles */
+
+#include "image.hpp"
+#include "log.hpp"
+#include "protocol.hpp"
+#include "stream.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <getopt.h>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+    using Clock = std::chrono::steady_clock;
+
+    /*! Helper: Outputs usage statement to stdout
+     */
+    inline void print_usage(const char* app)
+    {
+        printf("Usage: %s {--encode|--decode}\n"
+               "   -s<socket>\n"
+               "   -f<carrier-image>\n"
+               "  [-i<message-file>]\n"
+               "  [-t<output-file-type>]\n"
+               "  [-K<key-id>]\n"
+               "  [-c<connections>]\n"
+               "  [-n<requests>]\n"
+               "  [-P]\n"
+               "  [-b]\n\n",
+               app);
+
+        printf("\t%s\n\t%s\n\t%s\n\t%s\n",
+               "-c<connections>            Concurrent connections; defaults "
+               "to 4",
+               "-n<requests>               Requests per connection; defaults "
+               "to 100",
+               "-P                         Send the carrier path instead of "
+               "its content",
+               "Other options as for steg_client; replies are checked but "
+               "discarded");
+    }
+
+    // Helper: reads a whole file
+    bool slurp(const std::string& path, std::string& out)
+    {
+        steg::InputStream inp;
+        if (path.empty() || !inp.open(path.c_str())) {
+            return false;
+        }
+
+        char chunk[1 << 16];
+        for (std::size_t n = 0; (n = inp.read(chunk, sizeof(chunk))) != 0;) {
+            out.append(chunk, n);
+        }
+
+        return true;
+    }
+
+    // Helper: latency at quantile q of sorted samples, in milliseconds
+    double quantile(const std::vector<double>& sorted, const double q)
+    {
+        if (sorted.empty()) {
+            return 0;
+        }
+
+        const auto i = static_cast<std::size_t>(
+            q * static_cast<double>(sorted.size() - 1) + 0.5);
+        return sorted[i];
+    }
+} // namespace
+
+int main(int argc, char** argv)
+{
+    std::string socketPath;
+    std::string imagePath;
+    std::string outputType;
+    std::string inputPath;
+    std::string keyId;
+
+    unsigned connections = 4;
+    unsigned requests = 100;
+
+    steg::Request req;
+
+    const option longOptions[] = {
+        {.name = "help", .has_arg = no_argument, .flag = nullptr, .val = 'h'},
+        {.name = "encode",
+         .has_arg = no_argument,
+         .flag = nullptr,
+         .val = 'E'},
+        {.name = "decode",
+         .has_arg = no_argument,
+         .flag = nullptr,
+         .val = 'D'},
+        {.name = nullptr, .has_arg = 0, .flag = nullptr, .val = 0},
+    };
+
+    int opt = 0;
+    while ((opt = getopt_long(
+                argc, argv, "s:f:t:i:K:c:n:Pbh", longOptions, nullptr))
+           != -1) {
+        switch (opt) {
+            case 's':
+                socketPath = optarg;
+                break;
+            case 'f':
+                imagePath = optarg;
+                break;
+            case 't':
+                outputType = optarg;
+                break;
+            case 'i':
+                inputPath = optarg;
+                break;
+            case 'K':
+                keyId = optarg;
+                break;
+            case 'c':
+                connections
+                    = static_cast<unsigned>(std::strtoul(optarg, nullptr, 10));
+                break;
+            case 'n':
+                requests
+                    = static_cast<unsigned>(std::strtoul(optarg, nullptr, 10));
+                break;
+            case 'P':
+                req.flags |= steg::Request::kCarrierPath;
+                break;
+            case 'b':
+                req.flags |= steg::Request::kBase64;
+                break;
+            case 'E':
+                req.op = steg::Request::kEncode;
+                break;
+            case 'D':
+                req.op = steg::Request::kDecode;
+                break;
+            default:
+                print_usage(argv[0]);
+                return opt == 'h' ? 0 : 1;
+        }
+    }
+
+    if (req.op == 0 || socketPath.empty() || imagePath.empty()
+        || connections == 0 || requests == 0
+        || (req.op == steg::Request::kEncode && inputPath.empty())) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    std::string carrier;
+    if ((req.flags & steg::Request::kCarrierPath) != 0) {
+        carrier = imagePath;
+    } else if (!slurp(imagePath, carrier)) {
+        steg::Log::error("Unable to read", imagePath.c_str());
+        return 1;
+    }
+
+    std::string payload;
+    if (req.op == steg::Request::kEncode && !slurp(inputPath, payload)) {
+        steg::Log::error("Unable to read", inputPath.c_str());
+        return 1;
+    }
+
+    req.type = steg::Image::parse_type(outputType.c_str());
+    req.keyId = keyId;
+    req.carrier = carrier;
+    req.payload = payload;
+
+    // Per-connection latencies, merged once everyone is done
+    std::vector<std::vector<double>> latencies(connections);
+    std::atomic<std::size_t> failed = 0;
+    std::atomic<std::size_t> replyBytes = 0;
+
+    const Clock::time_point start = Clock::now();
+
+    std::vector<std::thread> clients;
+    for (unsigned c = 0; c != connections; ++c) {
+        clients.emplace_back([&, c] {
+            const int fd = steg::connect_to(socketPath.c_str());
+            if (fd < 0) {
+                failed += requests;
+                return;
+            }
+
+            std::vector<double>& samples = latencies[c];
+            samples.reserve(requests);
+
+            steg::Response res;
+            for (unsigned i = 0; i != requests; ++i) {
+                const Clock::time_point t = Clock::now();
+                if (!steg::write_request(fd, req)
+                    || !steg::read_response(fd, res)) {
+                    failed += requests - i;
+                    break;
+                }
+
+                const std::chrono::duration<double, std::milli> ms
+                    = Clock::now() - t;
+                samples.push_back(ms.count());
+
+                if (res.status != steg::Response::kOk) {
+                    ++failed;
+                }
+
+                replyBytes += res.data.size();
+            }
+
+            ::close(fd);
+        });
+    }
+
+    for (std::thread& client: clients) {
+        client.join();
+    }
+
+    const std::chrono::duration<double> elapsed = Clock::now() - start;
+
+    std::vector<double> all;
+    for (const std::vector<double>& samples: latencies) {
+        all.insert(all.end(), samples.begin(), samples.end());
+    }
+
+    std::sort(all.begin(), all.end());
+
+    const double seconds = elapsed.count();
+    const double sent = static_cast<double>(all.size())
+                        * static_cast<double>(carrier.size() + payload.size());
+
+    std::printf("connections=%u requests=%zu failed=%zu seconds=%.3f "
+                "req_per_s=%.1f sent_mb_per_s=%.1f recv_mb_per_s=%.1f "
+                "p50_ms=%.3f p99_ms=%.3f max_ms=%.3f\n",
+                connections,
+                all.size(),
+                failed.load(),
+                seconds,
+                static_cast<double>(all.size()) / seconds,
+                sent / seconds / 1e6,
+                static_cast<double>(replyBytes.load()) / seconds / 1e6,
+                quantile(all, 0.50),
+                quantile(all, 0.99),
+                all.empty() ? 0 : all.back());
+
+    return failed == 0 ? 0 : 1;
+}
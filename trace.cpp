@@ -0,0 +1,175 @@
+/* trace.cpp -- v1.0 */
+
+#include "trace.hpp"
+#include "log.hpp"
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+    // Events kept per thread, a power of two
+    constexpr std::uint64_t kRingSize = std::uint64_t{1} << 15;
+
+    // @bag
+    struct Event {
+        const char* name;
+        std::uint64_t begin;
+        std::uint64_t end;
+        std::uint64_t job;
+    };
+
+    // @bag
+    // Events of one thread; only that thread writes, write() reads once
+    // every thread is done
+    struct Ring {
+        Event events[kRingSize];
+        std::atomic<std::uint64_t> head = 0;
+        unsigned tid = 0;
+    };
+
+    // @bag
+    // Rings of every thread that recorded, kept past the thread's exit
+    struct Registry {
+        std::mutex mutex;
+        std::vector<std::unique_ptr<Ring>> rings;
+        std::uint64_t start = 0;
+    };
+
+    Registry& registry()
+    {
+        static Registry instance;
+        return instance;
+    }
+
+    // Helper: ring of the calling thread, registered on first use
+    Ring& local()
+    {
+        thread_local Ring* ring = nullptr;
+        if (ring == nullptr) {
+            Registry& reg = registry();
+            std::lock_guard lock(reg.mutex);
+            reg.rings.push_back(std::make_unique<Ring>());
+            ring = reg.rings.back().get();
+            ring->tid = static_cast<unsigned>(reg.rings.size());
+        }
+
+        return *ring;
+    }
+
+    // Helper: nanoseconds since the trace started, as fractional
+    // microseconds, the unit of trace-event timestamps
+    double micros(const std::uint64_t ns, const std::uint64_t start)
+    {
+        return static_cast<double>(ns - start) / 1e3;
+    }
+} // namespace
+
+/*! Flag checked by every scope.
+ */
+std::atomic<bool> steg::Trace::enabled_ = false;
+
+/*! Job of the calling thread.
+ */
+thread_local std::uint64_t steg::Trace::job_ = 0;
+
+/*! Starts recording.
+ */
+void steg::Trace::enable()
+{
+    registry().start = now();
+    enabled_.store(true, std::memory_order_relaxed);
+}
+
+/*! Steady clock time.
+ */
+std::uint64_t steg::Trace::now()
+{
+    return static_cast<std::uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch())
+            .count());
+}
+
+/*! Records one event of the calling thread.
+ */
+void steg::Trace::record(const char* name,
+                         const std::uint64_t begin,
+                         const std::uint64_t end)
+{
+    Ring& ring = local();
+    const std::uint64_t head = ring.head.load(std::memory_order_relaxed);
+    ring.events[head & (kRingSize - 1)] = {name, begin, end, job_};
+    ring.head.store(head + 1, std::memory_order_release);
+}
+
+/*! Writes every recorded event.
+ */
+bool steg::Trace::write(const char* path)
+{
+    std::FILE* file = std::fopen(path, "w");
+    if (file == nullptr) {
+        Log::error("Unable to create", path);
+        return false;
+    }
+
+    Registry& reg = registry();
+    std::lock_guard lock(reg.mutex);
+
+    const long pid = static_cast<long>(::getpid());
+    std::uint64_t dropped = 0;
+
+    std::fputs("{\"traceEvents\":[\n", file);
+
+    const char* separator = "";
+    for (const std::unique_ptr<Ring>& ring: reg.rings) {
+        std::fprintf(file,
+                     "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%ld,"
+                     "\"tid\":%u,\"args\":{\"name\":\"thread %u\"}}",
+                     separator,
+                     pid,
+                     ring->tid,
+                     ring->tid);
+        separator = ",\n";
+
+        // Oldest event still in the ring first
+        const std::uint64_t head = ring->head.load(std::memory_order_acquire);
+        const std::uint64_t first = head > kRingSize ? head - kRingSize : 0;
+        dropped += first;
+
+        for (std::uint64_t i = first; i != head; ++i) {
+            const Event& event = ring->events[i & (kRingSize - 1)];
+            std::fprintf(file,
+                         "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":%ld,"
+                         "\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f",
+                         separator,
+                         event.name,
+                         pid,
+                         ring->tid,
+                         micros(event.begin, reg.start),
+                         static_cast<double>(event.end - event.begin) / 1e3);
+
+            if (event.job != 0) {
+                std::fprintf(
+                    file, ",\"args\":{\"job\":%" PRIu64 "}", event.job);
+            }
+
+            std::fputc('}', file);
+        }
+    }
+
+    std::fprintf(file,
+                 "\n],\"displayTimeUnit\":\"ms\","
+                 "\"otherData\":{\"dropped\":%" PRIu64 "}}\n",
+                 dropped);
+
+    if (std::fclose(file) != 0) {
+        Log::error("Unable to write", path);
+        return false;
+    }
+
+    return true;
+}
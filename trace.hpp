@@ -0,0 +1,114 @@
+/* trace.hpp -- v1.0
+   Begin/end events of stages, tiles and jobs, recorded per thread for
+   --trace and written out as Chrome trace-event JSON (chrome://tracing,
+   Perfetto). Each thread appends to its own ring buffer without locks; a
+   full ring overwrites its oldest events. A disabled scope costs one flag
+   check */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+namespace steg {
+    //! @class Trace
+    //! Event recorder shared by all threads
+    class Trace {
+    public:
+        //! @return true once enable() has been called
+        static bool enabled()
+        {
+            return enabled_.load(std::memory_order_relaxed);
+        }
+
+        //! Starts recording
+        static void enable();
+
+        //! @return steady clock time, in nanoseconds
+        static std::uint64_t now();
+
+        //! Records one event of the calling thread
+        //! @param name event name, must outlive the trace (a literal)
+        //! @param begin start time, from now()
+        //! @param end end time, from now()
+        static void record(const char* name,
+                           std::uint64_t begin,
+                           std::uint64_t end);
+
+        //! @return job of the calling thread, 0 if none
+        static std::uint64_t job()
+        {
+            return job_;
+        }
+
+        //! Sets the job the calling thread works for, added to its events
+        //! @return job it replaces
+        static std::uint64_t exchange_job(std::uint64_t job)
+        {
+            const std::uint64_t previous = job_;
+            job_ = job;
+            return previous;
+        }
+
+        //! Writes every recorded event; call once all threads are done
+        //! @param path output file
+        //! @return true on success
+        static bool write(const char* path);
+    private:
+        static std::atomic<bool> enabled_;
+        static thread_local std::uint64_t job_;
+    };
+
+    //! @class TraceScope
+    //! Records a scope as one event, when tracing is enabled
+    class TraceScope {
+    public:
+        //! Ctor.
+        //! @param name event name, a literal
+        explicit TraceScope(const char* name)
+            : name_(name)
+        {
+            if (Trace::enabled()) {
+                begin_ = Trace::now();
+            }
+        }
+
+        //! Dtor. Records the event
+        ~TraceScope()
+        {
+            if (begin_ != 0) {
+                Trace::record(name_, begin_, Trace::now());
+            }
+        }
+
+        // Non-copyable object
+        TraceScope(const TraceScope&) = delete;
+        TraceScope& operator=(const TraceScope&) = delete;
+    private:
+        const char* name_;
+        std::uint64_t begin_ = 0;
+    };
+
+    //! @class TraceJob
+    //! Tags the events of the calling thread with a job for a scope
+    class TraceJob {
+    public:
+        //! Ctor.
+        //! @param job job number, such as a manifest line
+        explicit TraceJob(std::uint64_t job)
+            : previous_(Trace::exchange_job(job))
+        {}
+
+        //! Dtor. Restores the job before
+        ~TraceJob()
+        {
+            Trace::exchange_job(previous_);
+        }
+
+        // Non-copyable object
+        TraceJob(const TraceJob&) = delete;
+        TraceJob& operator=(const TraceJob&) = delete;
+    private:
+        std::uint64_t previous_;
+    };
+} // namespace steg
@@ -0,0 +1,163 @@
+/* work_deque.hpp -- v1.0
+   Lock-free work-stealing deque (Chase-Lev), one per scheduler worker */
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace steg {
+    //! @class WorkDeque
+    //! The owning thread pushes and pops at the bottom, any other thread
+    //! steals from the top; only a race for the last item takes a CAS
+    //! (see Le et al., "Correct and Efficient Work-Stealing for Weak Memory
+    //! Models", PPoPP 2013)
+    template <typename T>
+    class WorkDeque {
+    public:
+        //! Ctor.
+        //! @param capacity initial capacity, rounded up to a power of two
+        explicit WorkDeque(std::size_t capacity = 256)
+        {
+            std::size_t size = 1;
+            while (size < capacity) {
+                size *= 2;
+            }
+
+            rings_.push_back(std::make_unique<Ring>(size));
+            ring_.store(rings_.back().get(), std::memory_order_relaxed);
+        }
+
+        // Non-copyable object
+        WorkDeque(const WorkDeque&) = delete;
+        WorkDeque& operator=(const WorkDeque&) = delete;
+
+        //! Adds an item at the bottom; owner only
+        void push(T* item)
+        {
+            const std::int64_t b = bottom_.load(std::memory_order_relaxed);
+            const std::int64_t t = top_.load(std::memory_order_acquire);
+            Ring* ring = ring_.load(std::memory_order_relaxed);
+
+            if (b - t > static_cast<std::int64_t>(ring->capacity) - 1) {
+                ring = grow(ring, t, b);
+            }
+
+            ring->put(b, item);
+            std::atomic_thread_fence(std::memory_order_release);
+            bottom_.store(b + 1, std::memory_order_relaxed);
+        }
+
+        //! Takes the newest item; owner only
+        //! @return item, nullptr if empty
+        T* pop()
+        {
+            const std::int64_t b = bottom_.load(std::memory_order_relaxed) - 1;
+            Ring* ring = ring_.load(std::memory_order_relaxed);
+
+            bottom_.store(b, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            std::int64_t t = top_.load(std::memory_order_relaxed);
+
+            if (t > b) {
+                bottom_.store(b + 1, std::memory_order_relaxed);
+                return nullptr; // Empty
+            }
+
+            T* item = ring->get(b);
+            if (t == b) {
+                // Last item, race the thieves for it
+                if (!top_.compare_exchange_strong(t,
+                                                  t + 1,
+                                                  std::memory_order_seq_cst,
+                                                  std::memory_order_relaxed)) {
+                    item = nullptr;
+                }
+
+                bottom_.store(b + 1, std::memory_order_relaxed);
+            }
+
+            return item;
+        }
+
+        //! Takes the oldest item; any thread
+        //! @return item, nullptr if empty or lost a race
+        T* steal()
+        {
+            std::int64_t t = top_.load(std::memory_order_acquire);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            const std::int64_t b = bottom_.load(std::memory_order_acquire);
+
+            if (t >= b) {
+                return nullptr;
+            }
+
+            T* item = ring_.load(std::memory_order_acquire)->get(t);
+            if (!top_.compare_exchange_strong(t,
+                                              t + 1,
+                                              std::memory_order_seq_cst,
+                                              std::memory_order_relaxed)) {
+                return nullptr;
+            }
+
+            return item;
+        }
+
+        //! @return approximate number of items
+        std::size_t size() const
+        {
+            const std::int64_t b = bottom_.load(std::memory_order_relaxed);
+            const std::int64_t t = top_.load(std::memory_order_relaxed);
+            return b > t ? static_cast<std::size_t>(b - t) : 0;
+        }
+    private:
+        // Circular buffer of item slots
+        struct Ring {
+            explicit Ring(std::size_t size)
+                : capacity(size)
+                , slots(new std::atomic<T*>[size])
+            {}
+
+            T* get(std::int64_t i) const
+            {
+                return slots[static_cast<std::size_t>(i) & (capacity - 1)].load(
+                    std::memory_order_relaxed);
+            }
+
+            void put(std::int64_t i, T* item)
+            {
+                slots[static_cast<std::size_t>(i) & (capacity - 1)].store(
+                    item, std::memory_order_relaxed);
+            }
+
+            std::size_t capacity;
+            std::unique_ptr<std::atomic<T*>[]> slots;
+        };
+
+        // Helper: doubles the ring; old rings stay alive for thieves still
+        // reading them, until the deque goes away
+        Ring* grow(Ring* ring, std::int64_t t, std::int64_t b)
+        {
+            rings_.push_back(std::make_unique<Ring>(ring->capacity * 2));
+            Ring* grown = rings_.back().get();
+
+            for (std::int64_t i = t; i != b; ++i) {
+                grown->put(i, ring->get(i));
+            }
+
+            ring_.store(grown, std::memory_order_release);
+            return grown;
+        }
+
+        // Thieves and owner on separate cache lines
+        alignas(64) std::atomic<std::int64_t> top_ = 0;
+        alignas(64) std::atomic<std::int64_t> bottom_ = 0;
+        alignas(64) std::atomic<Ring*> ring_ = nullptr;
+
+        // Owner only
+        std::vector<std::unique_ptr<Ring>> rings_;
+    };
+} // namespace steg